@@ -0,0 +1,987 @@
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PerfCounters.hpp"
+#include "sources/AsyncIngest.hpp"
+#include "sources/FilteredView.hpp"
+#include "sources/MagicalContainer.hpp"
+#include "sources/PageAllocator.hpp"
+#include "sources/PersistentContainer.hpp"
+#include "sources/PrimeKernel.hpp"
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace ariel;
+
+namespace {
+
+    PerfCounters counters;
+    PerfCounters::Reading lastCounters;
+
+    /// Runs fn once and returns the elapsed wall-clock time in seconds. The hardware counters of the run are
+    /// kept in lastCounters.
+    template<typename Function>
+    double timeSeconds(Function &&fn) {
+        auto start = std::chrono::steady_clock::now();
+        lastCounters = counters.measure(fn);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        return elapsed.count();
+    }
+
+    /// Prints the counters of the last timed run divided by the number of elements it processed.
+    void printCounters(const char *label, std::size_t elements) {
+        if (!counters.available() || elements == 0) {
+            return;
+        }
+        const auto perElement = [elements](PerfCounters::Event event) {
+            return lastCounters[event] / static_cast<double>(elements);
+        };
+        std::cout << "  " << std::left << std::setw(24) << label << std::right << std::fixed << std::setprecision(3);
+        const std::array<std::pair<PerfCounters::Event, const char *>, 5> columns = {{
+                {PerfCounters::Cycles, "cycles"}, {PerfCounters::Instructions, "instr"},
+                {PerfCounters::L1DataMisses, "L1d-miss"}, {PerfCounters::LastLevelMisses, "LLC-miss"},
+                {PerfCounters::BranchMisses, "br-miss"}}};
+        for (const auto &[event, name]: columns) {
+            if (lastCounters.has(event)) {
+                std::cout << "  " << name << "/elem " << std::setw(8) << perElement(event);
+            } else {
+                std::cout << "  " << name << "/elem      n/a";
+            }
+        }
+        if (lastCounters.cpi() > 0) {
+            std::cout << "  CPI " << lastCounters.cpi();
+        }
+        std::cout << std::defaultfloat << std::setprecision(6) << '\n';
+    }
+
+    /// A benchmark runs when no names are given on the command line or when its name is one of them.
+    bool selected(int argc, char **argv, const char *name) {
+        if (argc < 2) {
+            return true;
+        }
+        for (int i = 1; i < argc; ++i) {
+            if (std::strcmp(argv[i], name) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::vector<int> randomValues(std::size_t count, int low, int high) {
+        std::mt19937 gen(12345);
+        std::uniform_int_distribution<int> dis(low, high);
+        std::vector<int> values(count);
+        for (int &value: values) {
+            value = dis(gen);
+        }
+        return values;
+    }
+
+    /// The original per-value primality test: trial division up to sqrt(num).
+    bool scalarIsPrime(int num) {
+        if (num < 2)
+            return false;
+
+        for (int i = 2; i <= sqrt(num); ++i) {
+            if (num % i == 0)
+                return false;
+        }
+        return true;
+    }
+
+    void benchPrimes() {
+        const std::size_t count = 10000000;
+        std::cout << "### primes: classifying " << count << " random values\n";
+
+        for (int high: {1000000, 2147483647}) {
+            std::vector<int> values = randomValues(count, 0, high);
+            std::vector<std::uint64_t> bitmap(primeBitmapWords(count));
+            std::size_t found = 0;
+
+            double batch = timeSeconds([&] {
+                classifyPrimes(values, bitmap);
+            });
+            for (std::uint64_t word: bitmap) {
+                found += static_cast<std::size_t>(std::popcount(word));
+            }
+            std::cout << "range [0, " << high << "]: batch kernel " << batch << " s (" << found << " primes)";
+
+            if (high <= 1000000) {
+                std::size_t scalarFound = 0;
+                double scalar = timeSeconds([&] {
+                    for (int value: values) {
+                        scalarFound += scalarIsPrime(value) ? 1U : 0U;
+                    }
+                });
+                std::cout << ", scalar loop " << scalar << " s (" << scalarFound << " primes), speedup "
+                          << scalar / batch << "x";
+            }
+            std::cout << '\n';
+        }
+
+        std::vector<int> load = randomValues(1000000, 0, 2147483647);
+        MagicalContainer container;
+        double build = timeSeconds([&] {
+            container.addElements(load);
+        });
+        std::cout << "bulk load of " << load.size() << " values with prime view build: " << build << " s\n";
+    }
+
+    void benchSnapshot() {
+        const std::size_t count = 10000000;
+        const std::string path = (std::filesystem::temp_directory_path() / "magical_container_bench.snapshot").string();
+        std::cout << "### snapshot: " << count << " elements\n";
+
+        std::vector<int> values = randomValues(count, 0, 2147483647);
+        MagicalContainer container;
+        double rebuild = timeSeconds([&] {
+            container.addElements(values);
+        });
+        double save = timeSeconds([&] {
+            container.save(path);
+        });
+
+        long long sum = 0;
+        double map = timeSeconds([&] {
+            MagicalContainer mapped = MagicalContainer::mapFromFile(path);
+            MagicalContainer::PrimeIterator prime(mapped);
+            sum += *prime + mapped.getElement(mapped.size() - 1);
+        });
+        double verified = timeSeconds([&] {
+            MagicalContainer mapped = MagicalContainer::mapFromFile(path, true);
+            sum += mapped.size();
+        });
+        std::filesystem::remove(path);
+
+        std::cout << "rebuild with bulk addElements: " << rebuild << " s, save: " << save << " s\n"
+                  << "mapFromFile + first access: " << map * 1000 << " ms, with checksum verification: "
+                  << verified * 1000 << " ms (" << sum << ")\n";
+    }
+
+    void benchIngest() {
+        const std::size_t count = 10000000;
+        const std::string path = (std::filesystem::temp_directory_path() / "magical_container_bench.txt").string();
+        std::cout << "### ingest: " << count << " newline-separated integers\n";
+        {
+            std::ofstream file(path);
+            for (int value: randomValues(count, -1000000000, 1000000000)) {
+                file << value << '\n';
+            }
+        }
+
+        MagicalContainer streamed;
+        IngestStats stats = streamed.ingestFile(path);
+
+        MagicalContainer parsed;
+        double iostream = timeSeconds([&] {
+            std::ifstream file(path);
+            std::vector<int> values;
+            int value = 0;
+            while (file >> value) {
+                values.push_back(value);
+            }
+            parsed.addElements(values);
+        });
+        std::filesystem::remove(path);
+
+        const double parseSeconds = stats.seconds - stats.mergeSeconds;
+        std::cout << "ingestFile: " << stats.seconds << " s (" << stats.gigabytesPerSecond() << " GB/s), parsing "
+                  << parseSeconds << " s (" << static_cast<double>(stats.bytes) / parseSeconds / 1e9
+                  << " GB/s), merging " << stats.batches << " batches " << stats.mergeSeconds << " s\n"
+                  << "ifstream >> + addElements: " << iostream << " s ("
+                  << static_cast<double>(stats.bytes) / iostream / 1e9 << " GB/s), speedup "
+                  << iostream / stats.seconds << "x, sizes " << streamed.size() << " / " << parsed.size() << "\n";
+    }
+
+    void benchExport() {
+        const std::size_t count = 10000000;
+        const std::string path = (std::filesystem::temp_directory_path() / "magical_container_bench.out").string();
+        std::cout << "### export: " << count << " values in ascending order\n";
+        MagicalContainer container;
+        container.addElements(randomValues(count, -1000000000, 1000000000));
+
+        std::size_t bytes = 0;
+        double direct = timeSeconds([&] {
+            int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            IntegerWriter writer(fd);
+            container.writeAscending(writer);
+            bytes = writer.bytesWritten();
+            ::close(fd);
+        });
+        double stream = timeSeconds([&] {
+            std::ofstream file(path);
+            MagicalContainer::AscendingIterator ascending(container);
+            for (auto it = ascending.begin(); it != ascending.end(); ++it) {
+                file << *it << ' ';
+            }
+        });
+        std::filesystem::remove(path);
+
+        std::cout << "writeAscending: " << direct << " s (" << static_cast<double>(bytes) / direct / 1e9
+                  << " GB/s), ofstream << loop: " << stream << " s ("
+                  << static_cast<double>(bytes) / stream / 1e9 << " GB/s), speedup " << stream / direct << "x\n";
+    }
+
+    /// Walks an iterator from begin() to end(), summing what it yields.
+    template<typename Iterator>
+    long long sumIterator(Iterator iterator) {
+        long long sum = 0;
+        for (auto it = iterator.begin(); it != iterator.end(); ++it) {
+            sum += *it;
+        }
+        return sum;
+    }
+
+    void benchIterators() {
+        if (!counters.available()) {
+            std::cout << "(hardware counters unavailable: " << counters.unavailableReason()
+                      << "; reporting wall-clock time only)\n";
+        }
+        for (std::size_t count: {std::size_t{100000}, std::size_t{10000000}}) {
+            std::cout << "### iterators: " << count << " elements\n";
+            MagicalContainer container;
+            container.addElements(randomValues(count, 0, 2147483647));
+            const auto elements = static_cast<std::size_t>(container.size());
+            const auto primes = static_cast<std::size_t>(container.primeCount());
+            const std::vector<int> array = container.getElements();
+
+            long long sum = 0;
+            double flat = timeSeconds([&] {
+                for (int element: array) {
+                    sum += element;
+                }
+            });
+            std::cout << "contiguous array: " << flat / static_cast<double>(elements) * 1e9 << " ns/elem\n";
+            printCounters("contiguous array", elements);
+
+            double ascending = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::AscendingIterator(container));
+            });
+            std::cout << "AscendingIterator: " << ascending / static_cast<double>(elements) * 1e9 << " ns/elem\n";
+            printCounters("AscendingIterator", elements);
+
+            double cross = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::SideCrossIterator(container));
+            });
+            std::cout << "SideCrossIterator: " << cross / static_cast<double>(elements) * 1e9 << " ns/elem\n";
+            printCounters("SideCrossIterator", elements);
+
+            double prime = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::PrimeIterator(container));
+            });
+            std::cout << "PrimeIterator: " << prime / static_cast<double>(primes) * 1e9 << " ns/prime ("
+                      << primes << " primes)\n";
+            printCounters("PrimeIterator", primes);
+
+            double descending = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::DescendingIterator(container));
+            });
+            std::cout << "DescendingIterator: " << descending / static_cast<double>(elements) * 1e9 << " ns/elem\n";
+            printCounters("DescendingIterator", elements);
+
+            double reverseCross = timeSeconds([&] {
+                MagicalContainer::SideCrossIterator iterator(container);
+                for (auto it = iterator.rbegin(); it != iterator.rend(); ++it) {
+                    sum += *it;
+                }
+            });
+            std::cout << "reverse SideCrossIterator: " << reverseCross / static_cast<double>(elements) * 1e9
+                      << " ns/elem\n";
+            printCounters("reverse SideCross", elements);
+
+            double copied = timeSeconds([&] {
+                std::vector<int> copy = container.getElements();
+                std::reverse(copy.begin(), copy.end());
+                for (int element: copy) {
+                    sum += element;
+                }
+            });
+            std::cout << "getElements + reverse: " << copied / static_cast<double>(elements) * 1e9 << " ns/elem\n";
+            printCounters("getElements + reverse", elements);
+            std::cout << "(checksum " << sum << ")\n";
+        }
+    }
+
+    /// Prints the p50, p99, p99.9 and maximum of a set of latencies given in nanoseconds.
+    void printLatencies(const char *label, std::vector<double> &latencies) {
+        std::sort(latencies.begin(), latencies.end());
+        auto at = [&latencies](double quantile) {
+            return latencies[static_cast<std::size_t>(quantile * static_cast<double>(latencies.size() - 1))];
+        };
+        std::cout << label << ": p50 " << at(0.5) << " ns, p99 " << at(0.99) << " ns, p99.9 " << at(0.999)
+                  << " ns, max " << latencies.back() << " ns (" << latencies.size() << " samples)\n";
+    }
+
+    void benchAsyncIngest() {
+        const std::size_t preload = 1000000;
+        const std::size_t producers = 4;
+        const std::size_t perProducer = 250000;
+        std::cout << "### asyncingest: " << producers << " producers x " << perProducer << " values into "
+                  << preload << " elements\n";
+
+        MagicalContainer container;
+        container.addElements(randomValues(preload, 0, 2147483647));
+        std::vector<std::vector<double>> latencies(producers);
+        double total = 0;
+        {
+            AsyncIngest ingest(container);
+            total = timeSeconds([&] {
+                std::vector<std::thread> threads;
+                for (std::size_t producer = 0; producer < producers; ++producer) {
+                    threads.emplace_back([&, producer] {
+                        std::vector<int> values = randomValues(perProducer, 0, 2147483647);
+                        latencies[producer].reserve(perProducer);
+                        for (int value: values) {
+                            auto start = std::chrono::steady_clock::now();
+                            ingest.add(value);
+                            latencies[producer].push_back(
+                                    std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+                        }
+                    });
+                }
+                for (std::thread &thread: threads) {
+                    thread.join();
+                }
+                ingest.flush();
+            });
+            std::cout << "merged in " << ingest.version() << " versions, " << total << " s until flushed\n";
+        }
+        std::vector<double> all;
+        for (const std::vector<double> &producer: latencies) {
+            all.insert(all.end(), producer.begin(), producer.end());
+        }
+        printLatencies("AsyncIngest::add", all);
+
+        std::vector<double> direct;
+        for (int value: randomValues(100, -2147483647, -1)) {
+            auto start = std::chrono::steady_clock::now();
+            container.addElement(value);
+            direct.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count());
+        }
+        printLatencies("MagicalContainer::addElement", direct);
+    }
+
+    void benchParallel() {
+        const std::size_t count = 10000000;
+        const unsigned hardware = std::max(1U, std::thread::hardware_concurrency());
+        std::cout << "### parallel: " << count << " elements, " << hardware << " hardware threads\n";
+        MagicalContainer container;
+        container.addElements(randomValues(count, 0, 2147483647));
+
+        // A per-element transform heavy enough for the traversal not to be purely memory bound.
+        auto transform = [](int element) {
+            auto value = static_cast<std::uint32_t>(element);
+            for (int round = 0; round < 8; ++round) {
+                value = value * 2654435761U + 0x9e3779b9U;
+                value ^= value >> 15U;
+            }
+            return static_cast<unsigned long long>(value);
+        };
+        const std::array<std::pair<MagicalContainer::View, const char *>, 3> views = {{
+                {MagicalContainer::View::Ascending, "Ascending"},
+                {MagicalContainer::View::SideCross, "SideCross"},
+                {MagicalContainer::View::Prime, "Prime"}}};
+
+        for (const auto &[view, name]: views) {
+            double single = 0;
+            for (unsigned threads = 1; threads <= std::max(hardware, 4U); threads *= 2) {
+                ThreadPool pool(threads - 1);
+                unsigned long long result = 0;
+                double seconds = timeSeconds([&] {
+                    result = container.parallelReduce(view, 0ULL, std::plus<>(), transform, DefaultParallelGrain, pool);
+                });
+                single = threads == 1 ? seconds : single;
+                std::cout << name << " parallelReduce, " << threads << " threads: " << seconds << " s, speedup "
+                          << single / seconds << "x (" << result << ")\n";
+            }
+        }
+    }
+
+    template<typename Range>
+    long long sumRange(Range &&range) {
+        long long sum = 0;
+        for (int element: range) {
+            sum += element;
+        }
+        return sum;
+    }
+
+    /// The container footprint as recorded by the stats build, or a note that it is not recorded.
+    std::string footprint(const MagicalContainer &container) {
+        if constexpr (ContainerStats::Enabled) {
+            return std::to_string(container.stats().footprintBytes / 1024) + " KiB";
+        }
+        return "n/a (build with STATS=1)";
+    }
+
+    void benchGenerators() {
+        const std::size_t count = 10000000;
+        const std::size_t partial = 1000;
+        std::cout << "### generators: " << count << " elements\n";
+        const std::vector<int> values = randomValues(count, 0, 2147483647);
+
+        MagicalContainer eager;
+        double eagerBuild = timeSeconds([&] {
+            eager.addElements(values);
+        });
+        MagicalContainer lazy;
+        lazy.setLazyViews(true);
+        double lazyBuild = timeSeconds([&] {
+            lazy.addElements(values);
+        });
+        std::cout << "build: eager " << eagerBuild << " s, footprint " << footprint(eager) << "; lazy " << lazyBuild
+                  << " s, footprint " << footprint(lazy) << '\n';
+
+        long long sum = 0;
+        double first = timeSeconds([&] {
+            Generator<int> generator = lazy.primes();
+            std::size_t taken = 0;
+            for (auto it = generator.begin(); it != generator.end() && taken < partial; ++it, ++taken) {
+                sum += *it;
+            }
+        });
+        std::cout << "lazy primes(), first " << partial << ": " << first * 1e6 << " us, footprint "
+                  << footprint(lazy) << '\n';
+
+        const auto elements = static_cast<std::size_t>(eager.size());
+        const auto primes = static_cast<std::size_t>(eager.primeCount());
+        // The first lazy prime pass classifies the blocks it reaches; the second one reads the memo.
+        const std::array<std::pair<const char *, std::function<long long()>>, 5> runs = {{
+                {"SideCrossIterator", [&] { return sumIterator(MagicalContainer::SideCrossIterator(eager)); }},
+                {"lazy sideCross()", [&] { return sumRange(lazy.sideCross()); }},
+                {"PrimeIterator", [&] { return sumIterator(MagicalContainer::PrimeIterator(eager)); }},
+                {"lazy primes(), cold", [&] { return sumRange(lazy.primes()); }},
+                {"lazy primes(), warm", [&] { return sumRange(lazy.primes()); }}}};
+        for (std::size_t run = 0; run < runs.size(); ++run) {
+            const std::size_t visited = run < 2 ? elements : primes;
+            double seconds = timeSeconds([&] {
+                sum += runs[run].second();
+            });
+            std::cout << runs[run].first << ": " << seconds / static_cast<double>(visited) * 1e9 << " ns per "
+                      << (run < 2 ? "element" : "prime") << '\n';
+            printCounters(runs[run].first, visited);
+        }
+        std::cout << "lazy footprint after a full prime pass: " << footprint(lazy) << " (checksum " << sum << ")\n";
+    }
+
+    void benchSetAlgebra() {
+        const std::size_t count = 5000000;
+        std::cout << "### setalgebra: " << count << " elements\n";
+        // randomValues() always uses the same seed, so the three inputs are cut from one longer sequence.
+        const std::vector<int> values = randomValues(2 * count + count / 1000, 0, 100000000);
+        const std::span<const int> all(values);
+        MagicalContainer left;
+        left.addElements(all.subspan(0, count));
+        MagicalContainer right;
+        right.addElements(all.subspan(count, count));
+        MagicalContainer small;
+        small.addElements(all.subspan(2 * count));
+
+        const std::array<std::pair<const char *, const MagicalContainer *>, 2> inputs = {{
+                {"balanced", &right}, {"skewed 1000:1", &small}}};
+        for (const auto &[shape, other]: inputs) {
+            std::size_t baseline = 0;
+            double copied = timeSeconds([&] {
+                const std::vector<int> a = left.getElements();
+                const std::vector<int> b = other->getElements();
+                std::vector<int> out;
+                std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+                MagicalContainer result;
+                result.setElements(out);
+                baseline = out.size();
+            });
+            std::size_t direct = 0;
+            double kernel = timeSeconds([&] {
+                direct = static_cast<std::size_t>(left.intersectWith(*other).size());
+            });
+            std::cout << shape << " intersection: getElements + std::set_intersection " << copied << " s, intersectWith "
+                      << kernel << " s (" << direct << '/' << baseline << " elements)\n";
+
+            double merged = timeSeconds([&] {
+                direct = static_cast<std::size_t>(left.unionWith(*other).size());
+            });
+            std::cout << shape << " union: unionWith " << merged << " s (" << direct << " elements)\n";
+        }
+    }
+
+    /// Times a hand-written filter loop over the sorted elements against building and traversing the
+    /// FilteredView of the same predicate with each strategy.
+    template<typename Predicate>
+    void benchFilter(const char *name, const MagicalContainer &container, const std::vector<int> &sorted) {
+        const Predicate predicate{};
+        long long expected = 0;
+        double loop = timeSeconds([&] {
+            for (int element: sorted) {
+                if (predicate(element)) {
+                    expected += element;
+                }
+            }
+        });
+        const double elements = static_cast<double>(sorted.size());
+        std::cout << name << ": hand-written loop " << loop / elements * 1e9 << " ns/elem\n";
+
+        auto run = [&]<FilterStrategy Strategy>(const char *label) {
+            long long sum = 0;
+            double build = 0;
+            double traverse = timeSeconds([&] {
+                auto start = std::chrono::steady_clock::now();
+                FilteredView<Predicate, Strategy> view(container);
+                build = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                for (int element: view) {
+                    sum += element;
+                }
+            }) - build;
+            std::cout << "  " << label << (Strategy == defaultStrategy<Predicate>() ? " (default)" : "")
+                      << ": build " << build / elements * 1e9 << " ns/elem, traverse " << traverse / elements * 1e9
+                      << " ns/elem" << (sum == expected ? "" : " MISMATCH") << '\n';
+        };
+        run.template operator()<FilterStrategy::Materialized>("materialized");
+        run.template operator()<FilterStrategy::Bitmap>("bitmap");
+        run.template operator()<FilterStrategy::Lazy>("lazy");
+    }
+
+    void benchFiltered() {
+        const std::size_t count = 10000000;
+        std::cout << "### filtered: " << count << " elements\n";
+        MagicalContainer container;
+        container.addElements(randomValues(count, 0, 2147483647));
+        const std::vector<int> sorted = container.getElements();
+        benchFilter<IsPrime>("IsPrime", container, sorted);
+        benchFilter<IsEven>("IsEven", container, sorted);
+        benchFilter<IsPerfectSquare>("IsPerfectSquare", container, sorted);
+        benchFilter<InRange<0, 536870911>>("InRange<0, 2^29 - 1>", container, sorted);
+    }
+
+
+    /// Sums every span a view hands out; the inner loop is a plain loop over contiguous ints.
+    long long sumChunks(const MagicalContainer &container, MagicalContainer::View view, std::size_t chunkSize) {
+        long long sum = 0;
+        container.forEachChunk(view, [&](std::span<const int> chunk) {
+            for (int element: chunk) {
+                sum += element;
+            }
+        }, chunkSize);
+        return sum;
+    }
+
+    void benchChunks() {
+        const std::size_t count = 10000000;
+        std::cout << "### chunks: " << count << " elements\n";
+        MagicalContainer container;
+        container.addElements(randomValues(count, 0, 2147483647));
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        bitmap.addElements(container.getElements());
+        const auto elements = static_cast<std::size_t>(container.size());
+        const auto primes = static_cast<std::size_t>(container.primeCount());
+        long long sum = 0;
+
+        auto report = [&](const char *label, double seconds, std::size_t visited) {
+            std::cout << label << ": " << seconds / static_cast<double>(visited) * 1e9 << " ns/elem\n";
+        };
+        report("AscendingIterator", timeSeconds([&] {
+            sum += sumIterator(MagicalContainer::AscendingIterator(container));
+        }), elements);
+        report("SideCrossIterator", timeSeconds([&] {
+            sum += sumIterator(MagicalContainer::SideCrossIterator(container));
+        }), elements);
+        report("PrimeIterator", timeSeconds([&] {
+            sum += sumIterator(MagicalContainer::PrimeIterator(container));
+        }), primes);
+        report("bitmap AscendingIterator", timeSeconds([&] {
+            sum += sumIterator(MagicalContainer::AscendingIterator(bitmap));
+        }), elements);
+        for (std::size_t chunkSize: {std::size_t{64}, DefaultChunkSize, std::size_t{16384}}) {
+            std::cout << "-- chunk size " << chunkSize << "\n";
+            report("ascending chunks", timeSeconds([&] {
+                sum += sumChunks(container, MagicalContainer::View::Ascending, chunkSize);
+            }), elements);
+            report("side-cross chunks", timeSeconds([&] {
+                sum += sumChunks(container, MagicalContainer::View::SideCross, chunkSize);
+            }), elements);
+            report("prime chunks", timeSeconds([&] {
+                sum += sumChunks(container, MagicalContainer::View::Prime, chunkSize);
+            }), primes);
+            report("bitmap ascending chunks", timeSeconds([&] {
+                sum += sumChunks(bitmap, MagicalContainer::View::Ascending, chunkSize);
+            }), elements);
+        }
+        std::cout << "(checksum " << sum << ")\n";
+    }
+
+
+    void benchSideCross() {
+        for (std::size_t count: {std::size_t{100000}, std::size_t{10000000}}) {
+            std::cout << "### sidecross: " << count << " elements\n";
+            MagicalContainer container;
+            container.addElements(randomValues(count, 0, 2147483647));
+            const std::vector<int> sorted = container.getElements();
+            const std::size_t elements = sorted.size();
+            std::vector<int> out(elements);
+            const int repeats = count < 1000000 ? 100 : 3;
+            long long sum = 0;
+
+            // Bytes read plus bytes written per pass, as for a copy.
+            auto report = [&](const char *label, double seconds) {
+                const double bytes = 2.0 * static_cast<double>(elements * sizeof(int)) * repeats;
+                std::cout << label << ": " << bytes / seconds / 1e9 << " GB/s, "
+                          << seconds / static_cast<double>(elements) / repeats * 1e9 << " ns/elem\n";
+                sum += out[elements / 2];
+            };
+            report("memcpy", timeSeconds([&] {
+                for (int r = 0; r < repeats; ++r) {
+                    std::memcpy(out.data(), sorted.data(), elements * sizeof(int));
+                }
+            }));
+            report("SideCrossIterator loop", timeSeconds([&] {
+                for (int r = 0; r < repeats; ++r) {
+                    MagicalContainer::SideCrossIterator cross(container);
+                    std::size_t i = 0;
+                    for (auto it = cross.begin(); it != cross.end(); ++it) {
+                        out[i++] = *it;
+                    }
+                }
+            }));
+            report("scalar index loop", timeSeconds([&] {
+                for (int r = 0; r < repeats; ++r) {
+                    for (std::size_t low = 0, high = elements - 1, i = 0; i < elements; ++low, --high) {
+                        out[i++] = sorted[low];
+                        if (i < elements) {
+                            out[i++] = sorted[high];
+                        }
+                    }
+                }
+            }));
+            report("materializeSideCross", timeSeconds([&] {
+                for (int r = 0; r < repeats; ++r) {
+                    container.materializeSideCross(out);
+                }
+            }));
+            std::cout << "(checksum " << sum << ")\n";
+        }
+    }
+
+
+    void benchAggregates() {
+        const std::size_t count = 10000000;
+        std::cout << "### aggregates: " << count << " elements\n";
+        MagicalContainer container;
+        container.addElements(randomValues(count, 0, 2147483647));
+        const std::vector<int> bounds = randomValues(2000, 0, 2147483647);
+        const std::size_t queries = bounds.size() / 2;
+        long long sum = 0;
+
+        auto run = [&](const char *label) {
+            double seconds = timeSeconds([&] {
+                for (std::size_t q = 0; q < queries; ++q) {
+                    const int low = std::min(bounds[2 * q], bounds[2 * q + 1]);
+                    const int high = std::max(bounds[2 * q], bounds[2 * q + 1]);
+                    sum += container.sum(low, high) + container.primeSum(low, high);
+                }
+            });
+            std::cout << label << ": " << seconds / static_cast<double>(queries) * 1e6 << " us/query\n";
+        };
+        run("linear scan");
+        container.setAggregateIndex(true);
+        double build = timeSeconds([&] {
+            sum += container.sum(0, 0);
+        });
+        std::cout << "index build: " << build * 1e3 << " ms\n";
+        run("prefix sums");
+        std::cout << "(checksum " << sum << ")\n";
+    }
+
+
+    void benchHistogram() {
+        const std::size_t count = 10000000;
+        std::cout << "### histogram: " << count << " elements\n";
+        const std::vector<int> values = randomValues(count, -2147483647, 2147483647);
+        MagicalContainer container;
+        container.addElements(values);
+        double q = 0;
+
+        double copied = timeSeconds([&] {
+            ValueHistogram histogram = ValueHistogram::log2();
+            for (int element: container.getElements()) {
+                histogram.add(element);
+            }
+            q += histogram.quantile(0.99);
+        });
+        std::cout << "getElements + rebuild per scrape: " << copied * 1e3 << " ms\n";
+        double attach = timeSeconds([&] {
+            container.setHistogram(ValueHistogram::log2());
+        });
+        std::cout << "setHistogram (one fill): " << attach * 1e3 << " ms\n";
+        double tracked = timeSeconds([&] {
+            for (int i = 0; i < 1000; ++i) {
+                q += container.histogram().quantile(0.99);
+            }
+        });
+        std::cout << "tracked histogram per scrape: " << tracked / 1000 * 1e9 << " ns\n";
+
+        std::vector<int> batch = randomValues(20000, 0, 1 << 20);
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+        for (bool withHistogram: {false, true}) {
+            MagicalContainer target(MagicalContainer::Storage::Bitmap);
+            if (withHistogram) {
+                target.setHistogram(ValueHistogram::log2());
+            }
+            double adds = timeSeconds([&] {
+                for (int element: batch) {
+                    target.addElement(element);
+                }
+                for (int element: batch) {
+                    target.removeElement(element);
+                }
+            });
+            std::cout << "bitmap addElement + removeElement" << (withHistogram ? " with histogram" : "") << ": "
+                      << adds / static_cast<double>(2 * batch.size()) * 1e9 << " ns/op\n";
+        }
+        std::cout << "(checksum " << q << ")\n";
+    }
+
+    void benchCopyOnWrite() {
+        const std::size_t count = 1000000;
+        std::cout << "### cow: " << count << " elements\n";
+        const std::vector<int> values = randomValues(count, 0, 1 << 26);
+        const int rounds = 1000;
+        for (auto storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap}) {
+            const char *name = storage == MagicalContainer::Storage::Vector ? "vector" : "bitmap";
+            MagicalContainer source(storage);
+            source.addElements(values);
+            std::size_t sizes = 0;
+            double copies = timeSeconds([&] {
+                for (int i = 0; i < rounds; ++i) {
+                    MagicalContainer snapshot = source;
+                    sizes += static_cast<std::size_t>(snapshot.size());
+                }
+            });
+            std::cout << name << " copy: " << copies / rounds * 1e9 << " ns\n";
+            double mutated = timeSeconds([&] {
+                for (int i = 0; i < rounds / 10; ++i) {
+                    MagicalContainer snapshot = source;
+                    snapshot.addElement(-1 - i);
+                    sizes += static_cast<std::size_t>(snapshot.size());
+                }
+            });
+            std::cout << name << " copy + first addElement: " << mutated / (rounds / 10) * 1e6 << " us\n";
+            double alone = timeSeconds([&] {
+                for (int i = 0; i < rounds / 10; ++i) {
+                    source.addElement(-1 - i);
+                }
+            });
+            std::cout << name << " addElement without a copy: " << alone / (rounds / 10) * 1e6 << " us\n";
+            std::cout << "(checksum " << sizes << ")\n";
+        }
+    }
+
+    void benchPersistent() {
+        const std::size_t count = 1000000;
+        const int versionCount = 10000;
+        std::cout << "### persistent: " << count << " elements, " << versionCount << " versions\n";
+        const std::vector<int> values = randomValues(count, 0, 1 << 28);
+        const std::vector<int> changes = randomValues(static_cast<std::size_t>(versionCount), 1 << 28, 1 << 29);
+        std::vector<PersistentContainer> versions;
+        versions.reserve(static_cast<std::size_t>(versionCount) + 1);
+        double built = timeSeconds([&] {
+            versions.emplace_back(values);
+        });
+        std::cout << "build: " << built * 1e3 << " ms\n";
+        double added = timeSeconds([&] {
+            for (int element: changes) {
+                versions.push_back(versions.back().addElement(element));
+            }
+        });
+        std::cout << "addElement per version: " << added / versionCount * 1e6 << " us\n";
+        const std::size_t base = versions.front().memoryBytes();
+        const std::size_t shared = PersistentContainer::memoryBytes(versions);
+        std::cout << "one version: " << base / 1e6 << " MB, all versions: " << shared / 1e6 << " MB ("
+                  << static_cast<double>(base) * (versionCount + 1) / 1e9 << " GB as full copies)\n";
+
+        long long sum = 0;
+        double walked = timeSeconds([&] {
+            for (int element: versions.back().ascending()) {
+                sum += element;
+            }
+        });
+        std::cout << "ascending generator: " << walked / static_cast<double>(count) * 1e9 << " ns/element\n";
+        double crossed = timeSeconds([&] {
+            for (int element: versions[versions.size() / 2].sideCross()) {
+                sum += element;
+            }
+        });
+        std::cout << "side-cross generator: " << crossed / static_cast<double>(count) * 1e9 << " ns/element\n";
+        std::cout << "(checksum " << sum << ")\n";
+    }
+
+    void benchMemory() {
+        const std::size_t count = 1000000;
+        const std::size_t batchSize = 10000;
+        std::cout << "### memory: " << count << " elements in batches of " << batchSize << "\n";
+        const std::vector<int> values = randomValues(count, 0, 1 << 30);
+
+        for (bool reserved: {false, true}) {
+            MagicalContainer container;
+            if (reserved) {
+                container.reserve(count);
+            }
+            // A change of a component's reserved bytes is one reallocation of it.
+            MemoryUsage last = container.memoryUsage();
+            std::size_t elementMoves = 0;
+            std::size_t viewMoves = 0;
+            double loaded = timeSeconds([&] {
+                for (std::size_t first = 0; first < count; first += batchSize) {
+                    container.addElements(std::span<const int>(values).subspan(first, batchSize));
+                    const MemoryUsage usage = container.memoryUsage();
+                    elementMoves += usage.elements.reserved != last.elements.reserved ? 1U : 0U;
+                    viewMoves += (usage.primeView.reserved != last.primeView.reserved ? 1U : 0U) +
+                                 (usage.ascendingView.reserved != last.ascendingView.reserved ? 1U : 0U) +
+                                 (usage.crossView.reserved != last.crossView.reserved ? 1U : 0U);
+                    last = usage;
+                }
+            });
+            const ComponentMemory total = container.memoryUsage().total();
+            std::cout << (reserved ? "reserve(n) first" : "no reserve") << ": " << loaded * 1e3 << " ms, "
+                      << elementMoves << " element and " << viewMoves << " view reallocations, "
+                      << total.used / 1e6 << " MB used of " << total.reserved / 1e6 << " MB reserved\n";
+            container.shrinkToFit();
+            const MemoryUsage shrunk = container.memoryUsage();
+            std::cout << "  after shrinkToFit: " << shrunk.total().reserved / 1e6 << " MB reserved (elements "
+                      << shrunk.elements.reserved / 1e6 << ", prime view " << shrunk.primeView.reserved / 1e6
+                      << ", ascending view " << shrunk.ascendingView.reserved / 1e6 << ", side-cross view "
+                      << shrunk.crossView.reserved / 1e6 << ")\n";
+        }
+    }
+
+    /// The anonymous memory of this process that is backed by transparent huge pages, in bytes.
+    std::size_t anonHugePageBytes() {
+        std::ifstream rollup("/proc/self/smaps_rollup");
+        std::string key;
+        std::size_t kilobytes = 0;
+        while (rollup >> key) {
+            if (key == "AnonHugePages:" && rollup >> kilobytes) {
+                return kilobytes * 1024;
+            }
+            rollup.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        }
+        return 0;
+    }
+
+    void benchPages() {
+        const std::size_t count = 16000000;
+        const std::size_t lookups = 4000000;
+        const PageSupport support = pageSupport();
+        std::cout << "### pages: " << count << " elements (transparent huge pages "
+                  << (support.transparent ? "on" : "off") << ", " << support.freeHugePages
+                  << " free hugetlb pages, " << std::popcount(support.onlineNodes) << " NUMA nodes)\n";
+        const std::vector<int> values = randomValues(count, 0, 2147483647);
+        std::vector<int> probes(lookups);
+        std::mt19937 gen(7);
+
+        const std::array<std::pair<const char *, PagePolicy>, 4> policies{{
+                {"4 KiB pages", PagePolicy()},
+                {"transparent huge pages", {HugePages::Transparent, NumaPlacement::Local, 0}},
+                {"explicit huge pages", {HugePages::Explicit, NumaPlacement::Local, 0}},
+                {"transparent + interleave", {HugePages::Transparent, NumaPlacement::Interleave, 0}},
+        }};
+        for (const auto &[name, policy]: policies) {
+            MagicalContainer container;
+            container.setPagePolicy(policy);
+            container.addElements(values);
+            const int size = container.size();
+            std::uniform_int_distribution<int> index(0, size - 1);
+            for (int &probe: probes) {
+                probe = index(gen);
+            }
+            long long sum = 0;
+            double ascending = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::AscendingIterator(container));
+            });
+            double cross = timeSeconds([&] {
+                sum += sumIterator(MagicalContainer::SideCrossIterator(container));
+            });
+            double random = timeSeconds([&] {
+                for (int probe: probes) {
+                    sum += container.kth(probe);
+                }
+            });
+            std::cout << name << ": ascending " << ascending / size * 1e9 << " ns/elem, side-cross "
+                      << cross / size * 1e9 << " ns/elem, random kth " << random / lookups * 1e9 << " ns, "
+                      << anonHugePageBytes() / 1e6 << " MB on huge pages (checksum " << sum << ")\n";
+        }
+    }
+
+}
+
+int main(int argc, char **argv) {
+    if (selected(argc, argv, "primes")) {
+        benchPrimes();
+    }
+    if (selected(argc, argv, "snapshot")) {
+        benchSnapshot();
+    }
+    if (selected(argc, argv, "ingest")) {
+        benchIngest();
+    }
+    if (selected(argc, argv, "export")) {
+        benchExport();
+    }
+    if (selected(argc, argv, "iterators")) {
+        benchIterators();
+    }
+    if (selected(argc, argv, "asyncingest")) {
+        benchAsyncIngest();
+    }
+    if (selected(argc, argv, "parallel")) {
+        benchParallel();
+    }
+    if (selected(argc, argv, "generators")) {
+        benchGenerators();
+    }
+    if (selected(argc, argv, "setalgebra")) {
+        benchSetAlgebra();
+    }
+    if (selected(argc, argv, "filtered")) {
+        benchFiltered();
+    }
+    if (selected(argc, argv, "chunks")) {
+        benchChunks();
+    }
+    if (selected(argc, argv, "sidecross")) {
+        benchSideCross();
+    }
+    if (selected(argc, argv, "aggregates")) {
+        benchAggregates();
+    }
+    if (selected(argc, argv, "histogram")) {
+        benchHistogram();
+    }
+    if (selected(argc, argv, "cow")) {
+        benchCopyOnWrite();
+    }
+    if (selected(argc, argv, "persistent")) {
+        benchPersistent();
+    }
+    if (selected(argc, argv, "memory")) {
+        benchMemory();
+    }
+    if (selected(argc, argv, "pages")) {
+        benchPages();
+    }
+    return 0;
+}
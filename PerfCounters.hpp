@@ -0,0 +1,168 @@
+/**
+ * @file PerfCounters.hpp
+ * @class PerfCounters
+ * @brief Hardware performance counters for the benchmark suite, read through Linux perf_event_open.
+ * Cycles, instructions, L1 data cache misses, last-level cache misses and branch misses are each opened as
+ * their own user-space-only counter, so a machine or container that lacks one event (or a virtual machine
+ * without a PMU) still reports the others. When no counter can be opened, available() is `false`,
+ * measurements return invalid readings and the benchmarks fall back to wall-clock time only. Counts are
+ * scaled by time enabled / time running in case the kernel multiplexed them.
+ */
+
+#ifndef MAGICAL_ITERATORS_PERFCOUNTERS_HPP
+#define MAGICAL_ITERATORS_PERFCOUNTERS_HPP
+
+#include <array>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace ariel {
+
+    class PerfCounters {
+    public:
+
+        enum Event {
+            Cycles, Instructions, L1DataMisses, LastLevelMisses, BranchMisses, EventCount
+        };
+
+        struct Reading {
+            std::array<double, EventCount> values{};
+            std::array<bool, EventCount> valid{};
+
+            bool has(Event event) const {
+                return valid[event];
+            }
+
+            double operator[](Event event) const {
+                return values[event];
+            }
+
+            /// Cycles per instruction, or 0 when either counter is missing.
+            double cpi() const {
+                return has(Cycles) && has(Instructions) && values[Instructions] > 0
+                       ? values[Cycles] / values[Instructions] : 0;
+            }
+        };
+
+    private:
+
+        std::array<int, EventCount> fds{};
+        std::string failure;
+
+#if defined(__linux__)
+        static int open(std::uint32_t type, std::uint64_t config) {
+            perf_event_attr attr{};
+            attr.size = sizeof(attr);
+            attr.type = type;
+            attr.config = config;
+            attr.disabled = 1;
+            attr.exclude_kernel = 1;
+            attr.exclude_hv = 1;
+            attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            return static_cast<int>(::syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+        }
+
+        static constexpr std::uint64_t cacheMisses(std::uint64_t cache) {
+            return cache | (PERF_COUNT_HW_CACHE_OP_READ << 8U) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16U);
+        }
+#endif
+
+    public:
+
+        PerfCounters() {
+            fds.fill(-1);
+#if defined(__linux__)
+            fds[Cycles] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+            if (fds[Cycles] < 0) {
+                failure = std::strerror(errno);
+            }
+            fds[Instructions] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+            fds[L1DataMisses] = open(PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_L1D));
+            fds[LastLevelMisses] = open(PERF_TYPE_HW_CACHE, cacheMisses(PERF_COUNT_HW_CACHE_LL));
+            fds[BranchMisses] = open(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#else
+            failure = "perf_event_open is only available on Linux";
+#endif
+        }
+
+        PerfCounters(const PerfCounters &) = delete;
+
+        PerfCounters &operator=(const PerfCounters &) = delete;
+
+        ~PerfCounters() {
+#if defined(__linux__)
+            for (int fd: fds) {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+#endif
+        }
+
+        /// Whether at least one counter could be opened.
+        bool available() const {
+            for (int fd: fds) {
+                if (fd >= 0) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Why the cycle counter could not be opened, or an empty string.
+        const std::string &unavailableReason() const {
+            return failure;
+        }
+
+        void start() {
+#if defined(__linux__)
+            for (int fd: fds) {
+                if (fd >= 0) {
+                    ::ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+                    ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+                }
+            }
+#endif
+        }
+
+        Reading stop() {
+            Reading reading;
+#if defined(__linux__)
+            for (int fd: fds) {
+                if (fd >= 0) {
+                    ::ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+                }
+            }
+            for (std::size_t event = 0; event < EventCount; ++event) {
+                std::array<std::uint64_t, 3> data{}; // value, time enabled, time running
+                if (fds[event] < 0 || ::read(fds[event], data.data(), sizeof(data)) != sizeof(data) || data[2] == 0) {
+                    continue;
+                }
+                reading.values[event] = static_cast<double>(data[0]) * static_cast<double>(data[1]) /
+                                        static_cast<double>(data[2]);
+                reading.valid[event] = true;
+            }
+#endif
+            return reading;
+        }
+
+        template<typename Function>
+        Reading measure(Function &&fn) {
+            start();
+            fn();
+            return stop();
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_PERFCOUNTERS_HPP
@@ -1,9 +1,54 @@
 #include "doctest.h"
+#include "sources/AsyncIngest.hpp"
+#include "sources/FilteredView.hpp"
 #include "sources/MagicalContainer.hpp"
+#include "sources/PageAllocator.hpp"
+#include "sources/PersistentContainer.hpp"
+#include "sources/PrimeKernel.hpp"
+#include "sources/PrimeTable.hpp"
+#include "sources/Snapshot.hpp"
+#include <array>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <stdexcept>
+#include <thread>
+#include <numeric>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace ariel;
 using namespace std;
+
+namespace {
+
+    // Collects the values a generator yields.
+    std::vector<int> collect(Generator<int> generator) {
+        std::vector<int> values;
+        for (int value: generator) {
+            values.push_back(value);
+        }
+        return values;
+    }
+
+    // Collects the elements from begin() to end() of an iterator or a view.
+    template<typename Range>
+    std::vector<int> collect(const Range &range) {
+        return std::vector<int>(range.begin(), range.end());
+    }
+
+    std::vector<int> ascendingOf(MagicalContainer &container) {
+        return collect(MagicalContainer::AscendingIterator(container));
+    }
+
+    std::vector<int> primesOf(const MagicalContainer &container) {
+        return collect(MagicalContainer::PrimeIterator(container));
+    }
+
+}
+
 // Test case for adding elements to the MagicalContainer
 TEST_CASE("Adding elements to MagicalContainer") {
     MagicalContainer container;
@@ -597,3 +642,1771 @@ TEST_CASE("operator= throws when iterators are pointing at different containers"
 }
 
 
+
+TEST_CASE("Search index lookups") {
+    MagicalContainer container;
+    for (int i = 0; i < 100; ++i) {
+        container.addElement(i * 3);
+    }
+
+    SUBCASE("Binary search without the index") {
+        CHECK_FALSE(container.hasSearchIndex());
+        CHECK(container.contains(42));
+        CHECK_FALSE(container.contains(43));
+        CHECK(container.lowerBound(43) == 15);
+        CHECK(container.lowerBound(-5) == 0);
+        CHECK(container.lowerBound(1000) == container.size());
+    }
+
+    SUBCASE("Eytzinger index agrees with the sorted storage") {
+        container.setSearchIndex(true);
+        for (int value = -2; value <= 300; ++value) {
+            int expected = (value <= 0) ? 0 : (value + 2) / 3;
+            CHECK(container.lowerBound(value) == std::min(expected, container.size()));
+            CHECK(container.contains(value) == (value >= 0 && value < 300 && value % 3 == 0));
+        }
+    }
+
+    SUBCASE("Index follows addElement and removeElement") {
+        container.setSearchIndex(true);
+        CHECK_FALSE(container.contains(43));
+        container.addElement(43);
+        CHECK(container.contains(43));
+        container.removeElement(42);
+        CHECK_FALSE(container.contains(42));
+        CHECK(container.lowerBound(42) == 14);
+    }
+}
+
+TEST_CASE("Views follow removeElement") {
+    MagicalContainer container;
+    container.addElement(2);
+    container.addElement(3);
+    container.addElement(4);
+    container.removeElement(3);
+
+    MagicalContainer::PrimeIterator it(container);
+    CHECK(*it == 2);
+    ++it;
+    CHECK(it == it.end());
+}
+
+TEST_CASE("Batch prime classification") {
+    SUBCASE("Bitmap matches trial division") {
+        std::vector<int> values;
+        for (int i = -10; i < 5000; ++i) {
+            values.push_back(i);
+        }
+        values.push_back(2147483647);
+        values.push_back(2147483646);
+        values.push_back(1000000007);
+        values.push_back(999999999);
+        values.push_back(65537 * 7);
+
+        std::vector<std::uint64_t> bitmap = classifyPrimes(values);
+        CHECK(bitmap.size() == primeBitmapWords(values.size()));
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            bool expected = values[i] >= 2;
+            for (long long d = 2; expected && d * d <= values[i]; ++d) {
+                expected = (values[i] % d != 0);
+            }
+            bool actual = ((bitmap[i / 64] >> (i % 64)) & 1U) != 0;
+            CHECK(actual == expected);
+        }
+    }
+
+    SUBCASE("Bulk load builds the prime view") {
+        MagicalContainer container;
+        container.addElement(7);
+        std::vector<int> batch = {10, 3, 7, 2, 9, 3, 11};
+        container.addElements(batch);
+        CHECK(container.size() == 6);
+
+        MagicalContainer::PrimeIterator it(container);
+        CHECK(*it == 2);
+        ++it;
+        CHECK(*it == 3);
+        ++it;
+        CHECK(*it == 7);
+        ++it;
+        CHECK(*it == 11);
+        ++it;
+        CHECK(it == it.end());
+    }
+
+    SUBCASE("Single inserts and removals move the flags of the other elements") {
+        std::vector<int> values;
+        for (int i = 0; i < 200; ++i) {
+            values.push_back(i * 3 + 1);
+        }
+        for (std::size_t index: {std::size_t{0}, std::size_t{63}, std::size_t{64}, std::size_t{127}, std::size_t{199}}) {
+            std::vector<std::uint64_t> bitmap = classifyPrimes(values);
+            std::vector<int> inserted = values;
+            inserted.insert(inserted.begin() + static_cast<std::ptrdiff_t>(index), 5);
+            insertPrimeFlag(bitmap, values.size(), index, true);
+            CHECK(bitmap == classifyPrimes(inserted));
+            erasePrimeFlag(bitmap, inserted.size(), index);
+            CHECK(bitmap == classifyPrimes(values));
+        }
+        std::vector<std::uint64_t> bitmap = classifyPrimes(values);
+        insertPrimeFlag(bitmap, values.size(), values.size(), true);
+        values.push_back(601);
+        CHECK(bitmap == classifyPrimes(values));
+
+        MagicalContainer container;
+        container.setElements(values);
+        for (int element: {0, 2, 96, 98, 599, 1000003}) {
+            container.addElement(element);
+            values.insert(std::lower_bound(values.begin(), values.end(), element), element);
+        }
+        for (int element: {1, 97, 601, 1000003}) {
+            container.removeElement(element);
+            values.erase(std::lower_bound(values.begin(), values.end(), element));
+        }
+        std::vector<int> expected;
+        std::copy_if(values.begin(), values.end(), std::back_inserter(expected), isPrimeValue);
+        CHECK(primesOf(container) == expected);
+    }
+}
+
+TEST_CASE("Compile-time prime table") {
+    constexpr std::array<int, 6> literal = {1, 2, 4, 5, 14, 65537};
+    constexpr int literalPrimes = static_cast<int>(std::count_if(literal.begin(), literal.end(), isPrimeConstexpr));
+    static_assert(literalPrimes == 3);
+    static_assert(isSmallPrime(65521) && !isSmallPrime(65533));
+
+    int tablePrimes = 0;
+    for (std::uint32_t value = 0; value < SmallPrimeLimit; ++value) {
+        if (isSmallPrime(value)) {
+            ++tablePrimes;
+        }
+        if (value < 2000 || value % 97 == 0) {
+            CHECK(isSmallPrime(value) == isPrimeMillerRabin(value));
+        }
+    }
+    CHECK(tablePrimes == 6542);
+    CHECK(literalPrimes == 3);
+}
+
+TEST_CASE("Roaring bitmap containers") {
+    RoaringBitmap bitmap;
+    for (int value = 0; value < 10000; ++value) {
+        CHECK(bitmap.add(value));
+    }
+    CHECK_FALSE(bitmap.add(5));
+    CHECK(bitmap.add(-3));
+    CHECK(bitmap.add(1 << 20));
+    CHECK(bitmap.cardinality() == 10002);
+    CHECK(bitmap.countChunks(RoaringBitmap::ChunkKind::Bitmap) == 1);
+    CHECK(bitmap.countChunks(RoaringBitmap::ChunkKind::Array) == 2);
+
+    SUBCASE("Rank and select follow signed order") {
+        CHECK(bitmap.select(0) == -3);
+        CHECK(bitmap.select(1) == 0);
+        CHECK(bitmap.select(5001) == 5000);
+        CHECK(bitmap.select(10001) == (1 << 20));
+        CHECK(bitmap.rank(-3) == 0);
+        CHECK(bitmap.rank(0) == 1);
+        CHECK(bitmap.rank(20000) == 10001);
+        CHECK_THROWS_AS(bitmap.select(10002), std::out_of_range);
+    }
+
+    SUBCASE("Select answers ranks in any order and across bitmaps") {
+        RoaringBitmap primes = bitmap.primes();
+        std::vector<int> ascendingPrimes;
+        for (int value = 0; value < 10000; ++value) {
+            if (isPrimeValue(value)) {
+                ascendingPrimes.push_back(value);
+            }
+        }
+        REQUIRE(primes.cardinality() == ascendingPrimes.size());
+        std::size_t low = 0;
+        std::size_t high = bitmap.cardinality() - 1;
+        while (low < high) {
+            CHECK(bitmap.select(low) == (low == 0 ? -3 : static_cast<int>(low) - 1));
+            std::size_t prime = low % ascendingPrimes.size();
+            CHECK(primes.select(ascendingPrimes.size() - 1 - prime) == ascendingPrimes[ascendingPrimes.size() - 1 - prime]);
+            CHECK(bitmap.select(high) == (high == 10001 ? (1 << 20) : static_cast<int>(high) - 1));
+            CHECK(primes.select(prime) == ascendingPrimes[prime]);
+            ++low;
+            --high;
+        }
+        CHECK(bitmap.remove(5000));
+        CHECK(bitmap.select(5001) == 5001);
+        CHECK(bitmap.select(4999) == 4998);
+    }
+
+    SUBCASE("Dense ranges compress to runs and expand on mutation") {
+        std::size_t before = bitmap.memoryBytes();
+        bitmap.runOptimize();
+        CHECK(bitmap.countChunks(RoaringBitmap::ChunkKind::Run) >= 1);
+        CHECK(bitmap.memoryBytes() < before);
+        CHECK(bitmap.contains(9999));
+        CHECK_FALSE(bitmap.contains(10000));
+        CHECK(bitmap.remove(4000));
+        CHECK_FALSE(bitmap.contains(4000));
+        CHECK(bitmap.select(4000) == 3999);
+        CHECK(bitmap.select(4001) == 4001);
+    }
+
+    SUBCASE("Removing below the array limit converts back to an array") {
+        for (int value = 4096; value < 10000; ++value) {
+            CHECK(bitmap.remove(value));
+        }
+        CHECK(bitmap.countChunks(RoaringBitmap::ChunkKind::Bitmap) == 0);
+        CHECK(bitmap.cardinality() == 4098);
+        CHECK(bitmap.primes().cardinality() == 564);
+    }
+}
+
+TEST_CASE("Bitmap storage backend") {
+    MagicalContainer container(MagicalContainer::Storage::Bitmap);
+    CHECK(container.getStorage() == MagicalContainer::Storage::Bitmap);
+    container.addElement(1);
+    container.addElement(2);
+    container.addElement(4);
+    container.addElement(5);
+    container.addElement(14);
+
+    SUBCASE("Iterators run on rank/select") {
+        CHECK(ascendingOf(container) == std::vector<int>{1, 2, 4, 5, 14});
+        CHECK(collect(MagicalContainer::SideCrossIterator(container)) == std::vector<int>{1, 14, 2, 5, 4});
+        CHECK(primesOf(container) == std::vector<int>{2, 5});
+    }
+
+    SUBCASE("Prime view follows mutations") {
+        CHECK(container.primeCount() == 2);
+        container.addElement(7);
+        container.removeElement(2);
+        CHECK(container.primeCount() == 2);
+        MagicalContainer::PrimeIterator prime(container);
+        CHECK(*prime == 5);
+        CHECK_THROWS_AS(container.removeElement(2), std::runtime_error);
+    }
+
+    SUBCASE("Converting between backends keeps the elements") {
+        container.setStorage(MagicalContainer::Storage::Vector);
+        CHECK(container.getElements() == std::vector<int>{1, 2, 4, 5, 14});
+        CHECK(container.primeCount() == 2);
+        container.setStorage(MagicalContainer::Storage::Bitmap);
+        CHECK(container.contains(14));
+        CHECK(container.lowerBound(6) == 4);
+        CHECK(container.getElement(2) == 4);
+    }
+}
+
+TEST_CASE("Frozen block-compressed storage") {
+    std::vector<int> values = {-2147483647 - 1, -1000000, -7, 0, 2147483647};
+    for (int i = 1; i < 1000; ++i) {
+        values.push_back(i * i);
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+
+    SUBCASE("Random access and search match the sorted input") {
+        FrozenStorage frozen = FrozenStorage::compress(values);
+        CHECK(frozen.size() == values.size());
+        CHECK(frozen.blockCount() == (values.size() + FrozenStorage::BlockSize - 1) / FrozenStorage::BlockSize);
+        CHECK(frozen.toVector() == values);
+        for (std::size_t i = 0; i < values.size(); i += 7) {
+            CHECK(frozen.at(i) == values[i]);
+            CHECK(frozen.lowerBound(values[i]) == i);
+            CHECK(frozen.contains(values[i]));
+        }
+        CHECK(frozen.lowerBound(5) == 6);
+        CHECK_FALSE(frozen.contains(5));
+        CHECK_THROWS_AS(frozen.at(values.size()), std::out_of_range);
+    }
+
+    SUBCASE("Dense values compress well") {
+        std::vector<int> dense(100000);
+        for (std::size_t i = 0; i < dense.size(); ++i) {
+            dense[i] = static_cast<int>(i * 3);
+        }
+        FrozenStorage frozen = FrozenStorage::compress(dense);
+        CHECK(frozen.memoryBytes() * 8 < dense.size() * sizeof(int));
+        CHECK(frozen.at(54321) == 54321 * 3);
+    }
+
+    SUBCASE("Frozen containers keep iterating and reject mutations") {
+        MagicalContainer container;
+        container.setElements({1, 2, 4, 5, 14});
+        container.freeze();
+        CHECK(container.isFrozen());
+        CHECK(container.size() == 5);
+
+        CHECK(collect(MagicalContainer::SideCrossIterator(container)) == std::vector<int>{1, 14, 2, 5, 4});
+
+        MagicalContainer::PrimeIterator prime(container);
+        CHECK(*prime == 2);
+        ++prime;
+        CHECK(*prime == 5);
+        ++prime;
+        CHECK(prime == prime.end());
+
+        CHECK_THROWS_AS(container.addElement(3), std::runtime_error);
+        CHECK_THROWS_AS(container.removeElement(2), std::runtime_error);
+        container.setStorage(MagicalContainer::Storage::Vector);
+        container.addElement(3);
+        CHECK(container.primeCount() == 3);
+    }
+}
+
+TEST_CASE("Binary snapshots with mapped loading") {
+    const std::string path = (std::filesystem::temp_directory_path() / "magical_container_test.snapshot").string();
+    MagicalContainer container;
+    container.setElements({1, 2, 4, 5, 14, -3, 65537});
+    container.save(path);
+
+    SUBCASE("A mapped container serves all three views") {
+        MagicalContainer mapped = MagicalContainer::mapFromFile(path, true);
+        CHECK(mapped.getStorage() == MagicalContainer::Storage::Mapped);
+        CHECK(mapped.getElements() == container.getElements());
+        CHECK(mapped.primeCount() == 3);
+        CHECK(mapped.contains(65537));
+        CHECK(mapped.lowerBound(3) == 3);
+
+        MagicalContainer::SideCrossIterator cross(mapped);
+        CHECK(*cross == -3);
+        ++cross;
+        CHECK(*cross == 65537);
+
+        MagicalContainer::PrimeIterator prime(mapped);
+        CHECK(*prime == 2);
+        ++prime;
+        CHECK(*prime == 5);
+        ++prime;
+        CHECK(*prime == 65537);
+
+        CHECK_THROWS_AS(mapped.addElement(3), std::runtime_error);
+        CHECK_THROWS_AS(container.setStorage(MagicalContainer::Storage::Mapped), std::runtime_error);
+        mapped.setStorage(MagicalContainer::Storage::Vector);
+        mapped.addElement(3);
+        CHECK(mapped.primeCount() == 4);
+    }
+
+    SUBCASE("Snapshots of other backends round-trip") {
+        container.setStorage(MagicalContainer::Storage::Bitmap);
+        container.save(path);
+        MagicalContainer mapped = MagicalContainer::mapFromFile(path);
+        CHECK(mapped.getElements() == container.getElements());
+        CHECK(mapped.primeCount() == container.primeCount());
+    }
+
+    SUBCASE("Corrupted snapshots are rejected") {
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(64);
+            file.put('\x7f');
+        }
+        CHECK_NOTHROW(MagicalContainer::mapFromFile(path, false));
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, true), std::runtime_error);
+        {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(0);
+            file.put('X');
+        }
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, false), std::runtime_error);
+    }
+
+    SUBCASE("Out-of-range headers and prime positions are rejected without verification") {
+        auto patch = [&path](std::streamoff offset, std::uint64_t value) {
+            std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+            file.seekp(offset);
+            file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+        };
+        patch(16, 16);
+        patch(32, ~std::uint64_t{63});
+        patch(40, 0);
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, false), std::runtime_error);
+
+        container.save(path);
+        patch(128, ~std::uint64_t{0});
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, false), std::runtime_error);
+    }
+
+    SUBCASE("Verification rejects elements out of order even with a matching checksum") {
+        const std::vector<int> unsorted{1, 5, 4, 14};
+        MappedSnapshot::write(path, unsorted, std::vector<std::uint32_t>{1});
+        CHECK_NOTHROW(MappedSnapshot::open(path, false));
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, true), std::runtime_error);
+
+        const std::vector<int> repeated{1, 5, 5, 14};
+        MappedSnapshot::write(path, repeated, std::vector<std::uint32_t>{1, 2});
+        CHECK_THROWS_AS(MagicalContainer::mapFromFile(path, true), std::runtime_error);
+    }
+
+    SUBCASE("A mapped container can save over its own file") {
+        MagicalContainer mapped = MagicalContainer::mapFromFile(path);
+        CHECK_NOTHROW(mapped.save(path));
+        CHECK(mapped.getElements() == container.getElements());
+        CHECK(MagicalContainer::mapFromFile(path, true).getElements() == container.getElements());
+        CHECK_FALSE(std::filesystem::exists(path + ".tmp"));
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Streaming integer ingest") {
+    const std::string path = (std::filesystem::temp_directory_path() / "magical_container_test.ingest").string();
+
+    SUBCASE("Tokens split across chunks are carried over") {
+        IntegerStreamParser parser;
+        std::vector<int> values;
+        parser.feed("12,-3", values);
+        parser.feed("4\n\n 7", values);
+        parser.feed("", values);
+        parser.feed("8\t-2147483648", values);
+        parser.finish(values);
+        CHECK(values == std::vector<int>{12, -34, 78, -2147483648});
+    }
+
+    SUBCASE("A file is merged in batches") {
+        {
+            std::ofstream file(path);
+            file << "5\n3, 2\r\n-7\t11\n3\n2147483647\n 100";
+        }
+        MagicalContainer container;
+        container.addElement(4);
+        IngestStats stats = container.ingestFile(path, 3);
+        CHECK(stats.values == 8);
+        CHECK(stats.batches == 2);
+        CHECK(stats.bytes == std::filesystem::file_size(path));
+        CHECK(container.getElements() == std::vector<int>{-7, 2, 3, 4, 5, 11, 100, 2147483647});
+        CHECK(container.primeCount() == 5);
+    }
+
+    SUBCASE("Invalid input is rejected") {
+        {
+            std::ofstream file(path);
+            file << "1\n2x\n3\n";
+        }
+        MagicalContainer container;
+        CHECK_THROWS_AS(container.ingestFile(path), std::runtime_error);
+        {
+            std::ofstream file(path);
+            file << "2147483648\n";
+        }
+        CHECK_THROWS_AS(container.ingestFile(path), std::runtime_error);
+        container.freeze();
+        CHECK_THROWS_AS(container.ingestFile(path), std::runtime_error);
+        CHECK_THROWS_AS(MagicalContainer().ingestFile(path + ".missing"), std::runtime_error);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Bulk output with to_chars") {
+    const std::string path = (std::filesystem::temp_directory_path() / "magical_container_test.out").string();
+    auto readBack = [&path] {
+        std::ifstream file(path);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+    MagicalContainer container;
+    container.setElements({17, 2, 25, 9, 3, -2147483648, 2147483647});
+
+    for (auto storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap,
+                        MagicalContainer::Storage::Frozen}) {
+        CAPTURE(static_cast<int>(storage));
+        MagicalContainer copy = container;
+        copy.setStorage(storage);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        REQUIRE(fd >= 0);
+        {
+            std::array<char, 16> buffer{};
+            IntegerWriter writer(fd, buffer);
+            CHECK(copy.writeAscending(writer) == 7);
+            CHECK(copy.writeSideCross(writer) == 7);
+            IntegerWriter lines(fd, 64, '\n');
+            CHECK(copy.writePrimes(lines) == 4);
+        }
+        ::close(fd);
+        CHECK(readBack() == "-2147483648 2 3 9 17 25 2147483647 "
+                            "-2147483648 2147483647 2 25 3 17 9 "
+                            "2\n3\n17\n2147483647\n");
+    }
+
+    std::array<char, 8> tiny{};
+    CHECK_THROWS_AS(IntegerWriter(1, tiny), std::runtime_error);
+    IntegerWriter closed(-1, 64);
+    closed.write(1);
+    CHECK(closed.bytesWritten() == 2);
+    CHECK_THROWS_AS(closed.flush(), std::runtime_error);
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Instrumentation counters and latency histograms") {
+    LatencyHistogram histogram;
+    for (std::uint64_t nanoseconds: {0U, 1U, 3U, 100U, 100U, 100U, 5000U}) {
+        histogram.record(nanoseconds);
+    }
+    CHECK(histogram.count() == 7);
+    CHECK(histogram.bucket(0) == 1);
+    CHECK(histogram.bucket(1) == 1);
+    CHECK(histogram.bucket(2) == 1);
+    CHECK(histogram.bucket(7) == 3);
+    CHECK(histogram.quantileNanoseconds(0.5) == 127);
+    CHECK(histogram.quantileNanoseconds(1.0) == 8191);
+    CHECK(histogram.meanNanoseconds() == doctest::Approx(5304.0 / 7));
+
+    MagicalContainer container;
+    container.addElement(4);
+    container.addElement(3);
+    container.addElements(std::vector<int>{5, 6, 7});
+    container.removeElement(4);
+    MagicalContainer::AscendingIterator ascending(container);
+    MagicalContainer::PrimeIterator prime(container);
+    ContainerStats stats = container.stats();
+    CHECK(stats.dump().find("iterator constructions") != std::string::npos);
+
+    if constexpr (ContainerStats::Enabled) {
+        CHECK(stats.addElementCalls == 2);
+        CHECK(stats.removeElementCalls == 1);
+        CHECK(stats.viewRebuilds == 4);
+        // Single inserts classify only their element and removals classify nothing.
+        CHECK(stats.primalityTests == 1 + 1 + 3 + 0);
+        CHECK(stats.iteratorConstructions == 2);
+        CHECK(stats.bytesAllocated >= 5 * sizeof(int));
+        CHECK(stats.latencyOf(StatsOperation::AddElement).count() == 2);
+        CHECK(stats.latencyOf(StatsOperation::RebuildViews).count() == 4);
+        container.resetStats();
+        CHECK(container.stats().viewRebuilds == 0);
+    } else {
+        CHECK(stats.addElementCalls == 0);
+        CHECK(stats.latencyOf(StatsOperation::AddElement).count() == 0);
+    }
+}
+
+TEST_CASE("Async ingest queue") {
+    SUBCASE("The ring reports full and empty") {
+        MpscRing<int> ring(3);
+        CHECK(ring.capacity() == 4);
+        int value = 0;
+        CHECK_FALSE(ring.tryPop(value));
+        for (int i = 0; i < 4; ++i) {
+            CHECK(ring.tryPush(i) == static_cast<std::size_t>(i));
+        }
+        CHECK(ring.tryPush(4) == SIZE_MAX);
+        CHECK(ring.tryPop(value));
+        CHECK(value == 0);
+        CHECK(ring.tryPush(4) == 4);
+        for (int expected = 1; expected <= 4; ++expected) {
+            CHECK(ring.tryPop(value));
+            CHECK(value == expected);
+        }
+        CHECK_FALSE(ring.tryPop(value));
+    }
+
+    SUBCASE("Producers are merged in batches") {
+        MagicalContainer container;
+        container.addElement(-1);
+        AsyncIngest ingest(container, 64, 100);
+        std::vector<std::thread> producers;
+        for (int producer = 0; producer < 4; ++producer) {
+            producers.emplace_back([&ingest, producer] {
+                for (int i = 0; i < 5000; ++i) {
+                    ingest.add(i * 4 + producer);
+                }
+            });
+        }
+        std::atomic<bool> shrank{false};
+        std::thread reader([&] {
+            int seen = 0;
+            while (seen < 20001) {
+                const int size = ingest.read([](const MagicalContainer &c) {
+                    return c.contains(-1) ? c.size() : 0;
+                });
+                shrank = shrank || size < seen;
+                seen = size;
+                std::this_thread::yield();
+            }
+        });
+        for (std::thread &producer: producers) {
+            producer.join();
+        }
+        ingest.flush();
+        reader.join();
+        CHECK_FALSE(shrank);
+        CHECK(ingest.read([](const MagicalContainer &c) { return c.size(); }) == 20001);
+        CHECK(ingest.version() >= 200);
+
+        std::future<std::uint64_t> durable = ingest.addAsync(-7);
+        const std::uint64_t visibleAt = durable.get();
+        CHECK(visibleAt <= ingest.version());
+        CHECK(ingest.read([](const MagicalContainer &c) { return c.contains(-7); }));
+    }
+
+    SUBCASE("Destruction merges what is still queued") {
+        MagicalContainer container;
+        {
+            AsyncIngest ingest(container);
+            for (int i = 0; i < 1000; ++i) {
+                ingest.add(i);
+            }
+        }
+        CHECK(container.size() == 1000);
+        CHECK(container.primeCount() == 168);
+    }
+
+    SUBCASE("Readers keep the version they started on while batches merge") {
+        MagicalContainer container;
+        container.setElements({2, 3, 4});
+        AsyncIngest ingest(container, 16, 4);
+        ingest.read([&](const MagicalContainer &version) {
+            for (int i = 10; i < 20; ++i) {
+                ingest.add(i);
+            }
+            ingest.flush();
+            CHECK(version.size() == 3);
+            CHECK(version.primeCount() == 2);
+        });
+        CHECK(ingest.read([](const MagicalContainer &c) { return c.size(); }) == 13);
+        CHECK(container.size() == 3);
+    }
+
+    SUBCASE("Merge errors reach flush and futures") {
+        MagicalContainer container;
+        container.freeze();
+        AsyncIngest ingest(container);
+        std::future<std::uint64_t> result = ingest.addAsync(1);
+        CHECK_THROWS_AS(result.get(), std::runtime_error);
+        CHECK_THROWS_AS(ingest.flush(), std::runtime_error);
+    }
+}
+
+TEST_CASE("Work-stealing parallel traversal") {
+    using View = MagicalContainer::View;
+    MagicalContainer container;
+    std::vector<int> values;
+    for (int i = -500; i < 5000; i += 3) {
+        values.push_back(i);
+    }
+    container.addElements(values);
+    ThreadPool pool(3);
+
+    auto sequential = [&container](View view) {
+        std::vector<int> order;
+        if (view == View::Ascending) {
+            MagicalContainer::AscendingIterator it(container);
+            for (auto i = it.begin(); i != it.end(); ++i) {
+                order.push_back(*i);
+            }
+        } else if (view == View::SideCross) {
+            MagicalContainer::SideCrossIterator it(container);
+            for (auto i = it.begin(); i != it.end(); ++i) {
+                order.push_back(*i);
+            }
+        } else {
+            MagicalContainer::PrimeIterator it(container);
+            for (auto i = it.begin(); i != it.end(); ++i) {
+                order.push_back(*i);
+            }
+        }
+        return order;
+    };
+    auto concatenate = [](std::vector<int> left, std::vector<int> right) {
+        left.insert(left.end(), right.begin(), right.end());
+        return left;
+    };
+    auto single = [](int element) {
+        return std::vector<int>{element};
+    };
+
+    for (auto storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap,
+                        MagicalContainer::Storage::Frozen}) {
+        container.setStorage(storage);
+        for (View view: {View::Ascending, View::SideCross, View::Prime}) {
+            CAPTURE(static_cast<int>(storage));
+            CAPTURE(static_cast<int>(view));
+            const std::vector<int> expected = sequential(view);
+            CHECK(container.viewSize(view) == expected.size());
+            CHECK(container.parallelReduce(view, std::vector<int>{}, concatenate, single, 7, pool) == expected);
+
+            std::atomic<long long> sum{0};
+            container.parallelForEach(view, [&sum](int element) {
+                sum.fetch_add(element);
+            }, 16, pool);
+            CHECK(sum.load() == std::accumulate(expected.begin(), expected.end(), 0LL));
+        }
+    }
+
+    CHECK(MagicalContainer().parallelReduce(View::Prime, 5, std::plus<>(), [](int e) { return e; }) == 5);
+    CHECK_THROWS_AS(container.parallelForEach(View::Ascending, [](int element) {
+        if (element == 1000) {
+            throw std::runtime_error("Error: stop");
+        }
+    }, 8, pool), std::runtime_error);
+}
+
+TEST_CASE("Lazy coroutine views") {
+    MagicalContainer eager;
+    MagicalContainer lazy;
+    lazy.setLazyViews(true);
+    CHECK(lazy.hasLazyViews());
+    std::vector<int> values;
+    for (int i = -20; i < 400; i += 3) {
+        values.push_back(i);
+    }
+    eager.addElements(values);
+    lazy.addElements(values);
+    lazy.addElement(7);
+    eager.addElement(7);
+    lazy.removeElement(10);
+    eager.removeElement(10);
+
+    const std::vector<int> cross = collect(MagicalContainer::SideCrossIterator(eager));
+    const std::vector<int> primes = primesOf(eager);
+
+    CHECK(collect(lazy.sideCross()) == cross);
+    CHECK(collect(eager.sideCross()) == cross);
+    CHECK(collect(lazy.primes()) == primes);
+    CHECK(collect(eager.primes()) == primes);
+
+    SUBCASE("Partial reads classify only what they reach") {
+        MagicalContainer fresh;
+        fresh.setLazyViews(true);
+        fresh.addElements(values);
+        fresh.resetStats();
+        Generator<int> generator = fresh.primes();
+        auto it = generator.begin();
+        CHECK(*it == 7);
+        ++it;
+        CHECK(*it == 13);
+        if constexpr (ContainerStats::Enabled) {
+            CHECK(fresh.stats().primalityTests == 64);
+        }
+    }
+
+    SUBCASE("Index-based iterators keep working") {
+        CHECK(lazy.primeCount() == eager.primeCount());
+        CHECK(primesOf(lazy) == primes);
+        MagicalContainer::SideCrossIterator lazyCross(lazy);
+        CHECK(*lazyCross == cross.front());
+        CHECK(lazy.getElements() == eager.getElements());
+    }
+
+    SUBCASE("Switching modes preserves the views") {
+        lazy.setLazyViews(false);
+        CHECK_FALSE(lazy.hasLazyViews());
+        CHECK(lazy.primeCount() == eager.primeCount());
+        CHECK(collect(lazy.primes()) == primes);
+        lazy.setStorage(MagicalContainer::Storage::Frozen);
+        CHECK(collect(lazy.sideCross()) == cross);
+    }
+
+    SUBCASE("Generators are lazy and clean up unfinished frames") {
+        MagicalContainer empty;
+        CHECK(collect(empty.sideCross()).empty());
+        Generator<int> unfinished = lazy.sideCross();
+        Generator<int> moved = std::move(unfinished);
+        CHECK(*moved.begin() == -20);
+    }
+}
+
+TEST_CASE("Set algebra between containers") {
+    auto expected = [](const MagicalContainer &left, const MagicalContainer &right, auto operation) {
+        std::vector<int> a = left.getElements();
+        std::vector<int> b = right.getElements();
+        std::vector<int> out;
+        operation(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(out));
+        return out;
+    };
+    auto checkAll = [&](const MagicalContainer &left, const MagicalContainer &right) {
+        const std::array<MagicalContainer, 4> results = {left.unionWith(right), left.intersectWith(right),
+                                                         left.differenceWith(right), left.symmetricDifference(right)};
+        CHECK(results[0].getElements() == expected(left, right, [](auto... args) { return std::set_union(args...); }));
+        CHECK(results[1].getElements() ==
+              expected(left, right, [](auto... args) { return std::set_intersection(args...); }));
+        CHECK(results[2].getElements() ==
+              expected(left, right, [](auto... args) { return std::set_difference(args...); }));
+        CHECK(results[3].getElements() ==
+              expected(left, right, [](auto... args) { return std::set_symmetric_difference(args...); }));
+        for (const MagicalContainer &result: results) {
+            std::vector<int> primes;
+            for (int element: result.getElements()) {
+                if (isPrimeValue(element)) {
+                    primes.push_back(element);
+                }
+            }
+            CHECK(primesOf(result) == primes);
+            CHECK(result.primeCount() == static_cast<int>(primes.size()));
+        }
+    };
+
+    MagicalContainer multiples;
+    MagicalContainer odds;
+    std::vector<int> values;
+    for (int i = -300; i < 3000; i += 3) {
+        values.push_back(i);
+    }
+    multiples.addElements(values);
+    values.clear();
+    for (int i = -101; i < 2500; i += 2) {
+        values.push_back(i);
+    }
+    odds.addElements(values);
+
+    SUBCASE("Balanced inputs") {
+        checkAll(multiples, odds);
+        checkAll(odds, multiples);
+        checkAll(multiples, multiples);
+        checkAll(multiples, MagicalContainer());
+        checkAll(MagicalContainer(), odds);
+    }
+
+    SUBCASE("Skewed inputs gallop in both directions") {
+        MagicalContainer few;
+        few.addElements(std::vector<int>{-300, -299, 7, 11, 12, 1999, 2999, 5000});
+        checkAll(multiples, few);
+        checkAll(few, multiples);
+        CHECK(gallop(std::vector<int>{1, 3, 5, 7, 9, 11}, 0, 8) == 4);
+        CHECK(gallop(std::vector<int>{1, 3, 5, 7, 9, 11}, 5, 100) == 6);
+        CHECK(gallop(std::vector<int>{1, 3, 5, 7, 9, 11}, 2, 1) == 2);
+    }
+
+    SUBCASE("Other backends and lazy views") {
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        bitmap.setElements(odds.getElements());
+        MagicalContainer frozen = multiples;
+        frozen.freeze();
+        checkAll(bitmap, frozen);
+        checkAll(frozen, bitmap);
+        MagicalContainer lazy;
+        lazy.setLazyViews(true);
+        lazy.addElements(multiples.getElements());
+        checkAll(lazy, odds);
+        CHECK(lazy.unionWith(odds).hasLazyViews());
+        CHECK_FALSE(odds.unionWith(lazy).hasLazyViews());
+    }
+
+    SUBCASE("Primality is carried over, not recomputed") {
+        if constexpr (ContainerStats::Enabled) {
+            multiples.resetStats();
+            odds.resetStats();
+            MagicalContainer combined = multiples.symmetricDifference(odds);
+            CHECK(combined.stats().primalityTests == 0);
+            CHECK(multiples.stats().primalityTests == 0);
+            CHECK(odds.stats().primalityTests == 0);
+        }
+    }
+}
+
+TEST_CASE("Order statistics and percentiles") {
+    std::vector<int> values;
+    for (int i = -50; i <= 500; i += 7) {
+        values.push_back(i);
+    }
+    MagicalContainer vector;
+    vector.setElements(values);
+
+    SUBCASE("Every backend answers the same queries") {
+        const std::string path = (std::filesystem::temp_directory_path() / "magical_order_test.snapshot").string();
+        vector.save(path);
+        std::vector<MagicalContainer> containers;
+        containers.emplace_back();
+        containers.back().setElements(values);
+        containers.emplace_back(MagicalContainer::Storage::Bitmap);
+        containers.back().setElements(values);
+        containers.emplace_back();
+        containers.back().setElements(values);
+        containers.back().freeze();
+        containers.push_back(MagicalContainer::mapFromFile(path));
+        containers.emplace_back();
+        containers.back().setLazyViews(true);
+        containers.back().setElements(values);
+
+        std::vector<int> primes;
+        std::copy_if(values.begin(), values.end(), std::back_inserter(primes), isPrimeValue);
+        for (const MagicalContainer &container: containers) {
+            for (int k = 0; k < container.size(); ++k) {
+                CHECK(container.kth(k) == values[static_cast<std::size_t>(k)]);
+            }
+            for (int k = 0; k < container.primeCount(); ++k) {
+                CHECK(container.kthPrime(k) == primes[static_cast<std::size_t>(k)]);
+            }
+            for (int x = -60; x <= 510; ++x) {
+                CHECK(container.rank(x) == std::lower_bound(values.begin(), values.end(), x) - values.begin());
+                CHECK(container.primeRank(x) == std::lower_bound(primes.begin(), primes.end(), x) - primes.begin());
+            }
+            CHECK(container.median() == doctest::Approx(values[values.size() / 2]));
+            CHECK(container.percentile(0) == values.front());
+            CHECK(container.percentile(100) == values.back());
+            CHECK(container.percentile(50) == values[(values.size() + 1) / 2 - 1]);
+            CHECK_THROWS_AS(container.kth(container.size()), std::out_of_range);
+            CHECK_THROWS_AS(container.kthPrime(-1), std::out_of_range);
+        }
+        std::filesystem::remove(path);
+    }
+
+    SUBCASE("Nearest-rank percentiles and even-sized medians") {
+        MagicalContainer container;
+        container.setElements({15, 20, 35, 40, 50});
+        CHECK(container.percentile(5) == 15);
+        CHECK(container.percentile(30) == 20);
+        CHECK(container.percentile(40) == 20);
+        CHECK(container.percentile(50) == 35);
+        CHECK(container.median() == 35);
+        container.addElement(60);
+        CHECK(container.median() == doctest::Approx(37.5));
+        CHECK_THROWS_AS(container.percentile(-1), std::out_of_range);
+        CHECK_THROWS_AS(container.percentile(100.5), std::out_of_range);
+        CHECK_THROWS_AS(MagicalContainer().median(), std::runtime_error);
+        CHECK_THROWS_AS(MagicalContainer().percentile(50), std::runtime_error);
+    }
+}
+
+TEST_CASE("Filtered views with compile-time predicates") {
+    std::vector<int> values;
+    for (int i = -200; i < 5000; i += 3) {
+        values.push_back(i);
+    }
+    MagicalContainer container;
+    container.setElements(values);
+
+    auto expected = [&values](auto predicate) {
+        std::vector<int> out;
+        std::copy_if(values.begin(), values.end(), std::back_inserter(out), predicate);
+        return out;
+    };
+    auto collectSized = [](const auto &view) {
+        std::vector<int> out = collect(view);
+        CHECK(out.size() == view.size());
+        return out;
+    };
+
+    SUBCASE("Selectivity hints pick the strategy") {
+        CHECK(FilteredView<IsPrime>::strategy() == FilterStrategy::Materialized);
+        CHECK(FilteredView<IsPerfectSquare>::strategy() == FilterStrategy::Materialized);
+        CHECK(FilteredView<InRange<0, 100>>::strategy() == FilterStrategy::Bitmap);
+        CHECK(FilteredView<IsEven>::strategy() == FilterStrategy::Lazy);
+    }
+
+    SUBCASE("Every strategy visits the same elements") {
+        CHECK(collectSized(FilteredView<IsEven, FilterStrategy::Materialized>(container)) == expected(IsEven()));
+        CHECK(collectSized(FilteredView<IsEven, FilterStrategy::Bitmap>(container)) == expected(IsEven()));
+        CHECK(collectSized(FilteredView<IsEven, FilterStrategy::Lazy>(container)) == expected(IsEven()));
+        CHECK(collectSized(FilteredView<IsPerfectSquare>(container)) == expected(IsPerfectSquare()));
+        CHECK(collectSized(FilteredView<IsPerfectSquare, FilterStrategy::Lazy>(container)) == expected(IsPerfectSquare()));
+        CHECK(collectSized(FilteredView<InRange<-50, 50>>(container)) == expected(InRange<-50, 50>()));
+        CHECK(collectSized(FilteredView<InRange<6000, 7000>>(container)).empty());
+    }
+
+    SUBCASE("The prime view matches the PrimeIterator on every backend") {
+        const std::vector<int> primes = primesOf(container);
+        CHECK(primes == expected(IsPrime()));
+        CHECK(collectSized(FilteredView<IsPrime>(container)) == primes);
+        CHECK(collectSized(FilteredView<IsPrime, FilterStrategy::Bitmap>(container)) == primes);
+        CHECK(collectSized(FilteredView<IsPrime, FilterStrategy::Lazy>(container)) == primes);
+        container.setStorage(MagicalContainer::Storage::Bitmap);
+        CHECK(collectSized(FilteredView<IsPrime>(container)) == primes);
+        CHECK(collectSized(FilteredView<IsEven>(container)) == expected(IsEven()));
+        container.freeze();
+        CHECK(collectSized(FilteredView<IsPrime>(container)) == primes);
+    }
+
+    SUBCASE("Empty containers") {
+        MagicalContainer empty;
+        CHECK(collectSized(FilteredView<IsPrime>(empty)).empty());
+        CHECK(collectSized(FilteredView<InRange<0, 10>>(empty)).empty());
+        CHECK(collectSized(FilteredView<IsEven>(empty)).empty());
+    }
+}
+
+TEST_CASE("Descending and reverse iterators") {
+    auto backward = [](const auto &iterator) {
+        return std::vector<int>(iterator.rbegin(), iterator.rend());
+    };
+    auto reversed = [](std::vector<int> values) {
+        std::reverse(values.begin(), values.end());
+        return values;
+    };
+
+    SUBCASE("Every size and backend walks backward exactly as it walks forward") {
+        for (int count = 0; count <= 9; ++count) {
+            std::vector<int> values;
+            for (int i = 0; i < count; ++i) {
+                values.push_back(i * 2 + 1);
+            }
+            MagicalContainer vector;
+            vector.setElements(values);
+            MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+            bitmap.setElements(values);
+            MagicalContainer frozen;
+            frozen.setElements(values);
+            frozen.freeze();
+            for (MagicalContainer *container: {&vector, &bitmap, &frozen}) {
+                MagicalContainer::AscendingIterator ascending(*container);
+                MagicalContainer::SideCrossIterator cross(*container);
+                MagicalContainer::PrimeIterator prime(*container);
+                MagicalContainer::DescendingIterator descending(*container);
+                CHECK(collect(ascending) == values);
+                CHECK(backward(ascending) == reversed(values));
+                CHECK(backward(cross) == reversed(collect(cross)));
+                CHECK(backward(prime) == reversed(collect(prime)));
+                CHECK(collect(descending) == reversed(values));
+                CHECK(backward(descending) == values);
+            }
+        }
+    }
+
+    SUBCASE("Stepping back and forth through the side-cross order") {
+        MagicalContainer container;
+        container.setElements({1, 2, 3, 4, 5, 6, 7});
+        MagicalContainer::SideCrossIterator cross(container);
+        auto it = cross.begin();
+        ++it;
+        ++it;
+        ++it;
+        CHECK(*it == 6);
+        --it;
+        CHECK(*it == 2);
+        --it;
+        CHECK(*it == 7);
+        ++it;
+        ++it;
+        ++it;
+        CHECK(*it == 3);
+        auto last = cross.end();
+        --last;
+        CHECK(*last == 4);
+        CHECK(*std::ranges::prev(cross.end(), 2) == 5);
+        --it;
+        --it;
+        --it;
+        --it;
+        CHECK(it == cross.begin());
+        CHECK_THROWS_AS(--it, std::runtime_error);
+    }
+
+    SUBCASE("Decrementing past the beginning throws") {
+        MagicalContainer container;
+        container.setElements({2, 3, 4});
+        MagicalContainer::AscendingIterator ascending(container);
+        MagicalContainer::PrimeIterator prime(container);
+        MagicalContainer::DescendingIterator descending(container);
+        auto a = ascending.begin();
+        auto p = prime.begin();
+        auto d = descending.begin();
+        CHECK_THROWS_AS(--a, std::runtime_error);
+        CHECK_THROWS_AS(--p, std::runtime_error);
+        CHECK_THROWS_AS(--d, std::runtime_error);
+        CHECK(*descending == 4);
+        CHECK(*std::ranges::prev(descending.end()) == 2);
+        CHECK(*std::ranges::prev(prime.end()) == 3);
+    }
+
+    SUBCASE("Assigned iterators step exactly like the iterator they were assigned from") {
+        MagicalContainer container;
+        container.setElements({1, 2, 3, 4, 5, 6, 7, 8, 9});
+        auto check = [](auto fresh, auto source, int steps) {
+            for (int i = 0; i < steps; ++i) {
+                ++source;
+            }
+            auto copied = fresh;
+            copied = source;
+            auto moved = fresh;
+            moved = std::move(decltype(source)(source));
+            for (auto *assigned: {&copied, &moved}) {
+                auto forward = source;
+                CHECK(*++*assigned == *++forward);
+                CHECK(*--*assigned == *--forward);
+                CHECK(*--*assigned == *--forward);
+            }
+        };
+        check(MagicalContainer::AscendingIterator(container), MagicalContainer::AscendingIterator(container), 3);
+        check(MagicalContainer::SideCrossIterator(container), MagicalContainer::SideCrossIterator(container), 3);
+        check(MagicalContainer::SideCrossIterator(container), MagicalContainer::SideCrossIterator(container), 6);
+        check(MagicalContainer::PrimeIterator(container), MagicalContainer::PrimeIterator(container), 2);
+    }
+
+    SUBCASE("Default construction and postfix steps work as for any bidirectional iterator") {
+        MagicalContainer container;
+        container.setElements({2, 3, 4, 5, 6});
+        auto check = [](auto iterator, const std::vector<int> &expected) {
+            decltype(iterator) empty;
+            empty = iterator;
+            CHECK(empty == iterator);
+            auto first = empty++;
+            CHECK(*first == expected.front());
+            CHECK(*empty == expected[1]);
+            auto second = empty--;
+            CHECK(*second == expected[1]);
+            CHECK(empty == first);
+            CHECK(std::ranges::distance(iterator.begin(), iterator.end()) ==
+                  static_cast<std::ptrdiff_t>(expected.size()));
+            CHECK(*std::ranges::next(iterator.begin(), 2) == expected[2]);
+            CHECK(std::vector<int>(iterator.rbegin(), iterator.rend()) ==
+                  std::vector<int>(expected.rbegin(), expected.rend()));
+        };
+        check(MagicalContainer::AscendingIterator(container), {2, 3, 4, 5, 6});
+        check(MagicalContainer::SideCrossIterator(container), {2, 6, 3, 5, 4});
+        check(MagicalContainer::PrimeIterator(container), {2, 3, 5});
+        check(MagicalContainer::DescendingIterator(container), {6, 5, 4, 3, 2});
+    }
+}
+
+TEST_CASE("Chunked traversal with spans") {
+    using View = MagicalContainer::View;
+    auto chunked = [](const MagicalContainer &container, View view, std::size_t chunkSize) {
+        std::vector<int> values;
+        container.forEachChunk(view, [&](std::span<const int> chunk) {
+            CHECK(!chunk.empty());
+            CHECK(chunk.size() <= chunkSize);
+            values.insert(values.end(), chunk.begin(), chunk.end());
+        }, chunkSize);
+        return values;
+    };
+
+    SUBCASE("Chunks of every size concatenate to the view on every backend") {
+        std::vector<int> values;
+        for (int i = 0; i < 300; ++i) {
+            values.push_back(i * 3 - 100);
+        }
+        const std::string path = (std::filesystem::temp_directory_path() / "magical_chunks_test.snapshot").string();
+        MagicalContainer vector;
+        vector.setElements(values);
+        vector.save(path);
+        MagicalContainer lazy;
+        lazy.setLazyViews(true);
+        lazy.setElements(values);
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        bitmap.setElements(values);
+        MagicalContainer frozen;
+        frozen.setElements(values);
+        frozen.freeze();
+        MagicalContainer mapped = MagicalContainer::mapFromFile(path);
+        for (MagicalContainer *container: {&vector, &lazy, &bitmap, &frozen, &mapped}) {
+            MagicalContainer::SideCrossIterator cross(*container);
+            MagicalContainer::PrimeIterator prime(*container);
+            for (std::size_t chunkSize: {std::size_t{1}, std::size_t{7}, std::size_t{64}, DefaultChunkSize}) {
+                CHECK(chunked(*container, View::Ascending, chunkSize) == values);
+                CHECK(chunked(*container, View::SideCross, chunkSize) ==
+                      std::vector<int>(cross.begin(), cross.end()));
+                CHECK(chunked(*container, View::Prime, chunkSize) ==
+                      std::vector<int>(prime.begin(), prime.end()));
+            }
+        }
+        std::filesystem::remove(path);
+
+        MagicalContainer empty;
+        CHECK(chunked(empty, View::SideCross, 8).empty());
+    }
+
+    SUBCASE("Ascending chunks of a vector point into storage, other chunks reuse one buffer") {
+        MagicalContainer container;
+        container.setElements({2, 3, 4, 5, 6, 7, 8, 9, 10, 11});
+        std::vector<const int *> starts;
+        container.forEachChunk(View::Ascending, [&](std::span<const int> chunk) {
+            starts.push_back(chunk.data());
+        }, 4);
+        REQUIRE(starts.size() == 3);
+        CHECK(starts[1] == starts[0] + 4);
+        CHECK(starts[2] == starts[0] + 8);
+
+        starts.clear();
+        container.forEachChunk(View::SideCross, [&](std::span<const int> chunk) {
+            starts.push_back(chunk.data());
+        }, 4);
+        REQUIRE(starts.size() == 3);
+        CHECK(starts[1] == starts[0]);
+        CHECK(starts[2] == starts[0]);
+    }
+}
+
+TEST_CASE("Materializing the side-cross order") {
+    SUBCASE("Every size and backend matches the side-cross iterator") {
+        for (int count = 0; count <= 40; ++count) {
+            std::vector<int> values;
+            for (int i = 0; i < count; ++i) {
+                values.push_back(i * 5 - 50);
+            }
+            MagicalContainer vector;
+            vector.setElements(values);
+            MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+            bitmap.setElements(values);
+            MagicalContainer frozen;
+            frozen.setElements(values);
+            frozen.freeze();
+            for (MagicalContainer *container: {&vector, &bitmap, &frozen}) {
+                MagicalContainer::SideCrossIterator cross(*container);
+                std::vector<int> out(values.size());
+                CHECK(container->materializeSideCross(out) == values.size());
+                CHECK(out == std::vector<int>(cross.begin(), cross.end()));
+            }
+        }
+    }
+
+    SUBCASE("The output must have room for every element and is written no further") {
+        MagicalContainer container;
+        container.setElements({1, 2, 3, 4, 5});
+        std::vector<int> small(4);
+        CHECK_THROWS_AS(container.materializeSideCross(small), std::runtime_error);
+        std::vector<int> large(7, 0);
+        CHECK(container.materializeSideCross(large) == 5);
+        CHECK(large == std::vector<int>{1, 5, 2, 4, 3, 0, 0});
+    }
+
+    SUBCASE("An empty container writes nothing") {
+        std::vector<int> out(3, 7);
+        CHECK(MagicalContainer().materializeSideCross(out) == 0);
+        CHECK(MagicalContainer(MagicalContainer::Storage::Bitmap).materializeSideCross({}) == 0);
+        CHECK(out == std::vector<int>{7, 7, 7});
+    }
+}
+
+TEST_CASE("Range sums, counts and means") {
+    auto expected = [](const std::vector<int> &values, int low, int high, bool primesOnly) {
+        long long sum = 0;
+        int count = 0;
+        for (int value: values) {
+            if (low <= value && value <= high && (!primesOnly || isPrimeValue(value))) {
+                sum += value;
+                ++count;
+            }
+        }
+        return std::make_pair(count, sum);
+    };
+
+    SUBCASE("Every backend agrees with a linear scan, with and without the index") {
+        std::vector<int> values;
+        for (int i = -40; i < 200; i += 3) {
+            values.push_back(i);
+        }
+        values.push_back(std::numeric_limits<int>::max());
+        MagicalContainer vector;
+        vector.setElements(values);
+        MagicalContainer lazy;
+        lazy.setLazyViews(true);
+        lazy.setElements(values);
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        bitmap.setElements(values);
+        MagicalContainer frozen;
+        frozen.setElements(values);
+        frozen.freeze();
+        const std::vector<std::pair<int, int>> ranges = {
+                {-100, 300}, {0, 0}, {2, 2}, {5, 50}, {51, 52}, {10, 5}, {-40, -40},
+                {100, std::numeric_limits<int>::max()}, {std::numeric_limits<int>::min(), -1}};
+        for (MagicalContainer *container: {&vector, &lazy, &bitmap, &frozen}) {
+            for (bool indexed: {false, true}) {
+                container->setAggregateIndex(indexed);
+                CHECK(container->hasAggregateIndex() == indexed);
+                for (auto [low, high]: ranges) {
+                    const auto [count, sum] = expected(values, low, high, false);
+                    const auto [primes, primeSum] = expected(values, low, high, true);
+                    CHECK(container->count(low, high) == count);
+                    CHECK(container->sum(low, high) == sum);
+                    CHECK(container->primeCount(low, high) == primes);
+                    CHECK(container->primeSum(low, high) == primeSum);
+                    if (count > 0) {
+                        CHECK(container->mean(low, high) == doctest::Approx(static_cast<double>(sum) / count));
+                    } else {
+                        CHECK_THROWS_AS(container->mean(low, high), std::runtime_error);
+                    }
+                    if (primes > 0) {
+                        CHECK(container->primeMean(low, high) ==
+                              doctest::Approx(static_cast<double>(primeSum) / primes));
+                    } else {
+                        CHECK_THROWS_AS(container->primeMean(low, high), std::runtime_error);
+                    }
+                }
+            }
+        }
+    }
+
+    SUBCASE("The index follows changes to the elements") {
+        for (auto storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap}) {
+            MagicalContainer container(storage);
+            container.setAggregateIndex(true);
+            container.setElements({1, 2, 3, 4});
+            CHECK(container.sum(0, 10) == 10);
+            CHECK(container.primeSum(0, 10) == 5);
+            container.addElement(7);
+            CHECK(container.sum(0, 10) == 17);
+            CHECK(container.primeSum(0, 10) == 12);
+            container.removeElement(2);
+            CHECK(container.sum(0, 10) == 15);
+            CHECK(container.primeSum(0, 10) == 10);
+            container.setElements({-5, 5});
+            CHECK(container.sum(-10, 10) == 0);
+            CHECK(container.primeMean(-10, 10) == 5.0);
+        }
+    }
+}
+
+TEST_CASE("Value histograms maintained on every change") {
+    SUBCASE("Linear and log-scaled bucket layouts") {
+        ValueHistogram linear = ValueHistogram::linear(0, 99, 10);
+        CHECK(linear.bucketCount() == 10);
+        CHECK(linear.bucketLow(3) == 30);
+        CHECK(linear.bucketHigh(3) == 39);
+        for (int value: {-1, 0, 9, 10, 55, 99, 100}) {
+            linear.add(value);
+        }
+        CHECK(linear.underflow() == 1);
+        CHECK(linear.overflow() == 1);
+        CHECK(linear.bucket(0) == 2);
+        CHECK(linear.bucket(1) == 1);
+        CHECK(linear.bucket(5) == 1);
+        CHECK(linear.bucket(9) == 1);
+        linear.remove(9);
+        CHECK(linear.bucket(0) == 1);
+        CHECK(linear.count() == 6);
+        CHECK_THROWS_AS(linear.bucket(10), std::out_of_range);
+        CHECK_THROWS_AS(ValueHistogram::linear(5, 4, 1), std::runtime_error);
+        CHECK_THROWS_AS(ValueHistogram::linear(0, 4, 0), std::runtime_error);
+        CHECK(ValueHistogram::linear(0, 2, 10).bucketCount() == 3);
+
+        ValueHistogram log = ValueHistogram::log2();
+        CHECK(log.bucketCount() == ValueHistogram::Log2BucketCount);
+        for (int value: {0, 1, 2, 3, 4, -1, -2, -3, std::numeric_limits<int>::max(),
+                         std::numeric_limits<int>::min()}) {
+            log.add(value);
+        }
+        CHECK(log.bucket(32) == 1);
+        CHECK(log.bucket(33) == 1);
+        CHECK(log.bucket(34) == 2);
+        CHECK(log.bucket(35) == 1);
+        CHECK(log.bucket(31) == 1);
+        CHECK(log.bucket(30) == 2);
+        CHECK(log.bucket(63) == 1);
+        CHECK(log.bucket(0) == 1);
+        CHECK(log.bucketLow(34) == 2);
+        CHECK(log.bucketHigh(34) == 3);
+        CHECK(log.bucketLow(30) == -3);
+        CHECK(log.bucketHigh(30) == -2);
+        CHECK(log.bucketLow(0) == std::numeric_limits<int>::min());
+        CHECK(log.bucketHigh(63) == std::numeric_limits<int>::max());
+    }
+
+    SUBCASE("Interpolated quantiles stay within a bucket width of the exact percentile") {
+        MagicalContainer container;
+        std::vector<int> values;
+        for (int i = 0; i < 1000; ++i) {
+            values.push_back(i * i % 10007);
+        }
+        container.setElements(values);
+        container.setHistogram(ValueHistogram::linear(0, 10006, 100));
+        const ValueHistogram &histogram = container.histogram();
+        for (double q: {0.0, 0.1, 0.5, 0.9, 0.99, 1.0}) {
+            const int exact = container.kth(static_cast<int>(q * (container.size() - 1)));
+            CHECK(std::abs(histogram.quantile(q) - exact) <= 101);
+        }
+        CHECK_THROWS_AS(histogram.quantile(1.5), std::runtime_error);
+        CHECK_THROWS_AS(ValueHistogram::log2().quantile(0.5), std::runtime_error);
+    }
+
+    SUBCASE("Every mutation on every mutable backend keeps the histogram exact") {
+        auto rebuilt = [](const MagicalContainer &container) {
+            ValueHistogram expected = ValueHistogram::linear(-50, 49, 7);
+            for (int element: container.getElements()) {
+                expected.add(element);
+            }
+            return expected;
+        };
+        auto same = [](const ValueHistogram &left, const ValueHistogram &right) {
+            bool equal = left.count() == right.count() && left.underflow() == right.underflow() &&
+                         left.overflow() == right.overflow();
+            for (std::size_t i = 0; i < left.bucketCount(); ++i) {
+                equal = equal && left.bucket(i) == right.bucket(i);
+            }
+            return equal;
+        };
+        MagicalContainer vector;
+        MagicalContainer lazy;
+        lazy.setLazyViews(true);
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        for (MagicalContainer *container: {&vector, &lazy, &bitmap}) {
+            CHECK_FALSE(container->hasHistogram());
+            CHECK_THROWS_AS(container->histogram(), std::runtime_error);
+            container->setElements({-60, 0, 3, 70});
+            container->setHistogram(ValueHistogram::linear(-50, 49, 7));
+            CHECK(container->hasHistogram());
+            CHECK(same(container->histogram(), rebuilt(*container)));
+            container->addElement(5);
+            container->addElement(5);
+            container->addElements(std::vector<int>{1, 3, 44, 44, 99, -100});
+            container->removeElement(0);
+            CHECK(same(container->histogram(), rebuilt(*container)));
+            CHECK(container->histogram().count() == static_cast<std::uint64_t>(container->size()));
+            container->setElements({10, 20});
+            CHECK(same(container->histogram(), rebuilt(*container)));
+            container->clearHistogram();
+            CHECK_FALSE(container->hasHistogram());
+        }
+    }
+}
+
+TEST_CASE("Copies share storage until one of them changes") {
+
+    SUBCASE("The views of a copy outlive the source") {
+        auto source = std::make_unique<MagicalContainer>();
+        source->setElements({2, 3, 4, 9, 11, 17});
+        MagicalContainer copy = *source;
+        source->addElement(5);
+        source.reset();
+        CHECK(ascendingOf(copy) == std::vector<int>{2, 3, 4, 9, 11, 17});
+        CHECK(primesOf(copy) == std::vector<int>{2, 3, 11, 17});
+        MagicalContainer assigned;
+        {
+            MagicalContainer temporary;
+            temporary.setElements({7, 8});
+            assigned = temporary;
+        }
+        CHECK(ascendingOf(assigned) == std::vector<int>{7, 8});
+        CHECK(primesOf(assigned) == std::vector<int>{7});
+    }
+
+    SUBCASE("Changing either side leaves the other one intact on every backend") {
+        for (auto storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap}) {
+            for (bool lazy: {false, true}) {
+                MagicalContainer source(storage);
+                source.setLazyViews(lazy);
+                source.setAggregateIndex(true);
+                source.setSearchIndex(true);
+                std::vector<int> values;
+                for (int i = 0; i < 300000; i += 3) {
+                    values.push_back(i);
+                }
+                source.setElements(values);
+                CHECK(source.sum(0, 3) == 3);
+
+                MagicalContainer copy = source;
+                copy.addElement(1);
+                copy.removeElement(299997);
+                CHECK(source.size() == 100000);
+                CHECK_FALSE(source.contains(1));
+                CHECK(source.contains(299997));
+                CHECK(source.sum(0, 3) == 3);
+                CHECK(copy.size() == 100000);
+                CHECK(copy.contains(1));
+                CHECK_FALSE(copy.contains(299997));
+                CHECK(copy.sum(0, 3) == 4);
+                CHECK(primesOf(copy).front() == 3);
+
+                source.addElements(std::vector<int>{4, 7});
+                CHECK(source.size() == 100002);
+                CHECK_FALSE(copy.contains(4));
+            }
+        }
+    }
+
+    SUBCASE("Frozen copies share their compressed blocks") {
+        MagicalContainer source;
+        source.setElements({1, 2, 3, 5, 8, 13, 21});
+        source.freeze();
+        MagicalContainer copy = source;
+        source.setStorage(MagicalContainer::Storage::Vector);
+        source.addElement(34);
+        CHECK(copy.isFrozen());
+        CHECK(copy.getElements() == std::vector<int>{1, 2, 3, 5, 8, 13, 21});
+        CHECK(source.size() == 8);
+    }
+
+    SUBCASE("Copies can be queried from different threads") {
+        for (bool lazy: {false, true}) {
+            MagicalContainer source;
+            source.setLazyViews(lazy);
+            std::vector<int> values(20000);
+            std::iota(values.begin(), values.end(), 0);
+            source.setElements(values);
+            MagicalContainer copy = source;
+            MagicalContainer empty;
+            MagicalContainer otherEmpty;
+            source.setSearchIndex(true);
+            copy.setSearchIndex(true);
+            empty.setSearchIndex(true);
+            otherEmpty.setSearchIndex(true);
+            auto query = [](const MagicalContainer &container, const MagicalContainer &none) {
+                int found = 0;
+                for (int value = 0; value < 20000; value += 7) {
+                    found += container.contains(value) ? 1 : 0;
+                    found += none.contains(value) ? 1 : 0;
+                }
+                return std::make_pair(found, container.primeCount());
+            };
+            std::pair<int, int> left;
+            std::pair<int, int> right;
+            std::thread reader([&] {
+                left = query(source, empty);
+            });
+            right = query(copy, otherEmpty);
+            reader.join();
+            CHECK(left == std::make_pair(2858, 2262));
+            CHECK(right == left);
+        }
+    }
+
+    SUBCASE("One container can be queried from several threads on every backend") {
+        std::vector<int> values(6000);
+        std::iota(values.begin(), values.end(), -1000);
+        auto query = [](const MagicalContainer &container) {
+            long long total = 0;
+            for (int value = -1000; value < 5000; value += 13) {
+                total += container.contains(value) ? 1 : 0;
+                total += container.rank(value);
+            }
+            for (int k = 0; k < container.primeCount(); k += 5) {
+                total += container.kthPrime(k);
+            }
+            total += container.sum(-500, 4000) + container.primeSum(0, 3000);
+            MagicalContainer::PrimeIterator prime(container);
+            for (auto it = prime.begin(); it != prime.end(); ++it) {
+                total += *it;
+            }
+            MagicalContainer::SideCrossIterator cross(container);
+            for (auto it = cross.begin(); it != cross.end(); ++it) {
+                total ^= *it;
+            }
+            return total;
+        };
+        for (MagicalContainer::Storage storage: {MagicalContainer::Storage::Vector, MagicalContainer::Storage::Bitmap,
+                                                 MagicalContainer::Storage::Frozen}) {
+            for (bool lazy: {false, true}) {
+                MagicalContainer reference;
+                reference.setElements(values);
+                const long long expected = query(reference);
+
+                MagicalContainer container;
+                container.setLazyViews(lazy);
+                container.setSearchIndex(true);
+                container.setAggregateIndex(true);
+                container.setElements(values);
+                container.setStorage(storage);
+                std::vector<long long> results(3);
+                std::vector<std::thread> readers;
+                for (std::size_t reader = 1; reader < results.size(); ++reader) {
+                    readers.emplace_back([&, reader] {
+                        results[reader] = query(container);
+                    });
+                }
+                results[0] = query(container);
+                for (std::thread &reader: readers) {
+                    reader.join();
+                }
+                CHECK(results == std::vector<long long>(results.size(), expected));
+            }
+        }
+    }
+}
+
+TEST_CASE("Persistent versions share their unchanged nodes") {
+    auto sideCross = [](std::vector<int> sorted) {
+        std::vector<int> order;
+        for (std::size_t low = 0, high = sorted.size(); low < high; ++low) {
+            order.push_back(sorted[low]);
+            if (low != --high) {
+                order.push_back(sorted[high]);
+            }
+        }
+        return order;
+    };
+
+    SUBCASE("Every version keeps its own elements in all three orders") {
+        std::vector<PersistentContainer> versions{PersistentContainer()};
+        std::vector<std::vector<int>> expected{{}};
+        for (int step = 0; step < 3000; ++step) {
+            const int element = (step * 7919) % 2003;
+            std::vector<int> next = expected.back();
+            auto position = std::lower_bound(next.begin(), next.end(), element);
+            if (step % 3 == 2 && position != next.end() && *position == element) {
+                next.erase(position);
+                versions.push_back(versions.back().removeElement(element));
+            } else {
+                if (position == next.end() || *position != element) {
+                    next.insert(position, element);
+                }
+                versions.push_back(versions.back().addElement(element));
+            }
+            expected.push_back(next);
+        }
+        for (std::size_t i = 0; i < versions.size(); i += 97) {
+            const PersistentContainer &version = versions[i];
+            std::vector<int> primes;
+            std::copy_if(expected[i].begin(), expected[i].end(), std::back_inserter(primes), isPrimeValue);
+            CHECK(version.size() == static_cast<int>(expected[i].size()));
+            CHECK(version.getElements() == expected[i]);
+            CHECK(collect(version.ascending()) == expected[i]);
+            CHECK(collect(version.sideCross()) == sideCross(expected[i]));
+            CHECK(collect(version.primes()) == primes);
+            CHECK(version.primeCount() == static_cast<int>(primes.size()));
+            if (!expected[i].empty()) {
+                CHECK(version.kth(static_cast<int>(expected[i].size() / 2)) == expected[i][expected[i].size() / 2]);
+            }
+        }
+        CHECK_THROWS_AS(versions.back().kth(versions.back().size()), std::out_of_range);
+    }
+
+    SUBCASE("Removing everything and duplicate additions") {
+        std::vector<int> values(500);
+        std::iota(values.begin(), values.end(), -250);
+        PersistentContainer full(values);
+        PersistentContainer version = full;
+        for (int element: values) {
+            CHECK(version.addElement(element).size() == version.size());
+            version = version.removeElement(element);
+            CHECK_FALSE(version.contains(element));
+        }
+        CHECK(version.size() == 0);
+        CHECK(collect(version.sideCross()).empty());
+        CHECK_THROWS_AS(version.removeElement(3), std::runtime_error);
+        CHECK(full.getElements() == values);
+        CHECK(collect(PersistentContainer(full).removeElement(0).primes()).size() == 53);
+    }
+
+    SUBCASE("Memory grows with the changes, not with the versions") {
+        std::vector<int> values(100000);
+        std::iota(values.begin(), values.end(), 0);
+        std::vector<PersistentContainer> versions{PersistentContainer(values)};
+        const std::size_t base = versions.front().memoryBytes();
+        for (int i = 0; i < 100; ++i) {
+            versions.push_back(versions.back().addElement(100000 + i * 1000).removeElement(i * 1000));
+        }
+        CHECK(PersistentContainer::memoryBytes(versions) < 2 * base);
+        CHECK(versions.front().memoryBytes() == base);
+        CHECK(versions.back().size() == 100000);
+    }
+}
+
+TEST_CASE("Memory usage, reserve and shrinkToFit") {
+
+    SUBCASE("The breakdown follows the vector storage and its views") {
+        MagicalContainer container;
+        CHECK(container.memoryUsage().total().used == 0);
+        std::vector<int> values(1000);
+        std::iota(values.begin(), values.end(), 1);
+        container.setElements(values);
+        const MemoryUsage usage = container.memoryUsage();
+        CHECK(usage.elements.used == 1000 * sizeof(int));
+        CHECK(usage.ascendingView.used == 1000 * sizeof(int *));
+        CHECK(usage.crossView.used == 1000 * sizeof(int *));
+        CHECK(usage.primeView.used == 168 * sizeof(int *));
+        CHECK(usage.elements.reserved >= usage.elements.used);
+        CHECK(usage.bitmap.used == 0);
+        CHECK(usage.total().used >= usage.elements.used + 2168 * sizeof(int *));
+        container.setSearchIndex(true);
+        CHECK(container.contains(500));
+        CHECK(container.memoryUsage().searchIndex.used > 0);
+    }
+
+    SUBCASE("Reserved room absorbs a bulk load without reallocating") {
+        for (bool lazy: {false, true}) {
+            MagicalContainer container;
+            container.setLazyViews(lazy);
+            container.addElements(std::vector<int>{5, 2});
+            container.reserve(5000);
+            const MemoryUsage before = container.memoryUsage();
+            CHECK(before.elements.reserved == 5000 * sizeof(int));
+            CHECK(ascendingOf(container) == std::vector<int>{2, 5});
+            std::vector<int> expected{2, 5};
+            for (int batch = 0; batch < 10; ++batch) {
+                std::vector<int> values;
+                for (int i = 0; i < 400; ++i) {
+                    values.push_back(batch * 400 + i + 10);
+                    expected.push_back(batch * 400 + i + 10);
+                }
+                container.addElements(values);
+                container.addElement(-batch);
+                expected.push_back(-batch);
+            }
+            std::sort(expected.begin(), expected.end());
+            expected.erase(std::unique(expected.begin(), expected.end()), expected.end());
+            const MemoryUsage after = container.memoryUsage();
+            CHECK(after.elements.reserved == before.elements.reserved);
+            CHECK(after.ascendingView.reserved == before.ascendingView.reserved);
+            CHECK(after.crossView.reserved == before.crossView.reserved);
+            CHECK(after.primeView.reserved == before.primeView.reserved);
+            CHECK(ascendingOf(container) == expected);
+
+            std::vector<int> expectedPrimes;
+            std::copy_if(expected.begin(), expected.end(), std::back_inserter(expectedPrimes), isPrimeValue);
+            container.shrinkToFit();
+            const MemoryUsage shrunk = container.memoryUsage();
+            CHECK(shrunk.elements.reserved == shrunk.elements.used);
+            CHECK(shrunk.ascendingView.reserved == shrunk.ascendingView.used);
+            CHECK(ascendingOf(container) == expected);
+            CHECK(primesOf(container) == expectedPrimes);
+            container.reserve(10000);
+            CHECK(primesOf(container) == expectedPrimes);
+            CHECK(container.getElement(0) == expected.front());
+        }
+    }
+
+    SUBCASE("Other backends") {
+        MagicalContainer bitmap(MagicalContainer::Storage::Bitmap);
+        bitmap.setElements({1, 2, 3, 100000});
+        bitmap.reserve(100);
+        bitmap.shrinkToFit();
+        CHECK(bitmap.memoryUsage().bitmap.used > 0);
+        CHECK(bitmap.memoryUsage().elements.used == 0);
+        CHECK(bitmap.getElements() == std::vector<int>{1, 2, 3, 100000});
+
+        MagicalContainer frozen;
+        frozen.setElements({1, 2, 3});
+        frozen.freeze();
+        CHECK(frozen.memoryUsage().frozen.used > 0);
+        CHECK_THROWS_AS(frozen.reserve(10), std::runtime_error);
+        frozen.shrinkToFit();
+        CHECK(frozen.size() == 3);
+    }
+}
+
+TEST_CASE("Huge page and NUMA page policies") {
+    SUBCASE("The allocator maps large arrays on huge page boundaries and falls back when it must") {
+        CHECK(pageSupport().onlineNodes != 0);
+        const std::size_t count = 3 * HugePageSize / sizeof(int) + 5;
+        for (HugePages hugePages: {HugePages::Off, HugePages::Transparent, HugePages::Explicit}) {
+            for (NumaPlacement placement: {NumaPlacement::Local, NumaPlacement::Interleave, NumaPlacement::Bind}) {
+                const PagePolicy policy{hugePages, placement, 0};
+                std::vector<int, PageAllocator<int>> values(count, 7, PageAllocator<int>(policy));
+                values[count - 1] = 9;
+                CHECK(values.get_allocator().getPolicy() == policy);
+                CHECK(usesPages(count * sizeof(int), policy) == (policy != PagePolicy()));
+                if (usesPages(count * sizeof(int), policy)) {
+                    CHECK(reinterpret_cast<std::uintptr_t>(values.data()) % HugePageSize == 0);
+                }
+                CHECK(std::accumulate(values.begin(), values.end(), 0LL) == 7LL * static_cast<long long>(count) + 2);
+                std::vector<int, PageAllocator<int>> small(3, 1, PageAllocator<int>(policy));
+                CHECK_FALSE(usesPages(small.size() * sizeof(int), policy));
+                small.swap(values);
+                CHECK(small.size() == count);
+            }
+        }
+    }
+
+    SUBCASE("A container keeps its elements and views across policy changes") {
+        std::vector<int> values(1 << 20);
+        std::iota(values.begin(), values.end(), 0);
+        for (bool lazy: {false, true}) {
+            MagicalContainer container;
+            container.setLazyViews(lazy);
+            container.setElements(values);
+            const int primes = container.primeCount();
+            container.setPagePolicy({HugePages::Transparent, NumaPlacement::Interleave, 0});
+            CHECK(container.getPagePolicy().hugePages == HugePages::Transparent);
+            CHECK(container.size() == 1 << 20);
+            CHECK(container.primeCount() == primes);
+            MagicalContainer::PrimeIterator prime(container);
+            CHECK(*prime == 2);
+            MagicalContainer::SideCrossIterator cross(container);
+            CHECK(*++cross == (1 << 20) - 1);
+
+            MagicalContainer copy = container;
+            copy.addElement(-1);
+            container.removeElement(2);
+            CHECK(copy.getElement(0) == -1);
+            CHECK(copy.primeCount() == primes);
+            CHECK(container.primeCount() == primes - 1);
+            CHECK(copy.getPagePolicy() == container.getPagePolicy());
+
+            container.setStorage(MagicalContainer::Storage::Bitmap);
+            container.setStorage(MagicalContainer::Storage::Vector);
+            container.reserve(1 << 21);
+            container.shrinkToFit();
+            container.setPagePolicy(PagePolicy());
+            CHECK(container.size() == (1 << 20) - 1);
+            CHECK(container.kth(2) == 3);
+            CHECK(container.primeCount() == primes - 1);
+        }
+    }
+}
@@ -0,0 +1,196 @@
+//
+// Asynchronous ingest front end.
+//
+
+#include "AsyncIngest.hpp"
+#include "MagicalContainer.hpp"
+
+
+namespace ariel {
+
+/**
+ * @brief Starts the merge thread.
+ * @param container The container to feed. It must outlive the AsyncIngest.
+ * @param capacity The number of values the ring can hold before producers have to wait.
+ * @param batchSize The largest number of values merged at a time.
+ */
+    AsyncIngest::AsyncIngest(MagicalContainer &container, std::size_t capacity, std::size_t batchSize)
+            : container(container), ring(capacity), batchSize(batchSize == 0 ? 1 : batchSize),
+              current(std::make_shared<const MagicalContainer>(container)), worker([this] { run(); }) {}
+
+/**
+ * @brief Merges every value enqueued so far, stops the merge thread and leaves the latest version in the
+ * container.
+ */
+    AsyncIngest::~AsyncIngest() {
+        stopping.store(true);
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCondition.notify_one();
+        }
+        worker.join();
+    }
+
+/**
+ * @brief Pushes a value into the ring, waiting for space if it is full.
+ * @param value The value to enqueue.
+ * @param held A lock the caller holds, released while waiting so the worker can make room.
+ * @return The position of the value in the ring.
+ */
+    std::size_t AsyncIngest::enqueue(int value, std::unique_lock<std::mutex> *held) {
+        std::size_t position = ring.tryPush(value);
+        while (position == SIZE_MAX) {
+            if (held != nullptr) {
+                held->unlock();
+            }
+            std::this_thread::yield();
+            if (held != nullptr) {
+                held->lock();
+            }
+            position = ring.tryPush(value);
+        }
+        return position;
+    }
+
+/**
+ * @brief Wakes the worker if it sleeps. Called by a producer after it published a value.
+ */
+    void AsyncIngest::wake() {
+        // The value was published before this load and run() announces sleep before it checks the ring, all
+        // sequentially consistent, so either the worker sees the value or this sees the worker sleeping.
+        if (workerSleeping.load(std::memory_order_seq_cst)) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            wakeCondition.notify_one();
+        }
+    }
+
+/**
+ * @brief Get the latest published version of the container.
+ * @return A version that never changes.
+ */
+    std::shared_ptr<const MagicalContainer> AsyncIngest::snapshot() const {
+        std::lock_guard<std::mutex> lock(versionMutex);
+        return current;
+    }
+
+/**
+ * @brief Enqueues a value without waiting for it to be merged.
+ * @param value The value to add to the container.
+ */
+    void AsyncIngest::add(int value) {
+        enqueue(value);
+        wake();
+    }
+
+/**
+ * @brief Enqueues a value and returns a future that becomes ready once it is visible to readers.
+ * @param value The value to add to the container.
+ * @return A future holding a version() at which the value is visible, or the error that prevented the merge.
+ */
+    std::future<std::uint64_t> AsyncIngest::addAsync(int value) {
+        std::promise<std::uint64_t> promise;
+        std::future<std::uint64_t> future = promise.get_future();
+        {
+            // The value is pushed and its promise registered under promiseMutex, which the worker takes to
+            // complete the promises of a batch, so the batch holding the value always finds the promise.
+            std::unique_lock<std::mutex> lock(promiseMutex);
+            promises.emplace(enqueue(value, &lock), std::move(promise));
+        }
+        wake();
+        return future;
+    }
+
+/**
+ * @brief Waits until every value enqueued before the call has been merged and published.
+ * @throws The first error raised while merging, if any.
+ */
+    void AsyncIngest::flush() {
+        const std::size_t target = ring.claimed();
+        std::unique_lock<std::mutex> lock(appliedMutex);
+        appliedCondition.wait(lock, [&] {
+            return applied.load() >= target;
+        });
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+/**
+ * @brief Get the published version of the container.
+ * @return The number of batches merged so far.
+ */
+    std::uint64_t AsyncIngest::version() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+/**
+ * @brief Merges one batch into a copy of the latest version, publishes the copy and completes the futures
+ * of the values the batch held. Readers only wait for the pointer swap, not for the merge.
+ * @param batch The values drained from the ring. It is cleared.
+ */
+    void AsyncIngest::merge(std::vector<int> &batch) {
+        std::exception_ptr failure;
+        std::uint64_t mergedVersion = 0;
+        try {
+            auto next = std::make_shared<MagicalContainer>(*current);
+            next->addElements(batch);
+            std::lock_guard<std::mutex> lock(versionMutex);
+            current = std::move(next);
+            mergedVersion = published.fetch_add(1, std::memory_order_acq_rel) + 1;
+        } catch (...) {
+            failure = std::current_exception();
+        }
+
+        const std::size_t first = applied.load();
+        const std::size_t done = first + batch.size();
+        batch.clear();
+        {
+            std::lock_guard<std::mutex> lock(appliedMutex);
+            if (failure && !error) {
+                error = failure;
+            }
+            applied.store(done);
+        }
+        appliedCondition.notify_all();
+
+        std::lock_guard<std::mutex> lock(promiseMutex);
+        while (!promises.empty() && promises.begin()->first < done) {
+            if (failure) {
+                promises.begin()->second.set_exception(failure);
+            } else {
+                promises.begin()->second.set_value(mergedVersion);
+            }
+            promises.erase(promises.begin());
+        }
+    }
+
+/**
+ * @brief The merge thread: drains the ring in batches until stopped and everything enqueued is merged, then
+ * stores the latest version in the container. When the ring is empty it sleeps until a producer wakes it.
+ */
+    void AsyncIngest::run() {
+        std::vector<int> batch;
+        batch.reserve(batchSize);
+        while (true) {
+            int value = 0;
+            while (batch.size() < batchSize && ring.tryPop(value)) {
+                batch.push_back(value);
+            }
+            if (!batch.empty()) {
+                merge(batch);
+                continue;
+            }
+            if (stopping.load() && applied.load() == ring.claimed()) {
+                container = *current;
+                return;
+            }
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            workerSleeping.store(true, std::memory_order_seq_cst);
+            wakeCondition.wait(lock, [&] {
+                return stopping.load() || ring.ready();
+            });
+            workerSleeping.store(false, std::memory_order_relaxed);
+        }
+    }
+
+}
@@ -0,0 +1,197 @@
+/**
+ * @file AsyncIngest.hpp
+ * @brief An asynchronous ingest front end for a MagicalContainer.
+ * Producer threads push values into a bounded lock-free MPSC ring and return immediately. A dedicated worker
+ * thread drains the ring in batches. It merges each batch with addElements() into a copy of the latest
+ * version, which shares its storage until the merge changes it, and publishes the copy as the next version
+ * by swapping a pointer under a brief lock. Readers go through read(), which runs on the version published
+ * when it started. A version never changes once published, so readers observe a whole batch or none of it
+ * and never wait for a merge. flush() and addAsync() give callers durability points.
+ */
+
+#ifndef MAGICAL_ITERATORS_ASYNCINGEST_HPP
+#define MAGICAL_ITERATORS_ASYNCINGEST_HPP
+
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace ariel {
+
+    class MagicalContainer;
+
+/**
+ * @class MpscRing
+ * @brief A bounded multi-producer, single-consumer ring buffer.
+ * Every slot carries a sequence number: a producer claims a position with a CAS on the tail and publishes its
+ * value by advancing the slot's sequence, and the consumer frees the slot by advancing it once more. Values
+ * are consumed in the order their positions were claimed. Publishing and ready() are sequentially consistent,
+ * so a consumer that announces it is going to sleep and then checks ready() cannot miss a producer that
+ * publishes and then checks the announcement.
+ */
+    template<typename T>
+    class MpscRing {
+    private:
+
+        struct Slot {
+            std::atomic<std::size_t> sequence;
+            T value;
+        };
+
+        std::size_t mask;
+        std::unique_ptr<Slot[]> slots;
+        alignas(64) std::atomic<std::size_t> tail{0};
+        alignas(64) std::size_t head = 0;
+
+    public:
+
+        /// @param capacity The number of slots, rounded up to a power of two.
+        explicit MpscRing(std::size_t capacity)
+                : mask(std::bit_ceil(capacity < 2 ? std::size_t{2} : capacity) - 1),
+                  slots(std::make_unique<Slot[]>(mask + 1)) {
+            for (std::size_t i = 0; i <= mask; ++i) {
+                slots[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        std::size_t capacity() const {
+            return mask + 1;
+        }
+
+        /// Appends a value. Safe to call from any number of threads.
+        /// @return The position the value was stored at, or SIZE_MAX if the ring is full.
+        std::size_t tryPush(const T &value) {
+            std::size_t position = tail.load(std::memory_order_relaxed);
+            while (true) {
+                Slot &slot = slots[position & mask];
+                const std::size_t sequence = slot.sequence.load(std::memory_order_acquire);
+                const auto difference = static_cast<std::ptrdiff_t>(sequence - position);
+                if (difference == 0) {
+                    if (tail.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                        slot.value = value;
+                        slot.sequence.store(position + 1, std::memory_order_seq_cst);
+                        return position;
+                    }
+                } else if (difference < 0) {
+                    return SIZE_MAX;
+                } else {
+                    position = tail.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /// Removes the oldest value. Must only be called from the single consumer thread.
+        /// @return `false` if the next value has not been published yet.
+        bool tryPop(T &value) {
+            Slot &slot = slots[head & mask];
+            if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+                return false;
+            }
+            value = std::move(slot.value);
+            slot.sequence.store(head + mask + 1, std::memory_order_release);
+            ++head;
+            return true;
+        }
+
+        /// Whether the oldest value has been published. Must only be called from the consumer thread.
+        bool ready() const {
+            return slots[head & mask].sequence.load(std::memory_order_seq_cst) == head + 1;
+        }
+
+        /// The number of positions claimed by producers so far.
+        std::size_t claimed() const {
+            return tail.load(std::memory_order_acquire);
+        }
+    };
+
+    constexpr std::size_t DefaultAsyncCapacity = 1U << 16U;
+
+    constexpr std::size_t DefaultAsyncBatch = 1U << 16U;
+
+/**
+ * @class AsyncIngest
+ * @brief Feeds a MagicalContainer from any number of producer threads through a background merge thread.
+ * While an AsyncIngest is alive it owns the container: the container must only be read through read() and
+ * must not be modified directly. The container itself is brought up to date when the AsyncIngest is destroyed.
+ */
+    class AsyncIngest {
+    private:
+
+        MagicalContainer &container;
+        MpscRing<int> ring;
+        std::size_t batchSize;
+
+        mutable std::mutex versionMutex;
+        std::shared_ptr<const MagicalContainer> current;
+        std::atomic<std::uint64_t> published{0};
+
+        std::atomic<std::size_t> applied{0};
+        std::mutex appliedMutex;
+        std::condition_variable appliedCondition;
+        std::exception_ptr error;
+
+        std::mutex promiseMutex;
+        std::map<std::size_t, std::promise<std::uint64_t>> promises;
+
+        std::atomic<bool> workerSleeping{false};
+        std::atomic<bool> stopping{false};
+        std::mutex wakeMutex;
+        std::condition_variable wakeCondition;
+        std::thread worker;
+
+        std::size_t enqueue(int value, std::unique_lock<std::mutex> *held = nullptr);
+
+        void wake();
+
+        std::shared_ptr<const MagicalContainer> snapshot() const;
+
+        void run();
+
+        void merge(std::vector<int> &batch);
+
+    public:
+
+        explicit AsyncIngest(MagicalContainer &container, std::size_t capacity = DefaultAsyncCapacity,
+                             std::size_t batchSize = DefaultAsyncBatch);
+
+        AsyncIngest(const AsyncIngest &) = delete;
+
+        AsyncIngest &operator=(const AsyncIngest &) = delete;
+
+        ~AsyncIngest();
+
+        void add(int value);
+
+        std::future<std::uint64_t> addAsync(int value);
+
+        void flush();
+
+        std::uint64_t version() const;
+
+/**
+ * @brief Runs a function on the latest published version of the container. Batches merged while it runs
+ * do not change the version it sees, and any number of threads may read at once.
+ * @param fn A function taking `const MagicalContainer &`.
+ * @return What fn returns.
+ */
+        template<typename Function>
+        decltype(auto) read(Function &&fn) const {
+            const std::shared_ptr<const MagicalContainer> version = snapshot();
+            return std::forward<Function>(fn)(*version);
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_ASYNCINGEST_HPP
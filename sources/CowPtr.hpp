@@ -0,0 +1,82 @@
+/**
+ * @file CowPtr.hpp
+ * @class CowPtr
+ * @brief A copy-on-write handle to a value of type T.
+ * Copying a handle shares the value, so it costs one reference-count increment whatever the size of the
+ * value. Reads go through operator-> and operator*, which only give const access; write() gives mutable
+ * access and first replaces a shared value with a private copy made by T's copy constructor, so a change
+ * through one handle is never seen through another. A default-constructed or moved-from handle refers to
+ * one shared, default-constructed T, which is copied on the first write like any other shared value.
+ */
+
+#ifndef MAGICAL_ITERATORS_COWPTR_HPP
+#define MAGICAL_ITERATORS_COWPTR_HPP
+
+#include <memory>
+#include <utility>
+
+namespace ariel {
+
+    template<typename T>
+    class CowPtr {
+    private:
+
+        std::shared_ptr<T> pointer;
+
+        static const std::shared_ptr<T> &empty() {
+            static const std::shared_ptr<T> instance = std::make_shared<T>();
+            return instance;
+        }
+
+    public:
+
+        CowPtr() : pointer(empty()) {}
+
+        explicit CowPtr(T value) : pointer(std::make_shared<T>(std::move(value))) {}
+
+        CowPtr(const CowPtr &other) = default;
+
+        CowPtr &operator=(const CowPtr &other) = default;
+
+        CowPtr(CowPtr &&other) noexcept: pointer(std::exchange(other.pointer, empty())) {}
+
+        CowPtr &operator=(CowPtr &&other) noexcept {
+            if (this != &other) {
+                pointer = std::exchange(other.pointer, empty());
+            }
+            return *this;
+        }
+
+        ~CowPtr() = default;
+
+        const T &operator*() const {
+            return *pointer;
+        }
+
+        const T *operator->() const {
+            return pointer.get();
+        }
+
+        /// Get mutable access to the value, copying it first if another handle shares it.
+        T &write() {
+            if (pointer.use_count() > 1) {
+                pointer = std::make_shared<T>(*pointer);
+            }
+            return *pointer;
+        }
+
+        /// Replace the value with a new, default-constructed one without copying the old one.
+        T &reset() {
+            pointer = std::make_shared<T>();
+            return *pointer;
+        }
+
+        /// Check whether another handle refers to the same value.
+        bool isShared() const {
+            return pointer.use_count() > 1;
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_COWPTR_HPP
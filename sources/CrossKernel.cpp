@@ -0,0 +1,65 @@
+//
+// Side-cross interleave kernel for sorted spans.
+//
+
+#include "CrossKernel.hpp"
+
+namespace ariel {
+
+    namespace {
+
+        /// The index into the sorted values of a side-cross position.
+        std::size_t crossIndex(std::size_t count, std::size_t position) {
+            return position % 2 == 0 ? position / 2 : count - 1 - position / 2;
+        }
+
+    }
+
+/**
+ * @brief Writes the side-cross positions [first, first + out.size()) of sorted values into out.
+ * @param sorted The values in ascending order.
+ * @param first The first position, with first + out.size() at most sorted.size().
+ * @param out The output, one value per position.
+ */
+    void interleaveCross(std::span<const int> sorted, std::size_t first, std::span<int> out) {
+        if (out.empty()) {
+            // Nothing to write, and sorted may be empty, so its back pointer must not be formed.
+            return;
+        }
+        const std::size_t count = sorted.size();
+        const std::size_t end = first + out.size();
+        std::size_t position = first;
+        int *target = out.data();
+        if (position % 2 == 1 && position < end) {
+            *target++ = sorted[crossIndex(count, position++)];
+        }
+
+        const std::size_t pairs = (end - position) / 2;
+        const int *front = sorted.data() + position / 2;
+        const int *back = sorted.data() + (count - 1 - position / 2);
+        std::size_t pair = 0;
+        for (; pair + CrossLanes <= pairs; pair += CrossLanes) {
+            int frontLanes[CrossLanes];
+            int backLanes[CrossLanes];
+            for (std::size_t lane = 0; lane < CrossLanes; ++lane) {
+                frontLanes[lane] = front[pair + lane];
+                backLanes[lane] = *(back - (pair + lane));
+            }
+            int *block = target + 2 * pair;
+            for (std::size_t lane = 0; lane < CrossLanes; ++lane) {
+                block[2 * lane] = frontLanes[lane];
+                block[2 * lane + 1] = backLanes[lane];
+            }
+        }
+        for (; pair < pairs; ++pair) {
+            target[2 * pair] = front[pair];
+            target[2 * pair + 1] = *(back - pair);
+        }
+
+        position += 2 * pairs;
+        if (position < end) {
+            target[2 * pairs] = sorted[crossIndex(count, position)];
+        }
+    }
+
+}
@@ -0,0 +1,25 @@
+/**
+ * @file CrossKernel.hpp
+ * @brief Gathers the side-cross order (smallest, largest, second smallest, ...) of sorted values into an array.
+ * Every pair of side-cross positions takes one value from a front stream that walks the sorted values forward
+ * and one from a back stream that walks them backward. The kernel loads CrossLanes values from each stream,
+ * reversing the back block, and stores the two blocks interleaved, all in straight-line lane loops the
+ * compiler can turn into vector loads, a lane reversal and unpacks. Only an odd first position and an odd
+ * last position are handled one value at a time.
+ */
+
+#ifndef MAGICAL_ITERATORS_CROSSKERNEL_HPP
+#define MAGICAL_ITERATORS_CROSSKERNEL_HPP
+
+#include <cstddef>
+#include <span>
+
+namespace ariel {
+
+    constexpr std::size_t CrossLanes = 8;
+
+    void interleaveCross(std::span<const int> sorted, std::size_t first, std::span<int> out);
+
+}
+
+#endif //MAGICAL_ITERATORS_CROSSKERNEL_HPP
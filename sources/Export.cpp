@@ -0,0 +1,199 @@
+//
+// Bulk text output of integers.
+//
+
+#include "Export.hpp"
+#include "MagicalContainer.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace ariel {
+
+/**
+ * @brief Constructs a writer that formats into a caller-provided buffer.
+ * @param fd The file descriptor the buffer is flushed to. It is not closed by the writer.
+ * @param buffer The buffer to format into, which must outlive the writer.
+ * @param separator The character written after every value.
+ * @throws std::runtime_error if the buffer cannot hold a single formatted value.
+ */
+    IntegerWriter::IntegerWriter(int fd, std::span<char> buffer, char separator)
+            : buffer(buffer), fd(fd), separator(separator) {
+        if (buffer.size() < MaxValueChars) {
+            throw std::runtime_error("Error: Output buffer is too small");
+        }
+    }
+
+/**
+ * @brief Constructs a writer that formats into a buffer of its own.
+ * @param fd The file descriptor the buffer is flushed to. It is not closed by the writer.
+ * @param bufferBytes The size of the buffer.
+ * @param separator The character written after every value.
+ * @throws std::runtime_error if the buffer cannot hold a single formatted value.
+ */
+    IntegerWriter::IntegerWriter(int fd, std::size_t bufferBytes, char separator)
+            : owned(bufferBytes), buffer(owned), fd(fd), separator(separator) {
+        if (buffer.size() < MaxValueChars) {
+            throw std::runtime_error("Error: Output buffer is too small");
+        }
+    }
+
+/**
+ * @brief Flushes what is left in the buffer. Errors are ignored here; call flush() to observe them.
+ */
+    IntegerWriter::~IntegerWriter() {
+        try {
+            flush();
+        } catch (const std::runtime_error &) {
+        }
+    }
+
+/**
+ * @brief Formats a value followed by the separator, flushing the buffer first if it is nearly full.
+ * @param value The value to write.
+ * @throws std::runtime_error if flushing fails.
+ */
+    void IntegerWriter::write(int value) {
+        if (buffer.size() - used < MaxValueChars) {
+            flush();
+        }
+        char *first = buffer.data() + used;
+        char *last = std::to_chars(first, buffer.data() + buffer.size(), value).ptr;
+        *last++ = separator;
+        used += static_cast<std::size_t>(last - first);
+    }
+
+/**
+ * @brief Writes the buffered characters to the file descriptor.
+ * @throws std::runtime_error if write(2) fails.
+ */
+    void IntegerWriter::flush() {
+        const char *data = buffer.data();
+        while (used > 0) {
+            ssize_t count = ::write(fd, data, used);
+            if (count < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                used = 0;
+                throw std::runtime_error("Error: Failed to write output");
+            }
+            data += count;
+            used -= static_cast<std::size_t>(count);
+            written += static_cast<std::size_t>(count);
+        }
+    }
+
+/**
+ * @brief Get the amount of output produced so far.
+ * @return The number of characters formatted, whether already flushed or still buffered.
+ */
+    std::size_t IntegerWriter::bytesWritten() const {
+        return written + used;
+    }
+
+/**
+ * @brief Writes the elements in ascending order and flushes the writer.
+ * @param writer The writer to format into.
+ * @return The number of values written.
+ * @throws std::runtime_error if writing fails.
+ */
+    std::size_t MagicalContainer::writeAscending(IntegerWriter &writer) const {
+        switch (this->storage) {
+            case Storage::Vector:
+                for (int element: this->core->elements) {
+                    writer.write(element);
+                }
+                break;
+            case Storage::Bitmap:
+                this->bitmap.forEach([&writer](int element) {
+                    writer.write(element);
+                });
+                break;
+            case Storage::Frozen:
+            case Storage::Mapped:
+                for (int i = 0; i < size(); ++i) {
+                    writer.write(ascendingAt(i));
+                }
+                break;
+        }
+        writer.flush();
+        return static_cast<std::size_t>(size());
+    }
+
+/**
+ * @brief Writes the elements in side-cross order (smallest, largest, second smallest, ...) and flushes the writer.
+ * @param writer The writer to format into.
+ * @return The number of values written.
+ * @throws std::runtime_error if writing fails.
+ */
+    std::size_t MagicalContainer::writeSideCross(IntegerWriter &writer) const {
+        const int count = size();
+        if (this->storage == Storage::Vector) {
+            const int *values = this->core->elements.data();
+            for (int low = 0, high = count - 1; low <= high; ++low, --high) {
+                writer.write(values[low]);
+                if (low != high) {
+                    writer.write(values[high]);
+                }
+            }
+        } else if (this->storage == Storage::Bitmap) {
+            // select() per position would restart its search every time, so decode the bitmap once.
+            const std::vector<int> values = this->bitmap.toVector();
+            for (int low = 0, high = count - 1; low <= high; ++low, --high) {
+                writer.write(values[static_cast<std::size_t>(low)]);
+                if (low != high) {
+                    writer.write(values[static_cast<std::size_t>(high)]);
+                }
+            }
+        } else {
+            for (int low = 0, high = count - 1; low <= high; ++low, --high) {
+                writer.write(crossAt(low));
+                if (low != high) {
+                    writer.write(crossAt(high));
+                }
+            }
+        }
+        writer.flush();
+        return static_cast<std::size_t>(count);
+    }
+
+/**
+ * @brief Writes the prime elements in ascending order and flushes the writer.
+ * @param writer The writer to format into.
+ * @return The number of values written.
+ * @throws std::runtime_error if writing fails.
+ */
+    std::size_t MagicalContainer::writePrimes(IntegerWriter &writer) const {
+        switch (this->storage) {
+            case Storage::Vector:
+                if (this->lazyViews) {
+                    for (int prime: primes()) {
+                        writer.write(prime);
+                    }
+                    break;
+                }
+                for (const int *prime: this->core->PrimeIter) {
+                    writer.write(*prime);
+                }
+                break;
+            case Storage::Bitmap:
+                primeView().forEach([&writer](int prime) {
+                    writer.write(prime);
+                });
+                break;
+            case Storage::Frozen:
+            case Storage::Mapped:
+                for (int i = 0; i < primeCount(); ++i) {
+                    writer.write(primeAt(i));
+                }
+                break;
+        }
+        writer.flush();
+        return static_cast<std::size_t>(primeCount());
+    }
+
+}
@@ -0,0 +1,56 @@
+/**
+ * @file Export.hpp
+ * @class IntegerWriter
+ * @brief Bulk text output of integers.
+ * Values are formatted with std::to_chars straight into a large char buffer, which is flushed to a file
+ * descriptor with write(2) whenever it cannot hold another value. This avoids the per-value locale,
+ * sentry and virtual-call overhead of `std::ostream << int`. The buffer may be owned by the writer or
+ * provided by the caller, so that it can be reused across exports.
+ */
+
+#ifndef MAGICAL_ITERATORS_EXPORT_HPP
+#define MAGICAL_ITERATORS_EXPORT_HPP
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace ariel {
+
+    constexpr std::size_t DefaultExportBufferBytes = 1U << 20U;
+
+    class IntegerWriter {
+    private:
+
+        /// The longest formatted int, "-2147483648", followed by one separator.
+        static constexpr std::size_t MaxValueChars = 12;
+
+        std::vector<char> owned;
+        std::span<char> buffer;
+        std::size_t used = 0;
+        std::size_t written = 0;
+        int fd;
+        char separator;
+
+    public:
+
+        IntegerWriter(int fd, std::span<char> buffer, char separator = ' ');
+
+        explicit IntegerWriter(int fd, std::size_t bufferBytes = DefaultExportBufferBytes, char separator = ' ');
+
+        IntegerWriter(const IntegerWriter &) = delete;
+
+        IntegerWriter &operator=(const IntegerWriter &) = delete;
+
+        ~IntegerWriter();
+
+        void write(int value);
+
+        void flush();
+
+        std::size_t bytesWritten() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_EXPORT_HPP
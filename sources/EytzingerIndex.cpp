@@ -0,0 +1,75 @@
+//
+// Eytzinger layout search index.
+//
+
+#include "EytzingerIndex.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace ariel {
+
+/**
+ * @brief Recursively places the sorted keys into the BFS layout with an in-order walk of the implicit tree.
+ * @param sorted The sorted source array.
+ * @param next The index of the next sorted key to place.
+ * @param node The 1-based node of the implicit tree being filled.
+ * @return The index of the next sorted key that has not been placed yet.
+ */
+    std::size_t EytzingerIndex::fill(const int *sorted, std::size_t next, std::size_t node) {
+        if (node < keys.size()) {
+            next = fill(sorted, next, 2 * node);
+            keys[node] = sorted[next];
+            ranks[node] = static_cast<int>(next);
+            ++next;
+            next = fill(sorted, next, 2 * node + 1);
+        }
+        return next;
+    }
+
+/**
+ * @brief Builds the index from a sorted array.
+ * @param sorted Pointer to the first element of the sorted array.
+ * @param count The number of elements in the array.
+ */
+    void EytzingerIndex::build(const int *sorted, std::size_t count) {
+        keys.assign(count + 1, 0);
+        ranks.assign(count + 1, 0);
+        fill(sorted, 0, 1);
+    }
+
+/**
+ * @brief Finds the position of the first key that is not less than the given key.
+ * The search is branchless; the node four levels below the current one is prefetched on every step,
+ * since sixteen consecutive BFS nodes share one cache line.
+ * @param key The key to search for.
+ * @return The rank of the first key >= key in the sorted source, or the number of keys if there is none.
+ */
+    std::size_t EytzingerIndex::lowerBound(int key) const {
+        if (keys.size() <= 1) {
+            return 0;
+        }
+        const std::size_t count = keys.size() - 1;
+        std::size_t node = 1;
+        while (node <= count) {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(keys.data() + std::min(node * 16, count));
+#endif
+            node = 2 * node + static_cast<std::size_t>(keys[node] < key);
+        }
+        node >>= std::countr_one(node) + 1;
+        if (node == 0) {
+            return count;
+        }
+        return static_cast<std::size_t>(ranks[node]);
+    }
+
+/**
+ * @brief Get the memory used by the index.
+ * @return The capacity of the keys and their ranks, in bytes.
+ */
+    std::size_t EytzingerIndex::memoryBytes() const {
+        return (keys.capacity() + ranks.capacity()) * sizeof(int);
+    }
+
+}
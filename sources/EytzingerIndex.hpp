@@ -0,0 +1,38 @@
+/**
+ * @file EytzingerIndex.hpp
+ * @class EytzingerIndex
+ * @brief A read-optimized search index over a sorted array of integers.
+ * The keys are stored in Eytzinger (BFS) order, so the first levels of every search share the same
+ * few cache lines and the next levels can be prefetched while the current comparison is resolved.
+ * The index is a derived structure: it is built once from the sorted storage, and its owner drops it
+ * whenever that storage changes.
+ */
+
+#ifndef MAGICAL_ITERATORS_EYTZINGERINDEX_HPP
+#define MAGICAL_ITERATORS_EYTZINGERINDEX_HPP
+
+#include <cstddef>
+#include <vector>
+
+namespace ariel {
+
+    class EytzingerIndex {
+    private:
+
+        std::vector<int> keys;
+        std::vector<int> ranks;
+
+        std::size_t fill(const int *sorted, std::size_t next, std::size_t node);
+
+    public:
+
+        void build(const int *sorted, std::size_t count);
+
+        std::size_t lowerBound(int key) const;
+
+        std::size_t memoryBytes() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_EYTZINGERINDEX_HPP
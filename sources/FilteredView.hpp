@@ -0,0 +1,287 @@
+/**
+ * @file FilteredView.hpp
+ * @class FilteredView
+ * @brief An ascending view of the elements of a MagicalContainer that satisfy a compile-time predicate.
+ * The predicate is a stateless functor type, so every call to it is inlined into the view. Each view keeps
+ * its matches in one of three forms, picked at compile time from the predicate's selectivity hint (the
+ * expected fraction of matching elements) unless given explicitly:
+ * - Materialized: the positions of the matches, 32 bits per match, for rare matches.
+ * - Bitmap: one bit per element, for matches that are neither rare nor common.
+ * - Lazy: nothing; the iterator tests 64 elements at a time as it goes, for common matches.
+ * A view reads the container's storage in place, so the container must outlive it and must not change
+ * while it is used.
+ */
+
+#ifndef MAGICAL_ITERATORS_FILTEREDVIEW_HPP
+#define MAGICAL_ITERATORS_FILTEREDVIEW_HPP
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <span>
+#include <type_traits>
+#include <vector>
+#include "MagicalContainer.hpp"
+#include "PrimeKernel.hpp"
+
+namespace ariel {
+
+    enum class FilterStrategy {
+        Materialized, Bitmap, Lazy
+    };
+
+    /// Primes are materialized whatever their density, since the container already keeps their positions.
+    struct IsPrime {
+        static constexpr double selectivity = 0.05;
+        static constexpr FilterStrategy preferredStrategy = FilterStrategy::Materialized;
+
+        bool operator()(int element) const {
+            return isPrimeValue(element);
+        }
+    };
+
+    struct IsEven {
+        static constexpr double selectivity = 0.5;
+
+        bool operator()(int element) const {
+            return element % 2 == 0;
+        }
+    };
+
+    struct IsPerfectSquare {
+        static constexpr double selectivity = 0.001;
+
+        bool operator()(int element) const {
+            if (element < 0) {
+                return false;
+            }
+            auto root = static_cast<std::uint32_t>(std::sqrt(static_cast<double>(element)));
+            while (static_cast<std::uint64_t>(root) * root > static_cast<std::uint64_t>(element)) {
+                --root;
+            }
+            while (static_cast<std::uint64_t>(root + 1) * (root + 1) <= static_cast<std::uint64_t>(element)) {
+                ++root;
+            }
+            return static_cast<std::uint64_t>(root) * root == static_cast<std::uint64_t>(element);
+        }
+    };
+
+    template<int Low, int High>
+    struct InRange {
+        static constexpr double selectivity = 0.25;
+
+        bool operator()(int element) const {
+            return Low <= element && element <= High;
+        }
+    };
+
+/**
+ * @brief Picks the strategy for a predicate: its `preferredStrategy` member if it has one, otherwise from its
+ * `selectivity` member, or 0.5 if it has none. Positions cost 32 bits per match and a bitmap one bit per
+ * element, so positions are smaller below 1/32; from 1/2 on, a lazy scan rejects at most every other element
+ * and storing anything no longer pays off.
+ * @return The strategy FilteredView<Predicate> uses by default.
+ */
+    template<typename Predicate>
+    constexpr FilterStrategy defaultStrategy() {
+        if constexpr (requires { Predicate::preferredStrategy; }) {
+            return Predicate::preferredStrategy;
+        }
+        double selectivity = 0.5;
+        if constexpr (requires { Predicate::selectivity; }) {
+            selectivity = Predicate::selectivity;
+        }
+        if (selectivity <= 1.0 / 32) {
+            return FilterStrategy::Materialized;
+        }
+        return selectivity < 0.5 ? FilterStrategy::Bitmap : FilterStrategy::Lazy;
+    }
+
+    template<typename Predicate, FilterStrategy Strategy = defaultStrategy<Predicate>()>
+    class FilteredView {
+        static_assert(std::is_empty_v<Predicate> && std::is_default_constructible_v<Predicate>,
+                      "FilteredView needs a stateless predicate");
+
+    private:
+
+        std::vector<int> scratch;
+        std::span<const int> values;
+        std::vector<std::uint32_t> positions;
+        std::vector<std::uint64_t> bits;
+        std::size_t matches = 0;
+
+        /// The matches among the 64 elements starting at first, one bit each. The lazy strategy tests them here
+        /// without branching, so simple predicates vectorize.
+        std::uint64_t blockMask(std::size_t first) const {
+            if constexpr (Strategy == FilterStrategy::Bitmap) {
+                return bits[first / 64];
+            } else {
+                const Predicate predicate{};
+                const std::size_t length = std::min<std::size_t>(64, values.size() - first);
+                std::uint64_t mask = 0;
+                for (std::size_t lane = 0; lane < length; ++lane) {
+                    mask |= static_cast<std::uint64_t>(predicate(values[first + lane])) << lane;
+                }
+                return mask;
+            }
+        }
+
+        std::size_t blockEnd() const {
+            return primeBitmapWords(values.size()) * 64;
+        }
+
+    public:
+
+        /// Walks the positions of a materialized view, or the set bits of a bitmap or lazy view block by block.
+        class iterator {
+        private:
+
+            const FilteredView *view = nullptr;
+            std::size_t cursor = 0;
+            std::uint64_t remaining = 0;
+
+            friend class FilteredView;
+
+            iterator(const FilteredView *view, std::size_t cursor) : view(view), cursor(cursor) {
+                if constexpr (Strategy != FilterStrategy::Materialized) {
+                    if (cursor < view->blockEnd()) {
+                        remaining = view->blockMask(cursor);
+                        settle();
+                    }
+                }
+            }
+
+            /// Moves cursor to the next block with a match once the current one is exhausted.
+            void settle() {
+                while (remaining == 0) {
+                    cursor += 64;
+                    if (cursor >= view->blockEnd()) {
+                        cursor = view->blockEnd();
+                        return;
+                    }
+                    remaining = view->blockMask(cursor);
+                }
+            }
+
+        public:
+
+            using iterator_category = std::forward_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = int;
+            using reference = int;
+            using pointer = const int *;
+
+            iterator() = default;
+
+            int operator*() const {
+                if constexpr (Strategy == FilterStrategy::Materialized) {
+                    return view->values[view->positions[cursor]];
+                } else {
+                    return view->values[cursor + static_cast<std::size_t>(std::countr_zero(remaining))];
+                }
+            }
+
+            iterator &operator++() {
+                if constexpr (Strategy == FilterStrategy::Materialized) {
+                    ++cursor;
+                } else {
+                    remaining &= remaining - 1;
+                    settle();
+                }
+                return *this;
+            }
+
+            iterator operator++(int) {
+                iterator previous = *this;
+                ++*this;
+                return previous;
+            }
+
+            bool operator==(const iterator &other) const {
+                return view == other.view && cursor == other.cursor && remaining == other.remaining;
+            }
+
+            bool operator!=(const iterator &other) const {
+                return !(*this == other);
+            }
+        };
+
+/**
+ * @brief Builds the view. The prime predicate reuses what the container already knows: its prime view for
+ * the materialized strategy and the batch prime kernel for the bitmap one.
+ * @param container The container to filter.
+ */
+        explicit FilteredView(const MagicalContainer &container)
+                : values(container.viewValues(MagicalContainer::View::Ascending, scratch)) {
+            const Predicate predicate{};
+            if constexpr (Strategy == FilterStrategy::Materialized) {
+                if constexpr (std::is_same_v<Predicate, IsPrime>) {
+                    const std::vector<std::uint64_t> primes = container.primeFlags(values);
+                    for (std::size_t word = 0; word < primes.size(); ++word) {
+                        for (std::uint64_t remaining = primes[word]; remaining != 0; remaining &= remaining - 1) {
+                            positions.push_back(
+                                    static_cast<std::uint32_t>(word * 64 + static_cast<std::size_t>(std::countr_zero(remaining))));
+                        }
+                    }
+                } else {
+                    for (std::size_t i = 0; i < values.size(); ++i) {
+                        if (predicate(values[i])) {
+                            positions.push_back(static_cast<std::uint32_t>(i));
+                        }
+                    }
+                }
+                matches = positions.size();
+            } else if constexpr (Strategy == FilterStrategy::Bitmap) {
+                if constexpr (std::is_same_v<Predicate, IsPrime>) {
+                    bits = classifyPrimes(values);
+                } else {
+                    bits.assign(primeBitmapWords(values.size()), 0);
+                    for (std::size_t i = 0; i < values.size(); ++i) {
+                        bits[i / 64] |= static_cast<std::uint64_t>(predicate(values[i])) << (i % 64);
+                    }
+                }
+                for (std::uint64_t word: bits) {
+                    matches += static_cast<std::size_t>(std::popcount(word));
+                }
+            }
+        }
+
+        FilteredView(const FilteredView &) = delete;
+
+        FilteredView &operator=(const FilteredView &) = delete;
+
+        static constexpr FilterStrategy strategy() {
+            return Strategy;
+        }
+
+        iterator begin() const {
+            return iterator(this, 0);
+        }
+
+        iterator end() const {
+            if constexpr (Strategy == FilterStrategy::Materialized) {
+                return iterator(this, positions.size());
+            } else {
+                return iterator(this, blockEnd());
+            }
+        }
+
+/**
+ * @brief Get the number of matching elements. The lazy strategy counts them on every call.
+ * @return The number of elements the view visits.
+ */
+        std::size_t size() const {
+            if constexpr (Strategy == FilterStrategy::Lazy) {
+                return static_cast<std::size_t>(std::distance(begin(), end()));
+            } else {
+                return matches;
+            }
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_FILTEREDVIEW_HPP
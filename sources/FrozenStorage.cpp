@@ -0,0 +1,216 @@
+//
+// Block-compressed frozen storage.
+//
+
+#include "FrozenStorage.hpp"
+#include "LazyCache.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+namespace ariel {
+
+    namespace {
+
+        /// A block decoded by the calling thread, keyed by the stamp of the encoding it came from.
+        struct DecodedBlock {
+            std::uint64_t stamp = 0;
+            std::size_t block = SIZE_MAX;
+            std::array<int, FrozenStorage::BlockSize> values{};
+        };
+
+        struct DecodeCache {
+            std::array<DecodedBlock, 2> slots;
+            std::size_t lastSlot = 0;
+        };
+
+        thread_local DecodeCache decodeCache;
+
+    }
+
+/**
+ * @brief Compresses sorted, duplicate-free values into blocks of bit-packed gaps.
+ * @param sorted The values in ascending order.
+ * @return The compressed representation.
+ */
+    FrozenStorage FrozenStorage::compress(std::span<const int> sorted) {
+        FrozenStorage result;
+        result.count = sorted.size();
+        Encoding encoded;
+        encoded.blocks.reserve((sorted.size() + BlockSize - 1) / BlockSize);
+
+        std::array<std::uint32_t, BlockSize> gaps{};
+        for (std::size_t first = 0; first < sorted.size(); first += BlockSize) {
+            const std::size_t length = std::min(BlockSize, sorted.size() - first);
+            std::uint32_t widest = 0;
+            for (std::size_t i = 1; i < length; ++i) {
+                gaps[i - 1] = static_cast<std::uint32_t>(sorted[first + i]) -
+                              static_cast<std::uint32_t>(sorted[first + i - 1]) - 1U;
+                widest |= gaps[i - 1];
+            }
+
+            const auto width = static_cast<std::uint32_t>(std::bit_width(widest));
+            const auto offset = static_cast<std::uint32_t>(encoded.packed.size());
+            encoded.blocks.push_back(Block{sorted[first], offset, width});
+            encoded.packed.resize(offset + ((length - 1) * width + 31) / 32, 0);
+
+            for (std::size_t i = 0; i + 1 < length && width != 0; ++i) {
+                const std::size_t bit = i * width;
+                const auto shift = static_cast<std::uint32_t>(bit % 32);
+                encoded.packed[offset + bit / 32] |= gaps[i] << shift;
+                if (shift + width > 32) {
+                    encoded.packed[offset + bit / 32 + 1] |= gaps[i] >> (32 - shift);
+                }
+            }
+        }
+        // Two words of padding let the decoder always read a 64-bit window.
+        encoded.packed.resize(encoded.packed.size() + 2, 0);
+        encoded.packed.shrink_to_fit();
+        encoded.stamp = nextCacheStamp();
+        result.encoding = CowPtr<Encoding>(std::move(encoded));
+        return result;
+    }
+
+/**
+ * @brief Get the number of values in a block.
+ * @param block The block index.
+ * @return BlockSize for every block but the last one.
+ */
+    std::size_t FrozenStorage::blockLength(std::size_t block) const {
+        return std::min(BlockSize, count - block * BlockSize);
+    }
+
+/**
+ * @brief Get the decoded values of a block, decoding it into the calling thread's least recently used cache
+ * slot on a miss.
+ * @param block The block index.
+ * @return A pointer to the decoded values of the block, valid until the thread decodes two more blocks.
+ */
+    const int *FrozenStorage::decoded(std::size_t block) const {
+        DecodeCache &cache = decodeCache;
+        for (std::size_t slot = 0; slot < cache.slots.size(); ++slot) {
+            if (cache.slots[slot].stamp == encoding->stamp && cache.slots[slot].block == block) {
+                cache.lastSlot = slot;
+                return cache.slots[slot].values.data();
+            }
+        }
+        cache.lastSlot = 1 - cache.lastSlot;
+        DecodedBlock &target = cache.slots[cache.lastSlot];
+        decodeBlock(block, target.values.data());
+        target.stamp = encoding->stamp;
+        target.block = block;
+        return target.values.data();
+    }
+
+/**
+ * @brief Get the number of values in the storage.
+ * @return The number of values.
+ */
+    std::size_t FrozenStorage::size() const {
+        return count;
+    }
+
+/**
+ * @brief Get the number of compressed blocks.
+ * @return The number of blocks.
+ */
+    std::size_t FrozenStorage::blockCount() const {
+        return encoding->blocks.size();
+    }
+
+/**
+ * @brief Get the value at the given position, going through the skip index to its block.
+ * @param index The position of the value.
+ * @return The value at that position.
+ * @throws std::out_of_range if the index is out of range.
+ */
+    int FrozenStorage::at(std::size_t index) const {
+        if (index >= count) {
+            throw std::out_of_range("Error: Invalid index.");
+        }
+        return decoded(index / BlockSize)[index % BlockSize];
+    }
+
+/**
+ * @brief Find the position of the first value that is not less than the given one.
+ * The block is found by binary search over the first values of the skip index, and only that block is decoded.
+ * @param value The value to search for.
+ * @return The position of the first value >= value, or size() if there is none.
+ */
+    std::size_t FrozenStorage::lowerBound(int value) const {
+        const std::vector<Block> &blocks = encoding->blocks;
+        auto after = std::upper_bound(blocks.begin(), blocks.end(), value, [](int key, const Block &block) {
+            return key < block.first;
+        });
+        if (after == blocks.begin()) {
+            return 0;
+        }
+        const auto block = static_cast<std::size_t>(after - blocks.begin()) - 1;
+        const int *values = decoded(block);
+        const std::size_t length = blockLength(block);
+        return block * BlockSize + static_cast<std::size_t>(std::lower_bound(values, values + length, value) - values);
+    }
+
+/**
+ * @brief Check whether the storage holds a value.
+ * @param value The value to look for.
+ * @return `true` if the value is present.
+ */
+    bool FrozenStorage::contains(int value) const {
+        std::size_t index = lowerBound(value);
+        return index < count && at(index) == value;
+    }
+
+/**
+ * @brief Decodes a whole block into the caller's buffer.
+ * The gaps are first unpacked independently of each other (a fixed-width extraction per lane, which the
+ * compiler can vectorize) and only then summed into values.
+ * @param block The block index.
+ * @param out A buffer of at least BlockSize values.
+ * @return The number of values written.
+ */
+    std::size_t FrozenStorage::decodeBlock(std::size_t block, int *out) const {
+        const Block &header = encoding->blocks[block];
+        const std::size_t length = blockLength(block);
+        const std::uint32_t *words = encoding->packed.data() + header.offset;
+        const std::uint64_t mask = (header.width == 32) ? 0xFFFFFFFFULL : ((1ULL << header.width) - 1);
+
+        std::array<std::uint32_t, BlockSize> gaps{};
+        for (std::size_t i = 0; i + 1 < length; ++i) {
+            const std::size_t bit = i * header.width;
+            const std::uint64_t window = words[bit / 32] | (static_cast<std::uint64_t>(words[bit / 32 + 1]) << 32U);
+            gaps[i] = static_cast<std::uint32_t>((window >> (bit % 32)) & mask);
+        }
+
+        auto value = static_cast<std::uint32_t>(header.first);
+        out[0] = header.first;
+        for (std::size_t i = 1; i < length; ++i) {
+            value += gaps[i - 1] + 1U;
+            out[i] = static_cast<int>(value);
+        }
+        return length;
+    }
+
+/**
+ * @brief Decompresses the whole storage.
+ * @return The values in ascending order.
+ */
+    std::vector<int> FrozenStorage::toVector() const {
+        std::vector<int> values(count);
+        for (std::size_t block = 0; block < encoding->blocks.size(); ++block) {
+            decodeBlock(block, values.data() + block * BlockSize);
+        }
+        return values;
+    }
+
+/**
+ * @brief Get the memory used by the storage.
+ * @return The number of bytes used by the skip index and the packed gaps.
+ */
+    std::size_t FrozenStorage::memoryBytes() const {
+        return encoding->blocks.capacity() * sizeof(Block) + encoding->packed.capacity() * sizeof(std::uint32_t);
+    }
+
+}
@@ -0,0 +1,73 @@
+/**
+ * @file FrozenStorage.hpp
+ * @class FrozenStorage
+ * @brief A read-only, block-compressed representation of a sorted array of distinct integers.
+ * Values are grouped into blocks of 128. Each block keeps its first value in a skip index and stores
+ * the remaining gaps (minus one, since values are distinct) bit-packed with the smallest width that fits
+ * the block's largest gap. Random access decodes a single block; each thread caches the two blocks it
+ * decoded last, so that ascending and side-cross scans decode every block only once and several threads
+ * can read one storage at once. The skip index and the packed gaps never change once built, so copies of
+ * a storage share them.
+ */
+
+#ifndef MAGICAL_ITERATORS_FROZENSTORAGE_HPP
+#define MAGICAL_ITERATORS_FROZENSTORAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "CowPtr.hpp"
+
+namespace ariel {
+
+    class FrozenStorage {
+    public:
+
+        static constexpr std::size_t BlockSize = 128;
+
+    private:
+
+        struct Block {
+            int first;
+            std::uint32_t offset;
+            std::uint32_t width;
+        };
+
+        struct Encoding {
+            std::vector<Block> blocks;
+            std::vector<std::uint32_t> packed;
+            std::uint64_t stamp = 0;
+        };
+
+        CowPtr<Encoding> encoding;
+        std::size_t count = 0;
+
+        std::size_t blockLength(std::size_t block) const;
+
+        const int *decoded(std::size_t block) const;
+
+    public:
+
+        static FrozenStorage compress(std::span<const int> sorted);
+
+        std::size_t size() const;
+
+        std::size_t blockCount() const;
+
+        int at(std::size_t index) const;
+
+        std::size_t lowerBound(int value) const;
+
+        bool contains(int value) const;
+
+        std::size_t decodeBlock(std::size_t block, int *out) const;
+
+        std::vector<int> toVector() const;
+
+        std::size_t memoryBytes() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_FROZENSTORAGE_HPP
@@ -0,0 +1,143 @@
+/**
+ * @file Generator.hpp
+ * @class Generator
+ * @brief A minimal C++20 coroutine generator in the style of C++23 std::generator.
+ * A coroutine returning Generator<T> runs only as far as its next co_yield each time the caller advances the
+ * iterator, so a sequence is computed lazily and only as far as it is read. The generator owns its coroutine
+ * frame and destroys it when it goes out of scope, even if the sequence was not consumed to the end.
+ */
+
+#ifndef MAGICAL_ITERATORS_GENERATOR_HPP
+#define MAGICAL_ITERATORS_GENERATOR_HPP
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <utility>
+
+namespace ariel {
+
+    template<typename T>
+    class Generator {
+    public:
+
+        struct promise_type {
+            T current{};
+            std::exception_ptr error;
+
+            Generator get_return_object() {
+                return Generator(std::coroutine_handle<promise_type>::from_promise(*this));
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always final_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_always yield_value(T value) noexcept {
+                current = std::move(value);
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() {
+                error = std::current_exception();
+            }
+        };
+
+        using Handle = std::coroutine_handle<promise_type>;
+
+        class iterator {
+        private:
+
+            Handle handle;
+
+            void advance() {
+                handle.resume();
+                if (handle.done() && handle.promise().error) {
+                    std::rethrow_exception(handle.promise().error);
+                }
+            }
+
+            friend class Generator;
+
+            explicit iterator(Handle handle) : handle(handle) {
+                advance();
+            }
+
+        public:
+
+            using iterator_category = std::input_iterator_tag;
+            using difference_type = std::ptrdiff_t;
+            using value_type = T;
+            using reference = const T &;
+            using pointer = const T *;
+
+            iterator() = default;
+
+            reference operator*() const {
+                return handle.promise().current;
+            }
+
+            iterator &operator++() {
+                advance();
+                return *this;
+            }
+
+            void operator++(int) {
+                ++*this;
+            }
+
+            bool operator==(std::default_sentinel_t) const {
+                return !handle || handle.done();
+            }
+        };
+
+    private:
+
+        Handle handle;
+
+        explicit Generator(Handle handle) : handle(handle) {}
+
+    public:
+
+        Generator(Generator &&other) noexcept: handle(std::exchange(other.handle, nullptr)) {}
+
+        Generator &operator=(Generator &&other) noexcept {
+            if (this != &other) {
+                if (handle) {
+                    handle.destroy();
+                }
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        Generator(const Generator &) = delete;
+
+        Generator &operator=(const Generator &) = delete;
+
+        ~Generator() {
+            if (handle) {
+                handle.destroy();
+            }
+        }
+
+        /// Starts the sequence. A generator can only be iterated once.
+        iterator begin() {
+            return iterator(handle);
+        }
+
+        std::default_sentinel_t end() const noexcept {
+            return {};
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_GENERATOR_HPP
@@ -0,0 +1,200 @@
+//
+// Streaming ingest of integer text.
+//
+
+#include "Ingest.hpp"
+#include "MagicalContainer.hpp"
+
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::size_t MaxTokenLength = 32;
+
+        constexpr std::array<bool, 256> makeSeparators() {
+            std::array<bool, 256> separators{};
+            for (char separator: {'\n', '\r', ',', ' ', '\t'}) {
+                separators[static_cast<unsigned char>(separator)] = true;
+            }
+            return separators;
+        }
+
+        constexpr std::array<bool, 256> Separators = makeSeparators();
+
+        bool isSeparator(char c) {
+            return Separators[static_cast<unsigned char>(c)];
+        }
+
+    }
+
+/**
+ * @brief Get the ingest throughput.
+ * @return The number of bytes read per second, in GB/s.
+ */
+    double IngestStats::gigabytesPerSecond() const {
+        if (seconds <= 0) {
+            return 0;
+        }
+        return static_cast<double>(bytes) / seconds / 1e9;
+    }
+
+/**
+ * @brief Parses one complete token.
+ * @param first The first character of the token.
+ * @param last One past the last character of the token.
+ * @param out The vector the value is appended to.
+ * @throws std::runtime_error if the token is not an integer in the range of int.
+ */
+    void IntegerStreamParser::parseToken(const char *first, const char *last, std::vector<int> &out) {
+        int value = 0;
+        auto [end, error] = std::from_chars(first, last, value);
+        if (error != std::errc() || end != last) {
+            throw std::runtime_error("Error: Invalid integer in input: " + std::string(first, last));
+        }
+        out.push_back(value);
+    }
+
+/**
+ * @brief Parses every complete token of a chunk. A token that runs into the end of the chunk is kept until
+ * the next chunk or finish() completes it.
+ * @param chunk The next chunk of input.
+ * @param out The vector the parsed values are appended to.
+ * @throws std::runtime_error if a token is not an integer in the range of int.
+ */
+    void IntegerStreamParser::feed(std::string_view chunk, std::vector<int> &out) {
+        const char *position = chunk.data();
+        const char *const end = chunk.data() + chunk.size();
+
+        if (!carry.empty()) {
+            while (position != end && !isSeparator(*position)) {
+                carry.push_back(*position++);
+            }
+            if (carry.size() > MaxTokenLength) {
+                throw std::runtime_error("Error: Invalid integer in input: " + carry.substr(0, MaxTokenLength));
+            }
+            if (position == end) {
+                return;
+            }
+            parseToken(carry.data(), carry.data() + carry.size(), out);
+            carry.clear();
+        }
+
+        while (true) {
+            while (position != end && isSeparator(*position)) {
+                ++position;
+            }
+            const char *token = position;
+            while (position != end && !isSeparator(*position)) {
+                ++position;
+            }
+            if (position == end) {
+                carry.assign(token, end);
+                return;
+            }
+            parseToken(token, position, out);
+        }
+    }
+
+/**
+ * @brief Parses the token left over at the end of the input, if any.
+ * @param out The vector the parsed value is appended to.
+ * @throws std::runtime_error if the token is not an integer in the range of int.
+ */
+    void IntegerStreamParser::finish(std::vector<int> &out) {
+        if (!carry.empty()) {
+            parseToken(carry.data(), carry.data() + carry.size(), out);
+            carry.clear();
+        }
+    }
+
+/**
+ * @brief Adds every integer read from a file descriptor to the MagicalContainer.
+ * The descriptor is read until end of file in chunks of DefaultIngestChunkBytes, and parsed values are
+ * merged with addElements() whenever batchSize of them have accumulated, so the extra memory is bounded
+ * by one chunk and one batch. The descriptor is not closed.
+ * @param fd The file descriptor to read from.
+ * @param batchSize The number of values merged into the container at a time.
+ * @return The number of bytes and values read, and the time spent.
+ * @throws std::runtime_error if reading fails, the input holds a token that is not an integer, or the
+ * container is read-only.
+ */
+    IngestStats MagicalContainer::ingestFd(int fd, std::size_t batchSize) {
+        requireMutable();
+        const auto start = std::chrono::steady_clock::now();
+        IngestStats stats;
+        IntegerStreamParser parser;
+        std::vector<char> chunk(DefaultIngestChunkBytes);
+        std::vector<int> batch;
+        batch.reserve(batchSize + DefaultIngestChunkBytes / 2);
+
+        auto merge = [&] {
+            const auto mergeStart = std::chrono::steady_clock::now();
+            addElements(batch);
+            stats.values += batch.size();
+            ++stats.batches;
+            batch.clear();
+            stats.mergeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - mergeStart).count();
+        };
+
+        while (true) {
+            ssize_t bytes = ::read(fd, chunk.data(), chunk.size());
+            if (bytes < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                throw std::runtime_error("Error: Failed to read ingest input");
+            }
+            if (bytes == 0) {
+                break;
+            }
+            stats.bytes += static_cast<std::size_t>(bytes);
+            parser.feed(std::string_view(chunk.data(), static_cast<std::size_t>(bytes)), batch);
+            if (batch.size() >= batchSize) {
+                merge();
+            }
+        }
+        parser.finish(batch);
+        if (!batch.empty()) {
+            merge();
+        }
+
+        stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        return stats;
+    }
+
+/**
+ * @brief Adds every integer in a text file to the MagicalContainer.
+ * @param path The path of the file, holding integers separated by newlines, commas, spaces or tabs.
+ * @param batchSize The number of values merged into the container at a time.
+ * @return The number of bytes and values read, and the time spent.
+ * @throws std::runtime_error if the file cannot be read, holds a token that is not an integer, or the
+ * container is read-only.
+ */
+    IngestStats MagicalContainer::ingestFile(const std::string &path, std::size_t batchSize) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Error: Failed to open ingest file " + path);
+        }
+#ifdef POSIX_FADV_SEQUENTIAL
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+        try {
+            IngestStats stats = ingestFd(fd, batchSize);
+            ::close(fd);
+            return stats;
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+    }
+
+}
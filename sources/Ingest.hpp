@@ -0,0 +1,57 @@
+/**
+ * @file Ingest.hpp
+ * @brief Streaming ingest of integer text into a MagicalContainer.
+ * Input is read from a file descriptor in large chunks and split on newlines, commas, spaces and tabs.
+ * Tokens are parsed with std::from_chars, collected into a bounded batch and merged into the container one
+ * batch at a time, so memory stays bounded by the batch and chunk sizes however large the input is.
+ */
+
+#ifndef MAGICAL_ITERATORS_INGEST_HPP
+#define MAGICAL_ITERATORS_INGEST_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace ariel {
+
+/**
+ * @struct IngestStats
+ * @brief What one ingest call read and how long it took.
+ */
+    struct IngestStats {
+        std::size_t bytes = 0;
+        std::size_t values = 0;
+        std::size_t batches = 0;
+        double seconds = 0;
+        double mergeSeconds = 0;
+
+        double gigabytesPerSecond() const;
+    };
+
+/**
+ * @class IntegerStreamParser
+ * @brief Parses separated integers from a sequence of chunks, carrying a token that is split between chunks.
+ */
+    class IntegerStreamParser {
+    private:
+
+        std::string carry;
+
+        static void parseToken(const char *first, const char *last, std::vector<int> &out);
+
+    public:
+
+        void feed(std::string_view chunk, std::vector<int> &out);
+
+        void finish(std::vector<int> &out);
+    };
+
+    constexpr std::size_t DefaultIngestChunkBytes = 1U << 20U;
+
+    constexpr std::size_t DefaultIngestBatch = 1U << 22U;
+
+}
+
+#endif //MAGICAL_ITERATORS_INGEST_HPP
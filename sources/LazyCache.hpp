@@ -0,0 +1,122 @@
+/**
+ * @file LazyCache.hpp
+ * @class LazyCache
+ * @brief A structure derived from its owner's state, built by the first const query that needs it.
+ * get() builds the value at most once, under a mutex, and publishes it through an atomic pointer, so any
+ * number of threads may query the owner at once; after that a read costs one acquire load. A published value
+ * is never changed in place: copying a cache shares it, and modify() hands a writer a private copy first.
+ * set(), modify() and clear() belong to the owner's mutating operations, which must not run concurrently with
+ * its queries.
+ */
+
+#ifndef MAGICAL_ITERATORS_LAZYCACHE_HPP
+#define MAGICAL_ITERATORS_LAZYCACHE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+namespace ariel {
+
+    template<typename T>
+    class LazyCache {
+    private:
+
+        mutable std::mutex mutex;
+        mutable std::shared_ptr<T> value;
+        mutable std::atomic<const T *> published{nullptr};
+
+        std::shared_ptr<T> share() const {
+            std::lock_guard<std::mutex> lock(mutex);
+            return value;
+        }
+
+        void publish(std::shared_ptr<T> shared) {
+            value = std::move(shared);
+            published.store(value.get(), std::memory_order_release);
+        }
+
+    public:
+
+        LazyCache() = default;
+
+        LazyCache(const LazyCache &other) {
+            publish(other.share());
+        }
+
+        LazyCache(LazyCache &&other) noexcept {
+            publish(std::exchange(other.value, nullptr));
+            other.published.store(nullptr, std::memory_order_relaxed);
+        }
+
+        LazyCache &operator=(const LazyCache &other) {
+            if (this != &other) {
+                publish(other.share());
+            }
+            return *this;
+        }
+
+        LazyCache &operator=(LazyCache &&other) noexcept {
+            if (this != &other) {
+                publish(std::exchange(other.value, nullptr));
+                other.published.store(nullptr, std::memory_order_relaxed);
+            }
+            return *this;
+        }
+
+        ~LazyCache() = default;
+
+        /// Get the value, building it with build() if this is the first query since it was cleared.
+        template<typename Build>
+        const T &get(Build &&build) const {
+            if (const T *built = published.load(std::memory_order_acquire)) {
+                return *built;
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!value) {
+                value = std::make_shared<T>(std::forward<Build>(build)());
+                published.store(value.get(), std::memory_order_release);
+            }
+            return *value;
+        }
+
+        /// Get the value if it is built, without building it.
+        const T *find() const {
+            return published.load(std::memory_order_acquire);
+        }
+
+        /// Replace the value with one the writer already has.
+        void set(T built) {
+            publish(std::make_shared<T>(std::move(built)));
+        }
+
+        /// Get mutable access to a built value, copying it first if a copy of the cache shares it.
+        /// @return The value, or nullptr if it is not built.
+        T *modify() {
+            if (value && value.use_count() > 1) {
+                publish(std::make_shared<T>(std::as_const(*value)));
+            }
+            return value.get();
+        }
+
+        /// Drop the value; the next get() builds it again.
+        void clear() {
+            publish(nullptr);
+        }
+    };
+
+/**
+ * @brief Get a number that no earlier call returned, to key per-thread caches by the structure they cache.
+ * Unlike an address, a stamp is never reused by a later structure.
+ * @return A fresh, non-zero stamp.
+ */
+    inline std::uint64_t nextCacheStamp() {
+        static std::atomic<std::uint64_t> stamps{0};
+        return stamps.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+}
+
+#endif //MAGICAL_ITERATORS_LAZYCACHE_HPP
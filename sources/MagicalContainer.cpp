@@ -3,6 +3,12 @@
 //
 
 #include "MagicalContainer.hpp"
+#include "CrossKernel.hpp"
+#include "PrimeKernel.hpp"
+
+#include <bit>
+#include <iterator>
+#include <limits>
 
 
 namespace ariel {
@@ -12,103 +18,1562 @@ namespace ariel {
  * @return `true` if the number is prime, `false` otherwise.
  */
     bool MagicalContainer::isPrime(int num) const {
-        if (num < 2)
-            return false;
+        MAGICAL_STATS_TIME(this->statistics, IsPrime);
+        MAGICAL_STATS_COUNT(this->statistics, primalityTests, 1U);
+        return isPrimeValue(num);
+    }
+
+/**
+ * @brief Constructs an empty core whose elements and views are allocated under a page policy.
+ * @param policy The page policy.
+ */
+    MagicalContainer::VectorCore::VectorCore(const PagePolicy &policy)
+            : elements(PageAllocator<int>(policy)), PrimeIter(PageAllocator<int *>(policy)),
+              AscendingIter(PageAllocator<int *>(policy)), CrossSideIter(PageAllocator<int *>(policy)) {}
+
+/**
+ * @brief Copies a core for a container about to change it. The pointer views are rebased from the source's
+ * elements onto the copy's, so the copy never points into a buffer it does not own.
+ * @param other The core to copy.
+ */
+    MagicalContainer::VectorCore::VectorCore(const VectorCore &other) : elements(other.elements) {
+        auto rebase = [&](const ViewArray &view) {
+            ViewArray rebased(view.get_allocator());
+            rebased.reserve(view.size());
+            for (const int *element: view) {
+                rebased.push_back(elements.data() + (element - other.elements.data()));
+            }
+            return rebased;
+        };
+        PrimeIter = rebase(other.PrimeIter);
+        AscendingIter = rebase(other.AscendingIter);
+        CrossSideIter = rebase(other.CrossSideIter);
+    }
+
+/**
+ * @brief Moves the elements to a new buffer with room for exactly capacity elements and rebases the pointer
+ * views onto it.
+ * @param capacity The capacity of the new buffer; at least the number of elements.
+ */
+    void MagicalContainer::VectorCore::relocate(std::size_t capacity) {
+        ElementArray moved(elements.get_allocator());
+        moved.reserve(capacity);
+        moved.assign(elements.begin(), elements.end());
+        for (ViewArray *view: {&PrimeIter, &AscendingIter, &CrossSideIter}) {
+            for (int *&element: *view) {
+                element = moved.data() + (element - elements.data());
+            }
+        }
+        elements.swap(moved);
+    }
+
+/**
+ * @brief Releases the slack capacity of the elements and the views.
+ */
+    void MagicalContainer::VectorCore::shrinkToFit() {
+        if (elements.capacity() != elements.size()) {
+            relocate(elements.size());
+        }
+        PrimeIter.shrink_to_fit();
+        AscendingIter.shrink_to_fit();
+        CrossSideIter.shrink_to_fit();
+    }
+
+/**
+ * @brief Constructs a memo in which no block is classified yet.
+ * @param blocks The number of 64-element blocks.
+ */
+    MagicalContainer::PrimeMemo::PrimeMemo(std::size_t blocks) : words(blocks), known(blocks) {}
+
+/**
+ * @brief Constructs a memo in which every block is already classified.
+ * @param flags One bit per element, set for the primes.
+ */
+    MagicalContainer::PrimeMemo::PrimeMemo(const std::vector<std::uint64_t> &flags)
+            : words(flags.size()), known(flags.size()) {
+        for (std::size_t block = 0; block < flags.size(); ++block) {
+            words[block].store(flags[block], std::memory_order_relaxed);
+            known[block].store(1, std::memory_order_relaxed);
+        }
+    }
+
+/**
+ * @brief Makes values the sorted elements of the vector backend, reusing the room of the current elements
+ * when they fit, which keeps the capacity given by reserve(). A core shared with another container is left to
+ * it and replaced by a new one under the container's page policy, instead of being copied only to be
+ * overwritten. The views must be rebuilt afterwards.
+ * @param values The new elements.
+ */
+    void MagicalContainer::adoptElements(std::span<const int> values) {
+        if (this->core.isShared()) {
+            this->core = CowPtr<VectorCore>(VectorCore(this->pagePolicy));
+        }
+        this->core.write().elements.assign(values.begin(), values.end());
+    }
+
+/**
+ * @brief Rebuilds the pointer views over the sorted storage.
+ * Must be called after every change to `elements`, since a change may reallocate the vector and
+ * invalidate the pointers kept by the views. Primality of the whole storage is classified in one batch
+ * and the prime view is filled from the resulting bitmap. The search and aggregate indexes are invalidated
+ * as well and rebuilt lazily by the next query that uses them.
+ */
+    void MagicalContainer::rebuildViews() {
+        if (this->lazyViews) {
+            this->primeMemo.clear();
+            this->lazyPrimePositions.clear();
+            this->searchIndex.clear();
+            this->aggregateIndex.clear();
+            MAGICAL_STATS_FOOTPRINT(this->statistics, storageBytes());
+            return;
+        }
+        MAGICAL_STATS_COUNT(this->statistics, primalityTests, this->core->elements.size());
+        rebuildViews(classifyPrimes(this->core->elements));
+    }
+
+/**
+ * @brief Rebuilds the pointer views over the sorted storage from an already known primality bitmap.
+ * @param primes One bit per element of the storage, set for the primes.
+ */
+    void MagicalContainer::rebuildViews(const std::vector<std::uint64_t> &primes) {
+        MAGICAL_STATS_TIME(this->statistics, RebuildViews);
+        MAGICAL_STATS_COUNT(this->statistics, viewRebuilds, 1U);
+        VectorCore &writable = this->core.write();
+        writable.PrimeIter.clear();
+        writable.AscendingIter.clear();
+        writable.CrossSideIter.clear();
+        // The views follow the capacity of the elements, so they are reallocated only when the elements are.
+        writable.AscendingIter.reserve(writable.elements.capacity());
+        writable.CrossSideIter.reserve(writable.elements.capacity());
+
+        for (int &element: writable.elements) {
+            writable.AscendingIter.emplace_back(&element);
+            writable.CrossSideIter.emplace_back(&element);
+        }
+
+        for (std::size_t word = 0; word < primes.size(); ++word) {
+            for (std::uint64_t bits = primes[word]; bits != 0; bits &= bits - 1) {
+                auto bit = static_cast<std::size_t>(std::countr_zero(bits));
+                writable.PrimeIter.emplace_back(&writable.elements[word * 64 + bit]);
+            }
+        }
+
+        this->searchIndex.clear();
+        this->aggregateIndex.clear();
+        MAGICAL_STATS_FOOTPRINT(this->statistics, storageBytes());
+    }
+
+/**
+ * @brief Get the prime values of a bitmap-backed container, computing them on first use.
+ * @return The bitmap of the prime values in `bitmap`.
+ */
+    const RoaringBitmap &MagicalContainer::primeView() const {
+        return this->primeBitmap.get([&] {
+            return this->bitmap.primes();
+        });
+    }
+
+/**
+ * @brief Get the element at the given position of the ascending order.
+ * @param index The position, assumed to be in range.
+ * @return The element at that position.
+ */
+    int MagicalContainer::ascendingAt(int index) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return this->bitmap.select(static_cast<std::size_t>(index));
+            case Storage::Frozen:
+                return this->frozen.at(static_cast<std::size_t>(index));
+            case Storage::Mapped:
+                return this->snapshot.elements()[static_cast<std::size_t>(index)];
+            case Storage::Vector:
+                break;
+        }
+        if (this->lazyViews) {
+            return this->core->elements[static_cast<std::size_t>(index)];
+        }
+        return *(this->core->AscendingIter[static_cast<std::vector<int *>::size_type>(index)]);
+    }
+
+/**
+ * @brief Get the element at the given position of the descending order.
+ * The vector backend reads its sorted storage from the back directly; the others go through ascendingAt().
+ * @param index The position, assumed to be in range.
+ * @return The element at that position.
+ */
+    int MagicalContainer::descendingAt(int index) const {
+        const int ascending = size() - 1 - index;
+        if (this->storage == Storage::Vector) {
+            return this->core->elements[static_cast<std::size_t>(ascending)];
+        }
+        return ascendingAt(ascending);
+    }
+
+/**
+ * @brief Get the element that the side-cross order visits at the given element index.
+ * @param index The element index, assumed to be in range.
+ * @return The element at that index.
+ */
+    int MagicalContainer::crossAt(int index) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return this->bitmap.select(static_cast<std::size_t>(index));
+            case Storage::Frozen:
+                return this->frozen.at(static_cast<std::size_t>(index));
+            case Storage::Mapped:
+                return this->snapshot.elements()[static_cast<std::size_t>(index)];
+            case Storage::Vector:
+                break;
+        }
+        if (this->lazyViews) {
+            return this->core->elements[static_cast<std::size_t>(index)];
+        }
+        return *(this->core->CrossSideIter[static_cast<std::vector<int *>::size_type>(index)]);
+    }
+
+/**
+ * @brief Get the prime element at the given position of the prime order.
+ * @param index The position among the prime elements, assumed to be in range.
+ * @return The prime element at that position.
+ */
+    int MagicalContainer::primeAt(int index) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return primeView().select(static_cast<std::size_t>(index));
+            case Storage::Frozen:
+                return this->frozenPrimes.at(static_cast<std::size_t>(index));
+            case Storage::Mapped:
+                return this->snapshot.elements()[this->snapshot.primeIndex()[static_cast<std::size_t>(index)]];
+            case Storage::Vector:
+                break;
+        }
+        if (this->lazyViews) {
+            return this->core->elements[primePositions()[static_cast<std::size_t>(index)]];
+        }
+        return *(this->core->PrimeIter[static_cast<std::vector<int *>::size_type>(index)]);
+    }
+
+/**
+ * @brief Get the primality memo of a container with lazy views, allocating it on first use after a change.
+ * @return The memo, one word per 64-element block.
+ */
+    const MagicalContainer::PrimeMemo &MagicalContainer::memo() const {
+        return this->primeMemo.get([this] {
+            return PrimeMemo(primeBitmapWords(this->core->elements.size()));
+        });
+    }
+
+/**
+ * @brief Check whether the element at a position is prime, classifying its 64-element block on first use.
+ * @param index The position of the element in the sorted storage, assumed to be in range.
+ * @return `true` if the element is prime.
+ */
+    bool MagicalContainer::isPrimeElement(std::size_t index) const {
+        const PrimeMemo &primes = memo();
+        const std::size_t block = index / 64;
+        std::uint64_t word = 0;
+        if (primes.known[block].load(std::memory_order_acquire) == 0) {
+            const std::size_t first = block * 64;
+            const std::size_t length = std::min<std::size_t>(64, this->core->elements.size() - first);
+            classifyPrimes(std::span<const int>(this->core->elements.data() + first, length),
+                           std::span<std::uint64_t>(&word, 1));
+            primes.words[block].store(word, std::memory_order_relaxed);
+            primes.known[block].store(1, std::memory_order_release);
+            MAGICAL_STATS_COUNT(this->statistics, primalityTests, length);
+        } else {
+            word = primes.words[block].load(std::memory_order_relaxed);
+        }
+        return ((word >> (index % 64)) & 1U) != 0;
+    }
+
+/**
+ * @brief Get the positions of every prime element of a container with lazy views, classifying whatever
+ * the memo does not know yet. Used by the index-based prime accessors, which need the full count.
+ * @return The ascending positions of the prime elements.
+ */
+    const std::vector<std::uint32_t> &MagicalContainer::primePositions() const {
+        return this->lazyPrimePositions.get([this] {
+            std::vector<std::uint32_t> positions;
+            for (std::size_t i = 0; i < this->core->elements.size(); ++i) {
+                if (isPrimeElement(i)) {
+                    positions.push_back(static_cast<std::uint32_t>(i));
+                }
+            }
+            return positions;
+        });
+    }
+
+/**
+ * @brief Get the values a traversal of a view reads from.
+ * The vector and mapped backends expose their sorted arrays directly, and the vector backend's prime view is
+ * read through its pointer view, for which an empty span is returned. The other backends are materialized
+ * into scratch: the sorted elements for the ascending and side-cross views, or the primes.
+ * @param view The view.
+ * @param scratch Storage for a materialized view.
+ * @return The sorted elements, or the primes in ascending order.
+ */
+    std::span<const int> MagicalContainer::viewValues(View view, std::vector<int> &scratch) const {
+        if (view == View::Prime) {
+            switch (this->storage) {
+                case Storage::Vector:
+                    if (!this->lazyViews) {
+                        return {};
+                    }
+                    scratch.clear();
+                    for (std::uint32_t position: primePositions()) {
+                        scratch.push_back(this->core->elements[position]);
+                    }
+                    break;
+                case Storage::Bitmap:
+                    scratch = primeView().toVector();
+                    break;
+                case Storage::Frozen:
+                    scratch = this->frozenPrimes.toVector();
+                    break;
+                case Storage::Mapped:
+                    scratch.resize(static_cast<std::size_t>(primeCount()));
+                    for (int i = 0; i < primeCount(); ++i) {
+                        scratch[static_cast<std::size_t>(i)] = primeAt(i);
+                    }
+                    break;
+            }
+            return scratch;
+        }
+        switch (this->storage) {
+            case Storage::Vector:
+                return this->core->elements;
+            case Storage::Mapped:
+                return this->snapshot.elements();
+            case Storage::Bitmap:
+            case Storage::Frozen:
+                break;
+        }
+        scratch = getElements();
+        return scratch;
+    }
+
+/**
+ * @brief Get the sorted elements as one contiguous array, if the backend keeps one.
+ * @return The sorted storage of the vector and mapped backends, or an empty span for the others.
+ */
+    std::span<const int> MagicalContainer::contiguousElements() const {
+        switch (this->storage) {
+            case Storage::Vector:
+                return this->core->elements;
+            case Storage::Mapped:
+                return this->snapshot.elements();
+            case Storage::Bitmap:
+            case Storage::Frozen:
+                break;
+        }
+        return {};
+    }
+
+/**
+ * @brief Copies the elements at positions [first, first + count) of a view into out.
+ * Side-cross positions of contiguous storage go through the interleave kernel, and the prime view of the vector and
+ * mapped backends is read through their pointer views or position lists. Everything else goes through the
+ * per-element accessors, with side-cross positions mapped to element indices arithmetically.
+ * @param view The view.
+ * @param first The first position.
+ * @param count The number of positions, assumed to be in range.
+ * @param out Room for count elements.
+ */
+    void MagicalContainer::gatherChunk(View view, std::size_t first, std::size_t count, int *out) const {
+        const std::span<const int> sorted = contiguousElements();
+        if (view == View::SideCross && !sorted.empty()) {
+            interleaveCross(sorted, first, std::span<int>(out, count));
+        } else if (view == View::SideCross) {
+            const auto last = static_cast<std::size_t>(size()) - 1;
+            for (std::size_t k = 0; k < count; ++k) {
+                const std::size_t position = first + k;
+                const std::size_t index = position % 2 == 0 ? position / 2 : last - position / 2;
+                out[k] = ascendingAt(static_cast<int>(index));
+            }
+        } else if (view == View::Prime && this->storage == Storage::Vector && !this->lazyViews) {
+            for (std::size_t k = 0; k < count; ++k) {
+                out[k] = *this->core->PrimeIter[first + k];
+            }
+        } else if (view == View::Prime && this->storage == Storage::Vector) {
+            const std::vector<std::uint32_t> &positions = primePositions();
+            for (std::size_t k = 0; k < count; ++k) {
+                out[k] = sorted[positions[first + k]];
+            }
+        } else if (view == View::Prime && this->storage == Storage::Mapped) {
+            const std::span<const std::uint32_t> positions = this->snapshot.primeIndex();
+            for (std::size_t k = 0; k < count; ++k) {
+                out[k] = sorted[positions[first + k]];
+            }
+        } else {
+            for (std::size_t k = 0; k < count; ++k) {
+                const auto position = static_cast<int>(first + k);
+                out[k] = view == View::Prime ? primeAt(position) : ascendingAt(position);
+            }
+        }
+    }
+
+/**
+ * @brief Writes every element in side-cross order (smallest, largest, second smallest, ...) into out.
+ * Backends without contiguous storage are decoded into a sorted array first.
+ * @param out The output; only its first size() elements are written.
+ * @return The number of elements written.
+ * @throws std::runtime_error if out is smaller than the container.
+ */
+    std::size_t MagicalContainer::materializeSideCross(std::span<int> out) const {
+        const auto count = static_cast<std::size_t>(size());
+        if (out.size() < count) {
+            throw std::runtime_error("Error: The output is smaller than the container.");
+        }
+        std::vector<int> scratch;
+        interleaveCross(viewValues(View::Ascending, scratch), 0, out.first(count));
+        return count;
+    }
+
+/**
+ * @brief Get the number of positions in a view.
+ * @param view The view.
+ * @return primeCount() for the prime view, size() otherwise.
+ */
+    std::size_t MagicalContainer::viewSize(View view) const {
+        return static_cast<std::size_t>(view == View::Prime ? primeCount() : size());
+    }
+
+/**
+ * @brief Get the primality of every element as a bitmap, from what the backend already knows.
+ * The vector backend reads its prime view, or its memo when its views are lazy, and the mapped backend its
+ * prime index. The other backends find each of their primes among the elements by galloping.
+ * @param sorted The elements in ascending order, as returned by viewValues() for the ascending view.
+ * @return One bit per element, set for the primes.
+ */
+    std::vector<std::uint64_t> MagicalContainer::primeFlags(std::span<const int> sorted) const {
+        std::vector<std::uint64_t> flags(primeBitmapWords(sorted.size()), 0);
+        auto mark = [&flags](std::size_t index) {
+            flags[index / 64] |= 1ULL << (index % 64);
+        };
+        switch (this->storage) {
+            case Storage::Vector:
+                if (this->lazyViews) {
+                    const PrimeMemo &primes = memo();
+                    for (std::size_t first = 0; first < sorted.size(); first += 64) {
+                        isPrimeElement(first);
+                        flags[first / 64] = primes.words[first / 64].load(std::memory_order_relaxed);
+                    }
+                    return flags;
+                }
+                for (const int *prime: this->core->PrimeIter) {
+                    mark(static_cast<std::size_t>(prime - this->core->elements.data()));
+                }
+                return flags;
+            case Storage::Mapped:
+                for (std::uint32_t position: this->snapshot.primeIndex()) {
+                    mark(position);
+                }
+                return flags;
+            case Storage::Bitmap:
+            case Storage::Frozen:
+                break;
+        }
+        std::vector<int> scratch;
+        std::size_t position = 0;
+        for (int prime: viewValues(View::Prime, scratch)) {
+            position = gallop(sorted, position, prime);
+            mark(position);
+        }
+        return flags;
+    }
 
-        for (int i = 2; i <= sqrt(num); ++i) {
-            if (num % i == 0)
-                return false;
+/**
+ * @brief Computes a set operation between the elements of two containers without classifying any element
+ * again: the primality of the result is carried over from the inputs.
+ * The result uses the vector backend, with lazy views if this container has them.
+ * @param other The right-hand container.
+ * @param operation The operation.
+ * @return A new MagicalContainer holding the result.
+ */
+    MagicalContainer MagicalContainer::combineWith(const MagicalContainer &other, SetOperation operation) const {
+        std::vector<int> leftScratch;
+        std::vector<int> rightScratch;
+        const std::span<const int> left = viewValues(View::Ascending, leftScratch);
+        const std::span<const int> right = other.viewValues(View::Ascending, rightScratch);
+        FlaggedValues combined = combineSorted(operation, left, primeFlags(left), right, other.primeFlags(right));
+
+        MagicalContainer result;
+        result.lazyViews = this->lazyViews;
+        result.pagePolicy = this->pagePolicy;
+        result.adoptElements(combined.values);
+        if (result.lazyViews) {
+            result.primeMemo.set(PrimeMemo(combined.flags));
+            MAGICAL_STATS_FOOTPRINT(result.statistics, result.storageBytes());
+        } else {
+            result.rebuildViews(combined.flags);
         }
-        return true;
+        return result;
     }
 
+/**
+ * @brief Guards the mutating operations against frozen and mapped containers.
+ * @throws std::runtime_error if the MagicalContainer is read-only.
+ */
+    void MagicalContainer::requireMutable() const {
+        if (this->storage == Storage::Frozen || this->storage == Storage::Mapped) {
+            throw std::runtime_error("Error: MagicalContainer is read-only");
+        }
+    }
+
+/**
+ * @brief Get the memory reserved by the vector storage, its pointer views and its lazy primality memo.
+ * @return The capacity of `elements`, of the three views and of the memo, in bytes.
+ */
+    std::size_t MagicalContainer::storageBytes() const {
+        const VectorCore &vector = *this->core;
+        std::size_t bytes = vector.elements.capacity() * sizeof(int) +
+                            (vector.AscendingIter.capacity() + vector.CrossSideIter.capacity() +
+                             vector.PrimeIter.capacity()) * sizeof(int *);
+        if (const PrimeMemo *primes = this->primeMemo.find()) {
+            bytes += primes->words.capacity() * sizeof(std::uint64_t) + primes->known.capacity();
+        }
+        if (const std::vector<std::uint32_t> *positions = this->lazyPrimePositions.find()) {
+            bytes += positions->capacity() * sizeof(std::uint32_t);
+        }
+        return bytes;
+    }
+
+/**
+ * @brief Constructs an empty MagicalContainer with the given storage backend.
+ * @param storage The storage backend to use.
+ */
+    MagicalContainer::MagicalContainer(Storage storage) : storage(storage) {}
+
 /**
  * @brief Adds an element to the MagicalContainer if it is not already present.
  * @note The method will ensure that duplicate elements are not added to the vector, and the vector remains sorted after adding the new element.
  * @param element The element to be added.
  */
-    void MagicalContainer::addElement(int element) {
-        bool flag = false;
-        for (int i = 0; i < this->size(); ++i) {
-            if (this->getElement(i) == element) {
-                flag = true;
-                break;
+    void MagicalContainer::addElement(int element) {
+        requireMutable();
+        MAGICAL_STATS_TIME(this->statistics, AddElement);
+        MAGICAL_STATS_COUNT(this->statistics, addElementCalls, 1U);
+        if (this->storage == Storage::Bitmap) {
+            if (!this->bitmap.add(element)) {
+                return;
+            }
+            RoaringBitmap *primes = this->primeBitmap.modify();
+            if (primes != nullptr && isPrime(element)) {
+                primes->add(element);
+            }
+            this->aggregateIndex.clear();
+            if (this->valueHistogram) {
+                this->valueHistogram->add(element);
+            }
+            return;
+        }
+        auto it = std::lower_bound(this->core->elements.begin(), this->core->elements.end(), element);
+        if (it != this->core->elements.end() && *it == element) {
+            return;
+        }
+        const auto position = it - this->core->elements.begin();
+        // Only the new element is classified; the flags of the others move up past it.
+        std::vector<std::uint64_t> primes;
+        if (!this->lazyViews) {
+            primes = primeFlags(this->core->elements);
+            insertPrimeFlag(primes, this->core->elements.size(), static_cast<std::size_t>(position), isPrime(element));
+        }
+        ElementArray &elements = this->core.write().elements;
+        elements.insert(elements.begin() + position, element);
+        if (this->valueHistogram) {
+            this->valueHistogram->add(element);
+        }
+        if (this->lazyViews) {
+            rebuildViews();
+        } else {
+            rebuildViews(primes);
+        }
+    }
+
+/**
+ * @brief Adds a batch of elements to the MagicalContainer.
+ * The batch is sorted and merged into the storage in place, from the back, and the views are rebuilt once,
+ * instead of once per element as with repeated addElement() calls. Only the batch is classified for
+ * primality; the flags of elements already present are carried through the merge. Duplicates, within the
+ * batch or with elements already present, are ignored.
+ * @param newElements The elements to be added.
+ */
+    void MagicalContainer::addElements(std::span<const int> newElements) {
+        requireMutable();
+        MAGICAL_STATS_TIME(this->statistics, AddElements);
+        if (this->storage == Storage::Bitmap) {
+            for (int element: newElements) {
+                addElement(element);
+            }
+            return;
+        }
+        std::vector<int> batch(newElements.begin(), newElements.end());
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+
+        // Count the new values first, so the storage grows at most once and the merge runs in place.
+        const ElementArray &current = this->core->elements;
+        const std::size_t oldSize = current.size();
+        std::size_t fresh = 0;
+        std::size_t existing = 0;
+        for (int element: batch) {
+            existing = gallop(current, existing, element);
+            if (existing == current.size() || current[existing] != element) {
+                ++fresh;
+            }
+        }
+        if (fresh == 0) {
+            return;
+        }
+
+        std::vector<std::uint64_t> oldPrimes;
+        std::vector<std::uint64_t> batchPrimes;
+        if (!this->lazyViews) {
+            oldPrimes = primeFlags(current);
+            batchPrimes = classifyPrimes(batch);
+            MAGICAL_STATS_COUNT(this->statistics, primalityTests, batch.size());
+        }
+        auto isSet = [](const std::vector<std::uint64_t> &bits, std::size_t index) {
+            return ((bits[index / 64] >> (index % 64)) & 1U) != 0;
+        };
+
+        // Merge from the back while carrying every element's prime flag along, so only the new batch is
+        // classified and the elements are only reallocated when they outgrow their capacity. Nothing after the
+        // resize can throw, so the histogram counts each new value as it is placed.
+        ElementArray &elements = this->core.write().elements;
+        elements.resize(oldSize + fresh);
+        std::vector<std::uint64_t> primes(this->lazyViews ? 0 : primeBitmapWords(elements.size()), 0);
+        std::size_t left = oldSize;
+        std::size_t right = batch.size();
+        std::size_t out = elements.size();
+        while (right > 0) {
+            bool prime = false;
+            if (left > 0 && elements[left - 1] >= batch[right - 1]) {
+                if (elements[left - 1] == batch[right - 1]) {
+                    --right;
+                }
+                elements[--out] = elements[--left];
+                prime = !this->lazyViews && isSet(oldPrimes, left);
+            } else {
+                elements[--out] = batch[--right];
+                prime = !this->lazyViews && isSet(batchPrimes, right);
+                if (this->valueHistogram) {
+                    this->valueHistogram->add(batch[right]);
+                }
+            }
+            if (prime) {
+                primes[out / 64] |= 1ULL << (out % 64);
+            }
+        }
+        if (this->lazyViews) {
+            rebuildViews();
+            return;
+        }
+        // The first `left` elements did not move, and neither did their flags.
+        for (std::size_t word = 0; word < left / 64; ++word) {
+            primes[word] = oldPrimes[word];
+        }
+        if (left % 64 != 0) {
+            primes[left / 64] |= oldPrimes[left / 64] & ((1ULL << (left % 64)) - 1);
+        }
+        rebuildViews(primes);
+    }
+
+/**
+ * @brief Removes an element from the MagicalContainer.
+ * This function removes the specified element from the MagicalContainer if it exists.
+ * @param element The element to be removed.
+ * @throws std::runtime_error if the element is not found in the MagicalContainer, or if it is read-only.
+ */
+    void MagicalContainer::removeElement(int element) {
+        requireMutable();
+        MAGICAL_STATS_TIME(this->statistics, RemoveElement);
+        MAGICAL_STATS_COUNT(this->statistics, removeElementCalls, 1U);
+        if (this->storage == Storage::Bitmap) {
+            if (!this->bitmap.remove(element)) {
+                throw std::runtime_error("Error: Element not found in MagicalContainer");
+            }
+            if (RoaringBitmap *primes = this->primeBitmap.modify()) {
+                primes->remove(element);
+            }
+            this->aggregateIndex.clear();
+            if (this->valueHistogram) {
+                this->valueHistogram->remove(element);
+            }
+            return;
+        }
+        auto it = std::lower_bound(this->core->elements.begin(), this->core->elements.end(), element);
+        if (it == this->core->elements.end() || *it != element) {
+            throw std::runtime_error("Error: Element not found in MagicalContainer");
+        }
+        const auto position = it - this->core->elements.begin();
+        // Nothing is classified; the flags after the removed element move down over it.
+        std::vector<std::uint64_t> primes;
+        if (!this->lazyViews) {
+            primes = primeFlags(this->core->elements);
+            erasePrimeFlag(primes, this->core->elements.size(), static_cast<std::size_t>(position));
+        }
+        ElementArray &elements = this->core.write().elements;
+        elements.erase(elements.begin() + position);
+        if (this->valueHistogram) {
+            this->valueHistogram->remove(element);
+        }
+        if (this->lazyViews) {
+            rebuildViews();
+        } else {
+            rebuildViews(primes);
+        }
+    }
+
+/**
+ * @brief Get the number of elements in the MagicalContainer.
+ * This function returns the size of the MagicalContainer, which is the number of elements currently stored in it.
+ * @return The number of elements in the MagicalContainer.
+ */
+    int MagicalContainer::size() const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return (int) this->bitmap.cardinality();
+            case Storage::Frozen:
+                return (int) this->frozen.size();
+            case Storage::Mapped:
+                return (int) this->snapshot.elements().size();
+            case Storage::Vector:
+                break;
+        }
+        return (int) this->core->elements.size();
+    }
+
+/**
+ * @brief Get the number of prime elements in the MagicalContainer.
+ * @return The number of elements visited by the PrimeIterator.
+ */
+    int MagicalContainer::primeCount() const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return (int) primeView().cardinality();
+            case Storage::Frozen:
+                return (int) this->frozenPrimes.size();
+            case Storage::Mapped:
+                return (int) this->snapshot.primeIndex().size();
+            case Storage::Vector:
+                break;
+        }
+        if (this->lazyViews) {
+            return (int) primePositions().size();
+        }
+        return (int) this->core->PrimeIter.size();
+    }
+
+/**
+ * @brief Get a copy of the elements in the MagicalContainer.
+ * @return A std::vector<int> containing the elements of the MagicalContainer in ascending order.
+ */
+    std::vector<int> MagicalContainer::getElements() const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return this->bitmap.toVector();
+            case Storage::Frozen:
+                return this->frozen.toVector();
+            case Storage::Mapped:
+                return {this->snapshot.elements().begin(), this->snapshot.elements().end()};
+            case Storage::Vector:
+                break;
+        }
+        return {this->core->elements.begin(), this->core->elements.end()};
+    }
+
+/**
+ * @brief Get the element at the specified index.
+ * @param index The index of the element to retrieve.
+ * @return The element at the specified index.
+ * @throws std::out_of_range if the index is out of range.
+ */
+    int MagicalContainer::getElement(int index) const {
+        if (index < 0 || index >= size()) {
+            throw std::out_of_range("Error: Invalid index.");
+        }
+        return ascendingAt(index);
+    }
+
+/**
+ * @brief Set the elements of the MagicalContainer.
+ * This function replaces the existing elements in the MagicalContainer with the elements provided in the newElements vector.
+ * @param newElements The vector containing the new elements to be set.
+ * @note The contents of the MagicalContainer will be completely replaced by the elements in newElements,
+ * which are sorted and deduplicated like elements added through addElement().
+ * @throws std::runtime_error if the MagicalContainer is read-only.
+ */
+    void MagicalContainer::setElements(const std::vector<int> &newElements) {
+        requireMutable();
+        std::vector<int> sorted = newElements;
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        if (this->storage == Storage::Bitmap) {
+            this->bitmap = RoaringBitmap::fromSorted(sorted);
+            this->primeBitmap.clear();
+            this->aggregateIndex.clear();
+            refillHistogram();
+            return;
+        }
+        adoptElements(sorted);
+        rebuildViews();
+        refillHistogram();
+    }
+
+/**
+ * @brief Get the union of this MagicalContainer and another one.
+ * @param other The other MagicalContainer.
+ * @return A new MagicalContainer with the elements present in either container.
+ */
+    MagicalContainer MagicalContainer::unionWith(const MagicalContainer &other) const {
+        return combineWith(other, SetOperation::Union);
+    }
+
+/**
+ * @brief Get the intersection of this MagicalContainer and another one.
+ * @param other The other MagicalContainer.
+ * @return A new MagicalContainer with the elements present in both containers.
+ */
+    MagicalContainer MagicalContainer::intersectWith(const MagicalContainer &other) const {
+        return combineWith(other, SetOperation::Intersection);
+    }
+
+/**
+ * @brief Get the difference between this MagicalContainer and another one.
+ * @param other The other MagicalContainer.
+ * @return A new MagicalContainer with the elements of this container that are not in the other one.
+ */
+    MagicalContainer MagicalContainer::differenceWith(const MagicalContainer &other) const {
+        return combineWith(other, SetOperation::Difference);
+    }
+
+/**
+ * @brief Get the symmetric difference of this MagicalContainer and another one.
+ * @param other The other MagicalContainer.
+ * @return A new MagicalContainer with the elements present in exactly one of the containers.
+ */
+    MagicalContainer MagicalContainer::symmetricDifference(const MagicalContainer &other) const {
+        return combineWith(other, SetOperation::SymmetricDifference);
+    }
+
+/**
+ * @brief Check whether the MagicalContainer holds the given element.
+ * @param element The element to look for.
+ * @return `true` if the element is present, `false` otherwise.
+ */
+    bool MagicalContainer::contains(int element) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return this->bitmap.contains(element);
+            case Storage::Frozen:
+                return this->frozen.contains(element);
+            case Storage::Mapped:
+                return std::binary_search(this->snapshot.elements().begin(), this->snapshot.elements().end(),
+                                          element);
+            case Storage::Vector:
+                break;
+        }
+        int rank = lowerBound(element);
+        return rank < size() && this->core->elements[static_cast<std::vector<int>::size_type>(rank)] == element;
+    }
+
+/**
+ * @brief Find the position of the first element that is not less than the given value.
+ * When the search index is enabled the lookup goes through the Eytzinger index, which is built here on
+ * the first query after a mutation; otherwise it is a plain binary search over the sorted storage.
+ * Bitmap and frozen containers answer from their chunk prefix counts and block skip index instead, and
+ * mapped containers binary search the mapped array.
+ * @param element The value to search for.
+ * @return The index of the first element >= element, or size() if there is none.
+ */
+    int MagicalContainer::lowerBound(int element) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return static_cast<int>(this->bitmap.rank(element));
+            case Storage::Frozen:
+                return static_cast<int>(this->frozen.lowerBound(element));
+            case Storage::Mapped: {
+                std::span<const int> mapped = this->snapshot.elements();
+                return static_cast<int>(std::lower_bound(mapped.begin(), mapped.end(), element) - mapped.begin());
+            }
+            case Storage::Vector:
+                break;
+        }
+        if (this->searchIndexEnabled) {
+            const EytzingerIndex &index = this->searchIndex.get([this] {
+                EytzingerIndex built;
+                built.build(this->core->elements.data(), this->core->elements.size());
+                return built;
+            });
+            return static_cast<int>(index.lowerBound(element));
+        }
+        return static_cast<int>(std::lower_bound(this->core->elements.begin(), this->core->elements.end(), element) -
+                                this->core->elements.begin());
+    }
+
+/**
+ * @brief Get the k-th smallest element, counting from 0.
+ * @param k The rank of the element.
+ * @return The element with exactly k smaller elements.
+ * @throws std::out_of_range if k is not in [0, size()).
+ */
+    int MagicalContainer::kth(int k) const {
+        return getElement(k);
+    }
+
+/**
+ * @brief Get the number of elements smaller than a value. The value does not have to be in the container.
+ * @param element The value.
+ * @return The number of elements < element.
+ */
+    int MagicalContainer::rank(int element) const {
+        return lowerBound(element);
+    }
+
+/**
+ * @brief Get a percentile of the elements by the nearest-rank method: the smallest element that is greater
+ * than or equal to at least p percent of the elements.
+ * @param p The percentile, in [0, 100]. 0 gives the smallest element and 100 the largest.
+ * @return The element at that percentile.
+ * @throws std::out_of_range if p is not in [0, 100].
+ * @throws std::runtime_error if the MagicalContainer is empty.
+ */
+    int MagicalContainer::percentile(double p) const {
+        if (!(p >= 0 && p <= 100)) {
+            throw std::out_of_range("Error: Invalid percentile.");
+        }
+        if (size() == 0) {
+            throw std::runtime_error("Error: MagicalContainer is empty");
+        }
+        const auto nearestRank = static_cast<int>(std::ceil(p * size() / 100));
+        return ascendingAt(std::max(nearestRank, 1) - 1);
+    }
+
+/**
+ * @brief Get the median of the elements.
+ * @return The middle element, or the mean of the two middle elements if the size is even.
+ * @throws std::runtime_error if the MagicalContainer is empty.
+ */
+    double MagicalContainer::median() const {
+        const int count = size();
+        if (count == 0) {
+            throw std::runtime_error("Error: MagicalContainer is empty");
+        }
+        if (count % 2 == 1) {
+            return ascendingAt(count / 2);
+        }
+        return (static_cast<double>(ascendingAt(count / 2 - 1)) + static_cast<double>(ascendingAt(count / 2))) / 2;
+    }
+
+/**
+ * @brief Get the k-th smallest prime element, counting from 0.
+ * @param k The rank of the prime among the prime elements.
+ * @return The prime element with exactly k smaller prime elements.
+ * @throws std::out_of_range if k is not in [0, primeCount()).
+ */
+    int MagicalContainer::kthPrime(int k) const {
+        if (k < 0 || k >= primeCount()) {
+            throw std::out_of_range("Error: Invalid index.");
+        }
+        return primeAt(k);
+    }
+
+/**
+ * @brief Get the number of prime elements smaller than a value.
+ * The prime view of every backend is sorted, so this is one binary search over it: over the positions of
+ * the prime elements for the vector and mapped backends, over the prime values for the others.
+ * @param element The value.
+ * @return The number of prime elements < element.
+ */
+    int MagicalContainer::primeRank(int element) const {
+        switch (this->storage) {
+            case Storage::Bitmap:
+                return static_cast<int>(primeView().rank(element));
+            case Storage::Frozen:
+                return static_cast<int>(this->frozenPrimes.lowerBound(element));
+            case Storage::Mapped: {
+                std::span<const std::uint32_t> positions = this->snapshot.primeIndex();
+                auto position = static_cast<std::uint32_t>(lowerBound(element));
+                return static_cast<int>(std::lower_bound(positions.begin(), positions.end(), position) -
+                                        positions.begin());
+            }
+            case Storage::Vector:
+                break;
+        }
+        const auto position = static_cast<std::size_t>(lowerBound(element));
+        if (this->lazyViews) {
+            const std::vector<std::uint32_t> &positions = primePositions();
+            return static_cast<int>(std::lower_bound(positions.begin(), positions.end(),
+                                                     static_cast<std::uint32_t>(position)) - positions.begin());
+        }
+        const int *bound = this->core->elements.data() + position;
+        return static_cast<int>(std::lower_bound(this->core->PrimeIter.begin(), this->core->PrimeIter.end(), bound) -
+                                this->core->PrimeIter.begin());
+    }
+
+/**
+ * @brief Get the positions of the elements in [low, high] in ascending order.
+ * @param low The smallest value in the range.
+ * @param high The largest value in the range.
+ * @return The first position and one past the last one; equal if the range holds no element.
+ */
+    std::pair<std::size_t, std::size_t> MagicalContainer::positionRange(int low, int high) const {
+        if (low > high) {
+            return {0, 0};
+        }
+        const int end = high == std::numeric_limits<int>::max() ? size() : lowerBound(high + 1);
+        return {static_cast<std::size_t>(lowerBound(low)), static_cast<std::size_t>(end)};
+    }
+
+/**
+ * @brief Get the ranks among the prime elements of the primes in [low, high].
+ * @param low The smallest value in the range.
+ * @param high The largest value in the range.
+ * @return The rank of the first prime and one past the last one; equal if the range holds no prime.
+ */
+    std::pair<std::size_t, std::size_t> MagicalContainer::primeRange(int low, int high) const {
+        if (low > high) {
+            return {0, 0};
+        }
+        const int end = high == std::numeric_limits<int>::max() ? primeCount() : primeRank(high + 1);
+        return {static_cast<std::size_t>(primeRank(low)), static_cast<std::size_t>(end)};
+    }
+
+/**
+ * @brief Get the aggregate index, building it on first use after a change.
+ * @return The prefix sums over the current elements and their primes.
+ */
+    const PrefixSumIndex &MagicalContainer::aggregates() const {
+        return this->aggregateIndex.get([&] {
+            std::vector<int> scratch;
+            const std::span<const int> values = viewValues(View::Ascending, scratch);
+            PrefixSumIndex index;
+            index.build(values, primeFlags(values));
+            return index;
+        });
+    }
+
+/**
+ * @brief Get the number of elements in [low, high].
+ * @param low The smallest value counted.
+ * @param high The largest value counted.
+ * @return The number of elements e with low <= e <= high.
+ */
+    int MagicalContainer::count(int low, int high) const {
+        const auto [begin, end] = positionRange(low, high);
+        return static_cast<int>(end - begin);
+    }
+
+/**
+ * @brief Get the sum of the elements in [low, high].
+ * With the aggregate index enabled this is two lower-bound searches and two prefix-sum lookups; otherwise
+ * the elements in the range are added up one by one.
+ * @param low The smallest value added.
+ * @param high The largest value added.
+ * @return The sum of the elements e with low <= e <= high, 0 if there is none.
+ */
+    long long MagicalContainer::sum(int low, int high) const {
+        const auto [begin, end] = positionRange(low, high);
+        if (this->aggregateIndexEnabled) {
+            return aggregates().sum(begin, end);
+        }
+        const std::span<const int> sorted = contiguousElements();
+        long long total = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            total += sorted.empty() ? ascendingAt(static_cast<int>(i)) : sorted[i];
+        }
+        return total;
+    }
+
+/**
+ * @brief Get the mean of the elements in [low, high].
+ * @param low The smallest value included.
+ * @param high The largest value included.
+ * @return The arithmetic mean of the elements e with low <= e <= high.
+ * @throws std::runtime_error if the range holds no element.
+ */
+    double MagicalContainer::mean(int low, int high) const {
+        const int elements = count(low, high);
+        if (elements == 0) {
+            throw std::runtime_error("Error: No elements in range");
+        }
+        return static_cast<double>(sum(low, high)) / elements;
+    }
+
+/**
+ * @brief Get the number of prime elements in [low, high].
+ * @param low The smallest value counted.
+ * @param high The largest value counted.
+ * @return The number of prime elements p with low <= p <= high.
+ */
+    int MagicalContainer::primeCount(int low, int high) const {
+        const auto [begin, end] = primeRange(low, high);
+        return static_cast<int>(end - begin);
+    }
+
+/**
+ * @brief Get the sum of the prime elements in [low, high], from the aggregate index if it is enabled.
+ * @param low The smallest value added.
+ * @param high The largest value added.
+ * @return The sum of the prime elements p with low <= p <= high, 0 if there is none.
+ */
+    long long MagicalContainer::primeSum(int low, int high) const {
+        const auto [begin, end] = primeRange(low, high);
+        if (this->aggregateIndexEnabled) {
+            return aggregates().primeSum(begin, end);
+        }
+        long long total = 0;
+        for (std::size_t i = begin; i < end; ++i) {
+            total += primeAt(static_cast<int>(i));
+        }
+        return total;
+    }
+
+/**
+ * @brief Get the mean of the prime elements in [low, high].
+ * @param low The smallest value included.
+ * @param high The largest value included.
+ * @return The arithmetic mean of the prime elements p with low <= p <= high.
+ * @throws std::runtime_error if the range holds no prime element.
+ */
+    double MagicalContainer::primeMean(int low, int high) const {
+        const int primes = primeCount(low, high);
+        if (primes == 0) {
+            throw std::runtime_error("Error: No prime elements in range");
+        }
+        return static_cast<double>(primeSum(low, high)) / primes;
+    }
+
+/**
+ * @brief Enable or disable the read-optimized search index.
+ * The index costs two extra ints per element and pays off for large, read-mostly containers.
+ * Disabling it releases its memory. The index only applies to the vector storage backend.
+ * @param enabled `true` to serve contains() and lowerBound() from the index.
+ */
+    void MagicalContainer::setSearchIndex(bool enabled) {
+        this->searchIndexEnabled = enabled;
+        if (!enabled) {
+            this->searchIndex.clear();
+        }
+    }
+
+/**
+ * @brief Check whether the read-optimized search index is enabled.
+ * @return `true` if lookups are served from the search index.
+ */
+    bool MagicalContainer::hasSearchIndex() const {
+        return this->searchIndexEnabled;
+    }
+
+/**
+ * @brief Enable or disable the aggregate index behind sum(), mean(), primeSum() and primeMean().
+ * The index costs 8 bytes per element and per prime, is built by the first query after a change and is
+ * dropped by every change, so it pays off for read-mostly containers that answer many range queries.
+ * Disabling it releases its memory.
+ * @param enabled `true` to answer range sums from prefix sums.
+ */
+    void MagicalContainer::setAggregateIndex(bool enabled) {
+        this->aggregateIndexEnabled = enabled;
+        if (!enabled) {
+            this->aggregateIndex.clear();
+        }
+    }
+
+/**
+ * @brief Check whether the aggregate index is enabled.
+ * @return `true` if range sums are answered from prefix sums.
+ */
+    bool MagicalContainer::hasAggregateIndex() const {
+        return this->aggregateIndexEnabled;
+    }
+
+/**
+ * @brief Recounts the tracked histogram, if any, from the current elements.
+ */
+    void MagicalContainer::refillHistogram() {
+        if (!this->valueHistogram) {
+            return;
+        }
+        this->valueHistogram->clear();
+        forEachChunk(View::Ascending, [this](std::span<const int> chunk) {
+            for (int element: chunk) {
+                this->valueHistogram->add(element);
+            }
+        });
+    }
+
+/**
+ * @brief Starts tracking a histogram of the elements with the given bucket layout, replacing any tracked one.
+ * The histogram is filled from the current elements once and from then on updated by every insertion and
+ * removal, so reading it never touches the storage.
+ * @param layout The histogram whose bucket layout to use; its counts are ignored.
+ */
+    void MagicalContainer::setHistogram(const ValueHistogram &layout) {
+        this->valueHistogram = layout;
+        refillHistogram();
+    }
+
+/**
+ * @brief Stops tracking the histogram and releases it.
+ */
+    void MagicalContainer::clearHistogram() {
+        this->valueHistogram.reset();
+    }
+
+/**
+ * @brief Check whether a histogram of the elements is tracked.
+ * @return `true` if histogram() can be called.
+ */
+    bool MagicalContainer::hasHistogram() const {
+        return this->valueHistogram.has_value();
+    }
+
+/**
+ * @brief Get the tracked histogram of the elements.
+ * @return The histogram, up to date with every change since setHistogram().
+ * @throws std::runtime_error if no histogram is tracked.
+ */
+    const ValueHistogram &MagicalContainer::histogram() const {
+        if (!this->valueHistogram) {
+            throw std::runtime_error("Error: No histogram is tracked");
+        }
+        return *this->valueHistogram;
+    }
+
+/**
+ * @brief Switches the vector backend between materialized and lazy views.
+ * With lazy views no pointer arrays are kept and nothing is classified when elements change: sideCross()
+ * and primes() compute their sequences as they are read, and primality is memoized per 64-element block
+ * until the next change. The index-based iterators keep working, but the first use of the prime count
+ * classifies every element. Several threads may read lazy views at once; the memo is filled with atomic stores.
+ * @param lazy `true` for lazy views, `false` for the materialized ones.
+ */
+    void MagicalContainer::setLazyViews(bool lazy) {
+        if (lazy == this->lazyViews) {
+            return;
+        }
+        this->lazyViews = lazy;
+        VectorCore &writable = this->core.write();
+        writable.PrimeIter = ViewArray(writable.PrimeIter.get_allocator());
+        writable.AscendingIter = ViewArray(writable.AscendingIter.get_allocator());
+        writable.CrossSideIter = ViewArray(writable.CrossSideIter.get_allocator());
+        this->primeMemo.clear();
+        this->lazyPrimePositions.clear();
+        if (this->storage == Storage::Vector) {
+            rebuildViews();
+        }
+    }
+
+/**
+ * @brief Check whether the views are computed lazily.
+ * @return `true` if setLazyViews(true) was called.
+ */
+    bool MagicalContainer::hasLazyViews() const {
+        return this->lazyViews;
+    }
+
+/**
+ * @brief Produces the side-cross order (smallest, largest, second smallest, ...) one element at a time.
+ * The container must outlive the generator and must not change while it is read.
+ * @return A generator of the elements in side-cross order.
+ */
+    Generator<int> MagicalContainer::sideCross() const {
+        const int count = size();
+        for (int low = 0, high = count - 1; low <= high; ++low, --high) {
+            co_yield crossAt(low);
+            if (low != high) {
+                co_yield crossAt(high);
+            }
+        }
+    }
+
+/**
+ * @brief Produces the prime elements in ascending order one at a time. With lazy views only the blocks
+ * of elements reached so far are classified.
+ * The container must outlive the generator and must not change while it is read.
+ * @return A generator of the prime elements.
+ */
+    Generator<int> MagicalContainer::primes() const {
+        if (this->storage == Storage::Vector && this->lazyViews) {
+            // Classify a block at a time and walk only the set bits of its word.
+            const PrimeMemo &memo = this->memo();
+            for (std::size_t first = 0; first < this->core->elements.size(); first += 64) {
+                isPrimeElement(first);
+                for (std::uint64_t word = memo.words[first / 64].load(std::memory_order_relaxed); word != 0;
+                     word &= word - 1) {
+                    co_yield this->core->elements[first + static_cast<std::size_t>(std::countr_zero(word))];
+                }
+            }
+            co_return;
+        }
+        const int count = primeCount();
+        for (int i = 0; i < count; ++i) {
+            co_yield primeAt(i);
+        }
+    }
+
+/**
+ * @brief Get the storage backend of the MagicalContainer.
+ * @return The storage backend currently in use.
+ */
+    MagicalContainer::Storage MagicalContainer::getStorage() const {
+        return this->storage;
+    }
+
+/**
+ * @brief Converts the MagicalContainer to another storage backend, keeping its elements.
+ * The elements are copied out in ascending order, every structure of the old backend is released, and the
+ * new backend is built from the copy. Converting to the frozen backend is the same as calling freeze().
+ * A container can only become mapped through mapFromFile().
+ * @param newStorage The storage backend to convert to.
+ * @throws std::runtime_error if newStorage is Storage::Mapped.
+ */
+    void MagicalContainer::setStorage(Storage newStorage) {
+        if (newStorage == this->storage) {
+            return;
+        }
+        if (newStorage == Storage::Mapped) {
+            throw std::runtime_error("Error: Use mapFromFile() to create a mapped MagicalContainer");
+        }
+        std::vector<int> values = getElements();
+
+        this->core = CowPtr<VectorCore>();
+        this->aggregateIndex.clear();
+        this->bitmap.clear();
+        this->primeBitmap.clear();
+        this->frozen = FrozenStorage();
+        this->frozenPrimes = FrozenStorage();
+        this->snapshot = MappedSnapshot();
+
+        this->storage = newStorage;
+        switch (newStorage) {
+            case Storage::Vector:
+                adoptElements(values);
+                rebuildViews();
+                break;
+            case Storage::Bitmap:
+                this->bitmap = RoaringBitmap::fromSorted(values);
+                break;
+            case Storage::Frozen: {
+                const std::vector<std::uint64_t> primes = classifyPrimes(values);
+                std::vector<int> primeValues;
+                for (std::size_t i = 0; i < values.size(); ++i) {
+                    if (((primes[i / 64] >> (i % 64)) & 1U) != 0) {
+                        primeValues.push_back(values[i]);
+                    }
+                }
+                this->frozen = FrozenStorage::compress(values);
+                this->frozenPrimes = FrozenStorage::compress(primeValues);
+                break;
+            }
+            case Storage::Mapped:
+                break;
+        }
+    }
+
+/**
+ * @brief Makes the MagicalContainer read-only and compresses its elements.
+ * The elements and the prime elements are stored as blocks of bit-packed gaps, which typically takes a few
+ * bits per element instead of the 28 bytes of the vector backend. All three iterators keep working;
+ * addElement(), addElements(), removeElement() and setElements() throw until the container is converted
+ * back with setStorage().
+ */
+    void MagicalContainer::freeze() {
+        setStorage(Storage::Frozen);
+    }
+
+/**
+ * @brief Check whether the MagicalContainer is frozen.
+ * @return `true` if the container uses the read-only frozen backend.
+ */
+    bool MagicalContainer::isFrozen() const {
+        return this->storage == Storage::Frozen;
+    }
+
+/**
+ * @brief Saves the MagicalContainer as a binary snapshot that mapFromFile() can load.
+ * @param path The path of the file to create or replace.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+    void MagicalContainer::save(const std::string &path) const {
+        if (this->storage == Storage::Vector && this->lazyViews) {
+            MappedSnapshot::write(path, this->core->elements, primePositions());
+            return;
+        }
+        if (this->storage == Storage::Vector) {
+            std::vector<std::uint32_t> primeIndex;
+            primeIndex.reserve(this->core->PrimeIter.size());
+            for (const int *prime: this->core->PrimeIter) {
+                primeIndex.push_back(static_cast<std::uint32_t>(prime - this->core->elements.data()));
             }
+            MappedSnapshot::write(path, this->core->elements, primeIndex);
+            return;
+        }
+        if (this->storage == Storage::Mapped) {
+            MappedSnapshot::write(path, this->snapshot.elements(), this->snapshot.primeIndex());
+            return;
         }
-        if (!flag) {
-            this->elements.emplace_back(element);
-            std::sort(this->elements.begin(), this->elements.end());
+        const std::vector<int> values = getElements();
+        const std::vector<std::uint64_t> primes = classifyPrimes(values);
+        std::vector<std::uint32_t> primeIndex;
+        for (std::size_t i = 0; i < values.size(); ++i) {
+            if (((primes[i / 64] >> (i % 64)) & 1U) != 0) {
+                primeIndex.push_back(static_cast<std::uint32_t>(i));
+            }
         }
+        MappedSnapshot::write(path, values, primeIndex);
+    }
 
-        this->PrimeIter.clear();
-        this->AscendingIter.clear();
-        this->CrossSideIter.clear();
+/**
+ * @brief Loads a MagicalContainer from a snapshot written by save().
+ * The file is mapped read-only and the container serves its elements and prime view straight from the
+ * mapping, so loading costs the same for any size. The container stays read-only until it is converted to
+ * another backend with setStorage().
+ * @param path The path of the snapshot file.
+ * @param verify `true` to validate the checksum and the prime index, which reads the whole file.
+ * @return The mapped MagicalContainer.
+ * @throws std::runtime_error if the file cannot be mapped or is not a valid snapshot.
+ */
+    MagicalContainer MagicalContainer::mapFromFile(const std::string &path, bool verify) {
+        MagicalContainer container(Storage::Mapped);
+        container.snapshot = MappedSnapshot::open(path, verify);
+        return container;
+    }
 
-        for (int i = 0; i < this->size(); ++i) {
-            this->AscendingIter.emplace_back(&this->elements.at((std::vector<int>::size_type) i));
-            this->CrossSideIter.emplace_back(&this->elements.at((std::vector<int>::size_type) i));
-            if (isPrime(this->getElement(i))) {
-                this->PrimeIter.emplace_back(&this->elements.at((std::vector<int>::size_type) i));
-            }
+/**
+ * @brief Compacts a bitmap-backed container by storing dense ranges as runs.
+ * Has no effect on the vector backend.
+ */
+    void MagicalContainer::optimizeStorage() {
+        if (this->storage == Storage::Bitmap) {
+            this->bitmap.runOptimize();
         }
     }
 
 /**
- * @brief Removes an element from the MagicalContainer.
- * This function removes the specified element from the MagicalContainer if it exists.
- * @param element The element to be removed.
- * @throws std::runtime_error if the element is not found in the MagicalContainer.
+ * @brief Get the memory held by each internal structure. The search index, the aggregate index, the histogram
+ * and the bitmap, frozen and mapped backends are reported with the same used and reserved bytes.
+ * @return The bytes used and reserved per structure.
  */
-    void MagicalContainer::removeElement(int element) {
-        auto it = elements.begin();
-        while (it != elements.end()) {
-            if (*it == element) {
-                elements.erase(it);
-                return;
-            }
-            ++it;
+    MemoryUsage MagicalContainer::memoryUsage() const {
+        auto of = [](const auto &values) {
+            const std::size_t width = sizeof(values[0]);
+            return ComponentMemory{values.size() * width, values.capacity() * width};
+        };
+        auto fixed = [](std::size_t bytes) {
+            return ComponentMemory{bytes, bytes};
+        };
+        const VectorCore &vector = *this->core;
+        MemoryUsage usage;
+        usage.elements = of(vector.elements);
+        usage.primeView = of(vector.PrimeIter);
+        usage.ascendingView = of(vector.AscendingIter);
+        usage.crossView = of(vector.CrossSideIter);
+        if (const PrimeMemo *primes = this->primeMemo.find()) {
+            usage.lazyPrimes = fixed(primes->words.size() * sizeof(std::uint64_t) + primes->known.size());
+        }
+        if (const std::vector<std::uint32_t> *positions = this->lazyPrimePositions.find()) {
+            usage.lazyPrimes.used += positions->size() * sizeof(std::uint32_t);
+            usage.lazyPrimes.reserved += positions->capacity() * sizeof(std::uint32_t);
+        }
+        const EytzingerIndex *index = this->searchIndex.find();
+        usage.searchIndex = fixed(index != nullptr ? index->memoryBytes() : 0);
+        const PrefixSumIndex *aggregates = this->aggregateIndex.find();
+        usage.aggregateIndex = fixed(aggregates != nullptr ? aggregates->memoryBytes() : 0);
+        if (this->valueHistogram) {
+            usage.histogram = fixed(this->valueHistogram->bucketCount() * sizeof(std::uint64_t));
         }
-        throw std::runtime_error("Error: Element not found in MagicalContainer");
+        if (this->storage == Storage::Bitmap) {
+            const RoaringBitmap *primes = this->primeBitmap.find();
+            usage.bitmap = fixed(this->bitmap.memoryBytes() + (primes != nullptr ? primes->memoryBytes() : 0));
+        } else if (this->storage == Storage::Frozen) {
+            usage.frozen = fixed(this->frozen.memoryBytes() + this->frozenPrimes.memoryBytes());
+        } else if (this->storage == Storage::Mapped) {
+            usage.mapped = fixed(this->snapshot.mappedBytes());
+        }
+        return usage;
     }
 
 /**
- * @brief Get the number of elements in the MagicalContainer.
- * This function returns the size of the MagicalContainer, which is the number of elements currently stored in it.
- * @return The number of elements in the MagicalContainer.
+ * @brief Makes room for capacity elements in the vector storage and, without lazy views, in all three views,
+ * so that loading up to that many elements reallocates none of them; the lazy primality memo is sized when it
+ * is first read after a change. The room is kept until shrinkToFit() or a change of storage. Has no effect on
+ * the bitmap backend, whose chunks are sized by the values they hold.
+ * @param capacity The number of elements to make room for.
+ * @throws std::runtime_error if the MagicalContainer is read-only.
  */
-    int MagicalContainer::size() const {
-        return (int) this->elements.size();
+    void MagicalContainer::reserve(std::size_t capacity) {
+        requireMutable();
+        if (this->storage != Storage::Vector) {
+            return;
+        }
+        VectorCore &writable = this->core.write();
+        if (capacity > writable.elements.capacity()) {
+            writable.relocate(capacity);
+        }
+        if (!this->lazyViews) {
+            writable.PrimeIter.reserve(capacity);
+            writable.AscendingIter.reserve(capacity);
+            writable.CrossSideIter.reserve(capacity);
+        }
+        MAGICAL_STATS_FOOTPRINT(this->statistics, storageBytes());
     }
 
 /**
- * @brief Get a const reference to the elements in the MagicalContainer.
- * @return A const reference to the std::vector<int> containing the elements in the MagicalContainer.
+ * @brief Releases the slack capacity of the storage: of the elements and the views of the vector backend, or
+ * of the chunks of the bitmap backend. Storage shared with a copy is left as it is, since the copy made to
+ * change it would hold no slack anyway.
  */
-    std::vector<int> MagicalContainer::getElements() const {
-        return this->elements;
+    void MagicalContainer::shrinkToFit() {
+        if (this->storage == Storage::Bitmap) {
+            this->bitmap.shrinkToFit();
+            if (RoaringBitmap *primes = this->primeBitmap.modify()) {
+                primes->shrinkToFit();
+            }
+            return;
+        }
+        if (this->storage != Storage::Vector || this->core.isShared()) {
+            return;
+        }
+        this->core.write().shrinkToFit();
+        MAGICAL_STATS_FOOTPRINT(this->statistics, storageBytes());
     }
 
 /**
- * @brief Get the element at the specified index.
- * @param index The index of the element to retrieve.
- * @return The element at the specified index.
- * @throws std::out_of_range if the index is out of range.
+ * @brief Sets how the elements and the views of the vector backend are allocated: on huge pages, and on which
+ * NUMA nodes. Arrays of at least HugePageSize bytes are affected; each part of the policy that the system
+ * does not support is skipped. The current elements are moved under the new policy and the views rebuilt from
+ * their known primality. Other backends take the policy when they are converted to the vector one.
+ * @param policy The page policy.
  */
-    int MagicalContainer::getElement(int index) const {
-        if (index < 0 || index >= elements.size()) {
-            throw std::out_of_range("Error: Invalid index.");
+    void MagicalContainer::setPagePolicy(const PagePolicy &policy) {
+        if (policy == this->pagePolicy) {
+            return;
+        }
+        this->pagePolicy = policy;
+        if (this->storage != Storage::Vector) {
+            return;
+        }
+        const std::vector<int> values(this->core->elements.begin(), this->core->elements.end());
+        const std::vector<std::uint64_t> primes = this->lazyViews ? std::vector<std::uint64_t>() : primeFlags(values);
+        const std::size_t capacity = this->core->elements.capacity();
+        this->core = CowPtr<VectorCore>(VectorCore(policy));
+        this->core.write().elements.reserve(capacity);
+        adoptElements(values);
+        if (this->lazyViews) {
+            rebuildViews();
+        } else {
+            rebuildViews(primes);
         }
-        return elements[static_cast<std::vector<int>::size_type>(index)];
     }
 
 /**
- * @brief Set the elements of the MagicalContainer.
- * This function replaces the existing elements in the MagicalContainer with the elements provided in the newElements vector.
- * @param newElements The vector containing the new elements to be set.
- * @note The contents of the MagicalContainer will be completely replaced by the elements in newElements.
+ * @brief Get the page policy of the vector backend.
+ * @return The policy given to setPagePolicy(), or the default one.
  */
-    void MagicalContainer::setElements(const std::vector<int> &newElements) {
-        this->elements = newElements;
+    const PagePolicy &MagicalContainer::getPagePolicy() const {
+        return this->pagePolicy;
     }
 
 
@@ -119,8 +1584,10 @@ namespace ariel {
  * @brief Constructs an AscendingIterator object for the given MagicalContainer.
  * @param container The MagicalContainer to iterate over.
  */
-    MagicalContainer::AscendingIterator::AscendingIterator(ariel::MagicalContainer &container) : container(container),
-                                                                                                 currentIndex(0) {}
+    MagicalContainer::AscendingIterator::AscendingIterator(ariel::MagicalContainer &container) : container(&container),
+                                                                                                 currentIndex(0) {
+        MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+    }
 
 /**
  * @brief Copy constructor of AscendingIterator object.
@@ -133,6 +1600,9 @@ namespace ariel {
     .container),
     currentIndex(other
     .currentIndex) {
+    if (this->container != nullptr) {
+        MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+    }
 }
 
 /**
@@ -142,18 +1612,20 @@ MagicalContainer::AscendingIterator::~AscendingIterator() {}
 
 /**
 * Assignment operator (=) for the AscendingIterator class.
+* A default-constructed iterator on either side takes the container of the other.
 * @param other The AscendingIterator object to be assigned.
 * @throws std::runtime_error if attempting to assign between iterators of different containers.
 * @return A reference to the current AscendingIterator object after assignment.
 */
 MagicalContainer::AscendingIterator &
 MagicalContainer::AscendingIterator::operator=(const ariel::MagicalContainer::AscendingIterator &other) {
-    if (&container != &other.container) {
+    if (this->container != nullptr && other.container != nullptr && this->container != other.container) {
         throw std::runtime_error("Error: Invalid assignment between iterators");
     }
     if (this == &other) {
         return *this;
     }
+    this->container = other.container;
     this->currentIndex = other.currentIndex;
     return *this;
 }
@@ -200,7 +1672,7 @@ bool MagicalContainer::AscendingIterator::operator<(const ariel::MagicalContaine
  * @return The value of the element at the current index.
  */
 int MagicalContainer::AscendingIterator::operator*() const {
-    return *(this->container.AscendingIter[static_cast<std::vector<int *>::size_type>(this->currentIndex)]);
+    return this->container->ascendingAt(this->currentIndex);
 }
 
 /**
@@ -210,18 +1682,53 @@ int MagicalContainer::AscendingIterator::operator*() const {
  */
 MagicalContainer::AscendingIterator &MagicalContainer::AscendingIterator::operator++() {
     ++currentIndex;
-    if (currentIndex > container.size()) {
+    if (currentIndex > container->size()) {
+        throw std::runtime_error("Error: Iterator out of range");
+    }
+    return *this;
+}
+
+/**
+ * @brief Overloads the pre-decrement operator (--) for the AscendingIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return Reference to the updated AscendingIterator object.
+ */
+MagicalContainer::AscendingIterator &MagicalContainer::AscendingIterator::operator--() {
+    if (currentIndex == 0) {
         throw std::runtime_error("Error: Iterator out of range");
     }
+    --currentIndex;
     return *this;
 }
 
+/**
+ * @brief Overloads the post-increment operator (++) for the AscendingIterator class.
+ * @throws std::runtime_error if the iterator goes out of range.
+ * @return A copy of the iterator from before the increment.
+ */
+MagicalContainer::AscendingIterator MagicalContainer::AscendingIterator::operator++(int) {
+    AscendingIterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+/**
+ * @brief Overloads the post-decrement operator (--) for the AscendingIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return A copy of the iterator from before the decrement.
+ */
+MagicalContainer::AscendingIterator MagicalContainer::AscendingIterator::operator--(int) {
+    AscendingIterator previous = *this;
+    --*this;
+    return previous;
+}
+
 /**
  * @brief Returns an iterator pointing to the beginning of the MagicalContainer.
  * @return An AscendingIterator object pointing to the beginning of the container.
  */
 MagicalContainer::AscendingIterator MagicalContainer::AscendingIterator::begin() const {
-    AscendingIterator beginIter(this->container);
+    AscendingIterator beginIter(*this->container);
     return beginIter;
 }
 
@@ -230,11 +1737,27 @@ MagicalContainer::AscendingIterator MagicalContainer::AscendingIterator::begin()
  * @return An AscendingIterator object pointing to the end of the container.
  */
 MagicalContainer::AscendingIterator MagicalContainer::AscendingIterator::end() const {
-    AscendingIterator it(container);
-    it.currentIndex = container.AscendingIter.size();
+    AscendingIterator it(*container);
+    it.currentIndex = container->size();
     return it;
 }
 
+/**
+ * @brief Returns a reverse iterator that starts at the largest element.
+ * @return A reverse iterator over end().
+ */
+std::reverse_iterator<MagicalContainer::AscendingIterator> MagicalContainer::AscendingIterator::rbegin() const {
+    return std::reverse_iterator<AscendingIterator>(end());
+}
+
+/**
+ * @brief Returns a reverse iterator past the smallest element.
+ * @return A reverse iterator over begin().
+ */
+std::reverse_iterator<MagicalContainer::AscendingIterator> MagicalContainer::AscendingIterator::rend() const {
+    return std::reverse_iterator<AscendingIterator>(begin());
+}
+
 /**
  * @brief Returns the current index of the iterator.
  * @return The current index of the iterator.
@@ -256,7 +1779,7 @@ void MagicalContainer::AscendingIterator::setCurrentIndex(int index) {
  * @return A reference to the MagicalContainer associated with the iterator.
  */
 const MagicalContainer &MagicalContainer::AscendingIterator::getContainer() const {
-    return container;
+    return *container;
 }
 
 
@@ -270,9 +1793,11 @@ const MagicalContainer &MagicalContainer::AscendingIterator::getContainer() cons
  * the start of the iteration.
  * @param container The MagicalContainer object to iterate over.
  */
-MagicalContainer::SideCrossIterator::SideCrossIterator(const ariel::MagicalContainer &container) : container(
-        container), currentIndex(0), startIndex(0), middleIndex(this->container.size() / 2), endIndex(
-        this->container.size() - 1) {}
+MagicalContainer::SideCrossIterator::SideCrossIterator(const ariel::MagicalContainer &container)
+        : container(&container), currentIndex(0), startIndex(0), endIndex(container.size() - 1),
+          middleIndex(container.size() / 2) {
+    MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+}
 
 /**
  * @brief Copy constructor  of a SideCrossIterator object.
@@ -282,7 +1807,11 @@ MagicalContainer::SideCrossIterator::SideCrossIterator(const ariel::MagicalConta
  */
 MagicalContainer::SideCrossIterator::SideCrossIterator(const ariel::MagicalContainer::SideCrossIterator &other)
         : container(other.container), currentIndex(other.currentIndex), startIndex(other.startIndex),
-          middleIndex(other.middleIndex), endIndex(other.endIndex) {}
+          endIndex(other.endIndex), middleIndex(other.middleIndex) {
+    if (this->container != nullptr) {
+        MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+    }
+}
 
 /**
  * @brief Destructor for the SideCrossIterator class.
@@ -292,20 +1821,25 @@ MagicalContainer::SideCrossIterator::~SideCrossIterator() {}
 /**
  * @brief Assignment operator (=) for the SideCrossIterator class.
  * This assignment operator allows for assigning the contents of one SideCrossIterator object to another.
- * It performs a deep copy of the underlying container and current index from the specified other SideCrossIterator object.
+ * It copies the current index and the bounds of the walk from the specified other SideCrossIterator object.
+ * A default-constructed iterator on either side takes the container of the other.
  * @param other The SideCrossIterator object to be assigned.
  * @throws std::runtime_error if attempting to assign between iterators of different containers.
  * @return A reference to the updated SideCrossIterator object.
  */
 MagicalContainer::SideCrossIterator &
 MagicalContainer::SideCrossIterator::operator=(const ariel::MagicalContainer::SideCrossIterator &other) {
-    if (&container != &other.container) {
+    if (this->container != nullptr && other.container != nullptr && this->container != other.container) {
         throw std::runtime_error("Error: Invalid assignment between iterators");
     }
     if (this == &other) {
         return *this;
     }
+    this->container = other.container;
     this->currentIndex = other.currentIndex;
+    this->startIndex = other.startIndex;
+    this->endIndex = other.endIndex;
+    this->middleIndex = other.middleIndex;
     return *this;
 }
 
@@ -352,11 +1886,11 @@ bool MagicalContainer::SideCrossIterator::operator<(const SideCrossIterator &oth
  * @return Reference to the updated SideCrossIterator object.
  */
 MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operator++() {
-    if (currentIndex == container.size()) {
+    if (currentIndex == container->size()) {
         throw std::runtime_error("Error: Iterator out of range");
     }
     if (this->currentIndex == middleIndex) {
-        setCurrentIndex(this->container.size());
+        setCurrentIndex(this->container->size());
     } else if (this->currentIndex < middleIndex) {
         setCurrentIndex(endIndex);
         endIndex--;
@@ -367,12 +1901,87 @@ MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operat
     return *this;
 }
 
+/**
+ * @brief Get the position of the iterator in the side-cross order, from its indices.
+ * The element at an even position 2k was taken from the front, so it is startIndex; the element at an odd
+ * position 2k + 1 was taken from the back, so it is size() - 1 - k.
+ * @return The position, or size() at the end.
+ */
+int MagicalContainer::SideCrossIterator::position() const {
+    const int count = container->size();
+    if (currentIndex == count) {
+        return count;
+    }
+    if (currentIndex == startIndex) {
+        return 2 * startIndex;
+    }
+    return 2 * (count - 1 - currentIndex) + 1;
+}
+
+/**
+ * @brief Moves the iterator to a position of the side-cross order, setting the indices exactly as that
+ * many increments from the beginning would.
+ * @param position The position, in [0, size()].
+ */
+void MagicalContainer::SideCrossIterator::seek(int position) {
+    const int count = container->size();
+    if (position == count) {
+        currentIndex = count;
+        return;
+    }
+    startIndex = position / 2;
+    if (position % 2 == 0) {
+        endIndex = count - 1 - position / 2;
+        currentIndex = startIndex;
+    } else {
+        currentIndex = count - 1 - position / 2;
+        endIndex = currentIndex - 1;
+    }
+}
+
+/**
+ * @brief Overloads the pre-decrement operator (--) for the SideCrossIterator class.
+ * The previous position is computed from the current one, so stepping back costs the same as stepping forward.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return Reference to the updated SideCrossIterator object.
+ */
+MagicalContainer::SideCrossIterator &MagicalContainer::SideCrossIterator::operator--() {
+    const int current = position();
+    if (current == 0) {
+        throw std::runtime_error("Error: Iterator out of range");
+    }
+    seek(current - 1);
+    return *this;
+}
+
+/**
+ * @brief Overloads the post-increment operator (++) for the SideCrossIterator class.
+ * @throws std::runtime_error if the iterator goes out of range.
+ * @return A copy of the iterator from before the increment.
+ */
+MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::operator++(int) {
+    SideCrossIterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+/**
+ * @brief Overloads the post-decrement operator (--) for the SideCrossIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return A copy of the iterator from before the decrement.
+ */
+MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::operator--(int) {
+    SideCrossIterator previous = *this;
+    --*this;
+    return previous;
+}
+
 /**
  * @brief Overloads the dereference operator (*) for the SideCrossIterator class.
  * @return The value of the element at the current index.
  */
 int MagicalContainer::SideCrossIterator::operator*() const {
-    return *(this->container.CrossSideIter[static_cast<std::vector<int *>::size_type>(this->currentIndex)]);
+    return this->container->crossAt(this->currentIndex);
 }
 
 
@@ -381,7 +1990,7 @@ int MagicalContainer::SideCrossIterator::operator*() const {
  * @return An SideCrossIterator object pointing to the beginning of the container.
  */
 MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::begin() const {
-    MagicalContainer::SideCrossIterator beginIter(this->container);
+    MagicalContainer::SideCrossIterator beginIter(*this->container);
     return beginIter;
 }
 
@@ -390,11 +1999,27 @@ MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::begin()
  * @return An SideCrossIterator object pointing to the end of the container.
  */
 MagicalContainer::SideCrossIterator MagicalContainer::SideCrossIterator::end() const {
-    MagicalContainer::SideCrossIterator it(this->container);
-    it.currentIndex = container.CrossSideIter.size();
+    MagicalContainer::SideCrossIterator it(*this->container);
+    it.currentIndex = container->size();
     return it;
 }
 
+/**
+ * @brief Returns a reverse iterator that starts at the last element of the side-cross order.
+ * @return A reverse iterator over end().
+ */
+std::reverse_iterator<MagicalContainer::SideCrossIterator> MagicalContainer::SideCrossIterator::rbegin() const {
+    return std::reverse_iterator<SideCrossIterator>(end());
+}
+
+/**
+ * @brief Returns a reverse iterator past the first element of the side-cross order.
+ * @return A reverse iterator over begin().
+ */
+std::reverse_iterator<MagicalContainer::SideCrossIterator> MagicalContainer::SideCrossIterator::rend() const {
+    return std::reverse_iterator<SideCrossIterator>(begin());
+}
+
 /**
  * @brief Getter of the field current index of the SideCrossIterator class.
  * @return The current index of the SideCrossIterator.
@@ -416,7 +2041,7 @@ void MagicalContainer::SideCrossIterator::setCurrentIndex(int index) {
  * @return A reference to the MagicalContainer object.
  */
 const MagicalContainer &MagicalContainer::SideCrossIterator::getContainer() const {
-    return container;
+    return *container;
 }
 
 
@@ -428,15 +2053,21 @@ const MagicalContainer &MagicalContainer::SideCrossIterator::getContainer() cons
  * @brief Constructor of a PrimeIterator object for the PrimeIterator class.
  * @param container The MagicalContainer to iterate over.
  */
-MagicalContainer::PrimeIterator::PrimeIterator(const ariel::MagicalContainer &container) : container(container),
-                                                                                           currentIndex(0) {}
+MagicalContainer::PrimeIterator::PrimeIterator(const ariel::MagicalContainer &container) : container(&container),
+                                                                                           currentIndex(0) {
+    MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+}
 
 /**
  * @brief Copy constructor of PrimeIterator object.
  * @param other The PrimeIterator object to copy from.
  */
 MagicalContainer::PrimeIterator::PrimeIterator(const ariel::MagicalContainer::PrimeIterator &other) : container(
-        other.container), currentIndex(other.currentIndex) {}
+        other.container), currentIndex(other.currentIndex) {
+    if (this->container != nullptr) {
+        MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+    }
+}
 
 /**
  * @brief Destructor for the PrimeIterator object.
@@ -445,18 +2076,20 @@ MagicalContainer::PrimeIterator::~PrimeIterator() {}
 
 /**
  * @brief Assignment operator (=) for the PrimeIterator class.
+ * A default-constructed iterator on either side takes the container of the other.
  * @param other The PrimeIterator object to be assigned.
  * @throws std::runtime_error if attempting to assign between iterators of different containers.
  * @return A reference to the current PrimeIterator object after assignment.
  */
 MagicalContainer::PrimeIterator &
 MagicalContainer::PrimeIterator::operator=(const ariel::MagicalContainer::PrimeIterator &other) {
-    if (&container != &other.container) {
+    if (this->container != nullptr && other.container != nullptr && this->container != other.container) {
         throw std::runtime_error("Error: Invalid assignment between iterators");
     }
     if (this == &other) {
         return *this;
     }
+    this->container = other.container;
     this->currentIndex = other.currentIndex;
     return *this;
 }
@@ -504,18 +2137,53 @@ bool MagicalContainer::PrimeIterator::operator<(const PrimeIterator &other) cons
  */
 MagicalContainer::PrimeIterator &MagicalContainer::PrimeIterator::operator++() {
     ++currentIndex;
-    if (currentIndex > container.PrimeIter.size()) {
+    if (currentIndex > container->primeCount()) {
+        throw std::runtime_error("Error: Iterator out of range");
+    }
+    return *this;
+}
+
+/**
+ * @brief Overloads the pre-decrement operator (--) for the PrimeIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return Reference to the updated PrimeIterator object.
+ */
+MagicalContainer::PrimeIterator &MagicalContainer::PrimeIterator::operator--() {
+    if (currentIndex == 0) {
         throw std::runtime_error("Error: Iterator out of range");
     }
+    --currentIndex;
     return *this;
 }
 
+/**
+ * @brief Overloads the post-increment operator (++) for the PrimeIterator class.
+ * @throws std::runtime_error if the iterator goes out of range.
+ * @return A copy of the iterator from before the increment.
+ */
+MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::operator++(int) {
+    PrimeIterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+/**
+ * @brief Overloads the post-decrement operator (--) for the PrimeIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return A copy of the iterator from before the decrement.
+ */
+MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::operator--(int) {
+    PrimeIterator previous = *this;
+    --*this;
+    return previous;
+}
+
 /**
  * @brief Overloads the dereference operator (*) for the PrimeIterator class.
  * @return The value of the element at the current index.
  */
 int MagicalContainer::PrimeIterator::operator*() const {
-    return *(this->container.PrimeIter[static_cast<std::vector<int *>::size_type>(this->currentIndex)]);
+    return this->container->primeAt(this->currentIndex);
 }
 
 
@@ -524,7 +2192,7 @@ int MagicalContainer::PrimeIterator::operator*() const {
  * @return A PrimeIterator object pointing to the beginning of the container.
  */
 MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::begin() const {
-    PrimeIterator beginIter(container);
+    PrimeIterator beginIter(*container);
     beginIter.setCurrentIndex(0);
     return beginIter;
 }
@@ -534,11 +2202,27 @@ MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::begin() const {
  * @return A PrimeIterator object pointing to the end of the container.
  */
 MagicalContainer::PrimeIterator MagicalContainer::PrimeIterator::end() const {
-    PrimeIterator it(container);
-    it.currentIndex = container.PrimeIter.size();
+    PrimeIterator it(*container);
+    it.currentIndex = container->primeCount();
     return it;
 }
 
+/**
+ * @brief Returns a reverse iterator that starts at the largest prime element.
+ * @return A reverse iterator over end().
+ */
+std::reverse_iterator<MagicalContainer::PrimeIterator> MagicalContainer::PrimeIterator::rbegin() const {
+    return std::reverse_iterator<PrimeIterator>(end());
+}
+
+/**
+ * @brief Returns a reverse iterator past the smallest prime element.
+ * @return A reverse iterator over begin().
+ */
+std::reverse_iterator<MagicalContainer::PrimeIterator> MagicalContainer::PrimeIterator::rend() const {
+    return std::reverse_iterator<PrimeIterator>(begin());
+}
+
 /**
  * @brief Get the current index of the iterator.
  * @return The current index of the iterator.
@@ -560,7 +2244,203 @@ void MagicalContainer::PrimeIterator::setCurrentIndex(int index) {
  * @return A const reference to the MagicalContainer object.
  */
 const MagicalContainer &MagicalContainer::PrimeIterator::getContainer() const {
-    return container;
+    return *container;
+}
+
+
+/// Implementation of the DescendingIterator class.
+
+
+/**
+ * @brief Constructor of a DescendingIterator object for the given MagicalContainer.
+ * @param container The MagicalContainer to iterate over.
+ */
+MagicalContainer::DescendingIterator::DescendingIterator(const ariel::MagicalContainer &container)
+        : container(&container), currentIndex(0) {
+    MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+}
+
+/**
+ * @brief Copy constructor of DescendingIterator object.
+ * @param other The DescendingIterator object to copy from.
+ */
+MagicalContainer::DescendingIterator::DescendingIterator(const ariel::MagicalContainer::DescendingIterator &other)
+        : container(other.container), currentIndex(other.currentIndex) {
+    if (this->container != nullptr) {
+        MAGICAL_STATS_COUNT(this->container->statistics, iteratorConstructions, 1U);
+    }
+}
+
+/**
+ * @brief Destructor for the DescendingIterator object.
+ */
+MagicalContainer::DescendingIterator::~DescendingIterator() {}
+
+/**
+ * @brief Assignment operator (=) for the DescendingIterator class.
+ * A default-constructed iterator on either side takes the container of the other.
+ * @param other The DescendingIterator object to be assigned.
+ * @throws std::runtime_error if attempting to assign between iterators of different containers.
+ * @return A reference to the current DescendingIterator object after assignment.
+ */
+MagicalContainer::DescendingIterator &
+MagicalContainer::DescendingIterator::operator=(const ariel::MagicalContainer::DescendingIterator &other) {
+    if (this->container != nullptr && other.container != nullptr && this->container != other.container) {
+        throw std::runtime_error("Error: Invalid assignment between iterators");
+    }
+    this->container = other.container;
+    this->currentIndex = other.currentIndex;
+    return *this;
+}
+
+/**
+ * @brief Overloads the equality comparison operator (==) for the DescendingIterator class.
+ * @param other The DescendingIterator object to compare with.
+ * @return true if the currentIndex values are equal, false otherwise.
+ */
+bool MagicalContainer::DescendingIterator::operator==(const DescendingIterator &other) const {
+    return this->currentIndex == other.currentIndex;
+}
+
+/**
+ * @brief Overloads the inequality comparison operator (!=) for the DescendingIterator class.
+ * @param other The DescendingIterator object to compare with.
+ * @return true if the currentIndex values are not equal, false otherwise.
+ */
+bool MagicalContainer::DescendingIterator::operator!=(const DescendingIterator &other) const {
+    return !(*this == other);
+}
+
+/**
+ * @brief Overloads the greater than (GT) comparison operator (>) for the DescendingIterator class.
+ * @param other The DescendingIterator object to compare with.
+ * @return true if the currentIndex value of the current object is greater than the currentIndex value of the other object, false otherwise.
+ */
+bool MagicalContainer::DescendingIterator::operator>(const DescendingIterator &other) const {
+    return (this->currentIndex > other.currentIndex);
+}
+
+/**
+ * @brief Overloads the less than (LT) comparison operator (<) for the DescendingIterator class.
+ * @param other The DescendingIterator object to compare with.
+ * @return true if the currentIndex value of the current object is less than the currentIndex value of the other object, false otherwise.
+ */
+bool MagicalContainer::DescendingIterator::operator<(const DescendingIterator &other) const {
+    return (this->currentIndex < other.currentIndex);
+}
+
+/**
+ * @brief Overloads the pre-increment operator (++) for the DescendingIterator class.
+ * @throws std::runtime_error if the iterator goes out of range.
+ * @return Reference to the updated DescendingIterator object.
+ */
+MagicalContainer::DescendingIterator &MagicalContainer::DescendingIterator::operator++() {
+    ++currentIndex;
+    if (currentIndex > container->size()) {
+        throw std::runtime_error("Error: Iterator out of range");
+    }
+    return *this;
+}
+
+/**
+ * @brief Overloads the pre-decrement operator (--) for the DescendingIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return Reference to the updated DescendingIterator object.
+ */
+MagicalContainer::DescendingIterator &MagicalContainer::DescendingIterator::operator--() {
+    if (currentIndex == 0) {
+        throw std::runtime_error("Error: Iterator out of range");
+    }
+    --currentIndex;
+    return *this;
+}
+
+/**
+ * @brief Overloads the post-increment operator (++) for the DescendingIterator class.
+ * @throws std::runtime_error if the iterator goes out of range.
+ * @return A copy of the iterator from before the increment.
+ */
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::operator++(int) {
+    DescendingIterator previous = *this;
+    ++*this;
+    return previous;
+}
+
+/**
+ * @brief Overloads the post-decrement operator (--) for the DescendingIterator class.
+ * @throws std::runtime_error if the iterator is already at the beginning.
+ * @return A copy of the iterator from before the decrement.
+ */
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::operator--(int) {
+    DescendingIterator previous = *this;
+    --*this;
+    return previous;
+}
+
+/**
+ * @brief Overloads the dereference operator (*) for the DescendingIterator class.
+ * @return The value of the element at the current index of the descending order.
+ */
+int MagicalContainer::DescendingIterator::operator*() const {
+    return this->container->descendingAt(this->currentIndex);
+}
+
+/**
+ * @brief Returns an iterator pointing to the largest element of the MagicalContainer.
+ * @return A DescendingIterator object pointing to the beginning of the descending order.
+ */
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::begin() const {
+    return DescendingIterator(*container);
+}
+
+/**
+ * @brief Returns an iterator pointing to the end of the descending order.
+ * @return A DescendingIterator object pointing past the smallest element.
+ */
+MagicalContainer::DescendingIterator MagicalContainer::DescendingIterator::end() const {
+    DescendingIterator it(*container);
+    it.currentIndex = container->size();
+    return it;
+}
+
+/**
+ * @brief Returns a reverse iterator that starts at the smallest element.
+ * @return A reverse iterator over end().
+ */
+std::reverse_iterator<MagicalContainer::DescendingIterator> MagicalContainer::DescendingIterator::rbegin() const {
+    return std::reverse_iterator<DescendingIterator>(end());
+}
+
+/**
+ * @brief Returns a reverse iterator past the largest element.
+ * @return A reverse iterator over begin().
+ */
+std::reverse_iterator<MagicalContainer::DescendingIterator> MagicalContainer::DescendingIterator::rend() const {
+    return std::reverse_iterator<DescendingIterator>(begin());
+}
+
+/**
+ * @brief Get the current index of the iterator.
+ * @return The current index of the iterator.
+ */
+int MagicalContainer::DescendingIterator::getCurrentIndex() const {
+    return this->currentIndex;
+}
+
+/**
+ * @brief Set the current index of the iterator.
+ * @param index The index to set as the current index of the iterator.
+ */
+void MagicalContainer::DescendingIterator::setCurrentIndex(int index) {
+    currentIndex = index;
+}
+
+/**
+ * @brief Get the container being iterated over.
+ * @return A const reference to the MagicalContainer object.
+ */
+const MagicalContainer &MagicalContainer::DescendingIterator::getContainer() const {
+    return *container;
 }
 
-}
\ No newline at end of file
+}
@@ -15,27 +15,223 @@
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <iterator>
+#include <optional>
 #include <stdexcept>
+#include <span>
+#include <string>
+#include <utility>
+#include "CowPtr.hpp"
+#include "EytzingerIndex.hpp"
+#include "Export.hpp"
+#include "FrozenStorage.hpp"
+#include "Generator.hpp"
+#include "Ingest.hpp"
+#include "LazyCache.hpp"
+#include "MemoryUsage.hpp"
+#include "PageAllocator.hpp"
+#include "PrefixSumIndex.hpp"
+#include "RoaringBitmap.hpp"
+#include "SetKernel.hpp"
+#include "Snapshot.hpp"
+#include "Stats.hpp"
+#include "ThreadPool.hpp"
+#include "ValueHistogram.hpp"
 
 namespace ariel {
 
+    enum class FilterStrategy;
+
+    /// The default number of elements forEachChunk() hands out at a time: 4 KiB of ints, well inside L1.
+    constexpr std::size_t DefaultChunkSize = 1U << 10U;
+
+    template<typename Predicate, FilterStrategy Strategy>
+    class FilteredView;
+
     class MagicalContainer {
+    public:
+
+/**
+ * @brief The storage backends a MagicalContainer can use.
+ * Vector keeps a sorted std::vector<int> with materialized pointer views. Bitmap keeps a Roaring-style
+ * compressed bitmap and serves the views through rank/select, which suits dense ranges of values.
+ * Frozen is a read-only, block-compressed copy of the sorted elements for cold data. Mapped is a
+ * read-only snapshot file mapped into memory by mapFromFile().
+ */
+        enum class Storage {
+            Vector, Bitmap, Frozen, Mapped
+        };
+
+/**
+ * @brief The orders a MagicalContainer can be traversed in, matching its three iterators.
+ */
+        enum class View {
+            Ascending, SideCross, Prime
+        };
+
     private:
 
-        std::vector<int> elements;
-        std::vector<int *> PrimeIter;
-        std::vector<int *> AscendingIter;
-        std::vector<int *> CrossSideIter;
+        template<typename Predicate, FilterStrategy Strategy>
+        friend class FilteredView;
+
+        Storage storage = Storage::Vector;
+
+/**
+ * @struct VectorCore
+ * @brief The sorted elements of the vector backend and their pointer views. Copies of a container share one
+ * core through a CowPtr and the first change copies it, so a copy is O(1). Copying a core rebases its pointer
+ * views onto the copy's own elements. A core holds no caches, so a shared core is never written to; the
+ * caches derived from it live in the container. The elements and the views are allocated under the
+ * container's page policy.
+ */
+        using ElementArray = std::vector<int, PageAllocator<int>>;
+        using ViewArray = std::vector<int *, PageAllocator<int *>>;
+
+        struct VectorCore {
+            ElementArray elements;
+            ViewArray PrimeIter;
+            ViewArray AscendingIter;
+            ViewArray CrossSideIter;
+
+            VectorCore() = default;
+
+            explicit VectorCore(const PagePolicy &policy);
+
+            VectorCore(const VectorCore &other);
+
+            VectorCore &operator=(const VectorCore &other) = delete;
+
+            void relocate(std::size_t capacity);
+
+            void shrinkToFit();
+        };
+
+/**
+ * @struct PrimeMemo
+ * @brief The primality of the elements with lazy views, classified one 64-element block at a time by the
+ * queries that reach it. Blocks are published with atomic stores, so queries on several threads may fill the
+ * memo at once; threads classifying the same block store the same bits.
+ */
+        struct PrimeMemo {
+            mutable std::vector<std::atomic<std::uint64_t>> words;
+            mutable std::vector<std::atomic<std::uint8_t>> known;
+
+            explicit PrimeMemo(std::size_t blocks);
+
+            explicit PrimeMemo(const std::vector<std::uint64_t> &flags);
+        };
+
+        CowPtr<VectorCore> core;
+
+        bool lazyViews = false;
+        bool searchIndexEnabled = false;
+        PagePolicy pagePolicy;
+
+        LazyCache<PrimeMemo> primeMemo;
+        LazyCache<std::vector<std::uint32_t>> lazyPrimePositions;
+        LazyCache<EytzingerIndex> searchIndex;
+
+        LazyCache<PrefixSumIndex> aggregateIndex;
+        bool aggregateIndexEnabled = false;
+
+        std::optional<ValueHistogram> valueHistogram;
+
+        RoaringBitmap bitmap;
+        LazyCache<RoaringBitmap> primeBitmap;
+
+        FrozenStorage frozen;
+        FrozenStorage frozenPrimes;
+
+        MappedSnapshot snapshot;
+
+#ifdef MAGICAL_STATS
+        mutable ContainerStats statistics;
+#endif
 
         bool isPrime(int num) const;
 
+        void adoptElements(std::span<const int> values);
+
+        void rebuildViews();
+
+        void rebuildViews(const std::vector<std::uint64_t> &primes);
+
+        const RoaringBitmap &primeView() const;
+
+        int ascendingAt(int index) const;
+
+        int descendingAt(int index) const;
+
+        int crossAt(int index) const;
+
+        int primeAt(int index) const;
+
+        void requireMutable() const;
+
+        std::size_t storageBytes() const;
+
+        const PrimeMemo &memo() const;
+
+        bool isPrimeElement(std::size_t index) const;
+
+        const std::vector<std::uint32_t> &primePositions() const;
+
+        std::vector<std::uint64_t> primeFlags(std::span<const int> sorted) const;
+
+        MagicalContainer combineWith(const MagicalContainer &other, SetOperation operation) const;
+
+        std::pair<std::size_t, std::size_t> positionRange(int low, int high) const;
+
+        std::pair<std::size_t, std::size_t> primeRange(int low, int high) const;
+
+        const PrefixSumIndex &aggregates() const;
+
+        void refillHistogram();
+
+        std::span<const int> viewValues(View view, std::vector<int> &scratch) const;
+
+        std::span<const int> contiguousElements() const;
+
+        void gatherChunk(View view, std::size_t first, std::size_t count, int *out) const;
+
+/**
+ * @brief Calls fn on the elements at positions [begin, end) of a view.
+ * @param view The view.
+ * @param values What viewValues() returned for the view.
+ * @param begin The first position.
+ * @param end One past the last position.
+ * @param fn The function to call with each element.
+ */
+        template<typename Function>
+        void visitRange(View view, std::span<const int> values, std::size_t begin, std::size_t end,
+                        Function &fn) const {
+            if (view == View::Prime && this->storage == Storage::Vector && !this->lazyViews) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    fn(*this->core->PrimeIter[i]);
+                }
+            } else if (view == View::SideCross) {
+                const std::size_t last = values.size() - 1;
+                for (std::size_t position = begin; position < end; ++position) {
+                    fn(values[position % 2 == 0 ? position / 2 : last - position / 2]);
+                }
+            } else {
+                for (std::size_t i = begin; i < end; ++i) {
+                    fn(values[i]);
+                }
+            }
+        }
+
     public:
 
         MagicalContainer() = default;
 
+        explicit MagicalContainer(Storage storage);
+
         ~MagicalContainer() = default;
 
+        /// Shares the storage of other; whichever container changes first copies the part it changes.
         MagicalContainer(const MagicalContainer &other) = default;
 
         MagicalContainer &operator=(const MagicalContainer &other) = default;
@@ -52,33 +248,252 @@ namespace ariel {
 
         void addElement(int element);
 
+        void addElements(std::span<const int> newElements);
+
         void removeElement(int element);
 
         int size() const;
 
+        int primeCount() const;
+
         std::vector<int> getElements() const;
 
         int getElement(int index) const;
 
         void setElements(const std::vector<int> &newElements);
 
+        MagicalContainer unionWith(const MagicalContainer &other) const;
+
+        MagicalContainer intersectWith(const MagicalContainer &other) const;
+
+        MagicalContainer differenceWith(const MagicalContainer &other) const;
+
+        MagicalContainer symmetricDifference(const MagicalContainer &other) const;
+
+        bool contains(int element) const;
+
+        int lowerBound(int element) const;
+
+        int kth(int k) const;
+
+        int rank(int element) const;
+
+        int percentile(double p) const;
+
+        double median() const;
+
+        int kthPrime(int k) const;
+
+        int primeRank(int element) const;
+
+        int count(int low, int high) const;
+
+        long long sum(int low, int high) const;
+
+        double mean(int low, int high) const;
+
+        int primeCount(int low, int high) const;
+
+        long long primeSum(int low, int high) const;
+
+        double primeMean(int low, int high) const;
+
+        void setSearchIndex(bool enabled);
+
+        bool hasSearchIndex() const;
+
+        void setAggregateIndex(bool enabled);
+
+        bool hasAggregateIndex() const;
+
+        void setHistogram(const ValueHistogram &layout);
+
+        void clearHistogram();
+
+        bool hasHistogram() const;
+
+        const ValueHistogram &histogram() const;
+
+        Storage getStorage() const;
+
+        void setStorage(Storage newStorage);
+
+        void optimizeStorage();
+
+        MemoryUsage memoryUsage() const;
+
+        void reserve(std::size_t capacity);
+
+        void shrinkToFit();
+
+        void setPagePolicy(const PagePolicy &policy);
+
+        const PagePolicy &getPagePolicy() const;
+
+        void freeze();
+
+        bool isFrozen() const;
+
+        void save(const std::string &path) const;
+
+        static MagicalContainer mapFromFile(const std::string &path, bool verify = false);
+
+        IngestStats ingestFd(int fd, std::size_t batchSize = DefaultIngestBatch);
+
+        IngestStats ingestFile(const std::string &path, std::size_t batchSize = DefaultIngestBatch);
+
+        std::size_t writeAscending(IntegerWriter &writer) const;
+
+        std::size_t writeSideCross(IntegerWriter &writer) const;
+
+        std::size_t materializeSideCross(std::span<int> out) const;
+
+        std::size_t writePrimes(IntegerWriter &writer) const;
+
+        void setLazyViews(bool lazy);
+
+        bool hasLazyViews() const;
+
+        Generator<int> sideCross() const;
+
+        Generator<int> primes() const;
+
+        std::size_t viewSize(View view) const;
+
+/**
+ * @brief Calls fn on every element of a view, spreading chunks of grain consecutive positions over a
+ * work-stealing pool. fn may run concurrently and in any order, so it must be thread-safe.
+ * Backends other than Vector and Mapped keep caches that are not safe to share between threads, so their
+ * view is materialized once before the parallel part.
+ * @param view The view to traverse.
+ * @param fn A function taking an int.
+ * @param grain The number of positions per chunk.
+ * @param pool The pool to run on.
+ * @throws The first exception thrown by fn.
+ */
+        template<typename Function>
+        void parallelForEach(View view, Function fn, std::size_t grain = DefaultParallelGrain,
+                             ThreadPool &pool = ThreadPool::shared()) const {
+            std::vector<int> scratch;
+            const std::span<const int> values = viewValues(view, scratch);
+            const std::size_t count = viewSize(view);
+            grain = std::max<std::size_t>(grain, 1);
+            pool.parallelChunks((count + grain - 1) / grain, [&](std::size_t chunk) {
+                Function local = fn;
+                visitRange(view, values, chunk * grain, std::min(count, (chunk + 1) * grain), local);
+            });
+        }
+
+/**
+ * @brief Reduces a view in parallel: every chunk of grain positions is folded on its own, and the
+ * partial results are then combined in view order, so reduce only needs to be associative.
+ * @param view The view to reduce.
+ * @param identity The identity of reduce.
+ * @param reduce A function combining two T values.
+ * @param transform A function mapping an element to T.
+ * @param grain The number of positions per chunk.
+ * @param pool The pool to run on.
+ * @return The reduction of transform over the view, or identity if it is empty.
+ * @throws The first exception thrown by reduce or transform.
+ */
+        template<typename T, typename Reduce, typename Transform>
+        T parallelReduce(View view, T identity, Reduce reduce, Transform transform,
+                         std::size_t grain = DefaultParallelGrain, ThreadPool &pool = ThreadPool::shared()) const {
+            std::vector<int> scratch;
+            const std::span<const int> values = viewValues(view, scratch);
+            const std::size_t count = viewSize(view);
+            grain = std::max<std::size_t>(grain, 1);
+            std::vector<T> partial((count + grain - 1) / grain, identity);
+            pool.parallelChunks(partial.size(), [&](std::size_t chunk) {
+                T accumulator = identity;
+                auto fold = [&](int element) {
+                    accumulator = reduce(std::move(accumulator), transform(element));
+                };
+                visitRange(view, values, chunk * grain, std::min(count, (chunk + 1) * grain), fold);
+                partial[chunk] = std::move(accumulator);
+            });
+            T result = std::move(identity);
+            for (T &value: partial) {
+                result = reduce(std::move(result), std::move(value));
+            }
+            return result;
+        }
+
+/**
+ * @brief Hands a view to fn in consecutive blocks of up to chunkSize elements, in view order.
+ * Ascending blocks of the vector and mapped backends point straight into the sorted storage; every other
+ * block is gathered into one buffer of chunkSize elements that is reused for the next block, so a span is
+ * only valid until fn returns. The bitmap backend fills that buffer in one pass over its chunks. The
+ * container must not change during the traversal.
+ * @param view The view to traverse.
+ * @param fn A function taking `std::span<const int>`.
+ * @param chunkSize The largest number of elements per block.
+ */
+        template<typename Function>
+        void forEachChunk(View view, Function fn, std::size_t chunkSize = DefaultChunkSize) const {
+            chunkSize = std::max<std::size_t>(chunkSize, 1);
+            const std::size_t count = viewSize(view);
+            const std::span<const int> sorted = contiguousElements();
+            if (view == View::Ascending && sorted.size() == count) {
+                for (std::size_t first = 0; first < count; first += chunkSize) {
+                    fn(sorted.subspan(first, std::min(chunkSize, count - first)));
+                }
+                return;
+            }
+            std::vector<int> buffer(std::min(chunkSize, count));
+            if (view == View::Ascending && this->storage == Storage::Bitmap) {
+                std::size_t length = 0;
+                this->bitmap.forEach([&](int element) {
+                    buffer[length++] = element;
+                    if (length == buffer.size()) {
+                        fn(std::span<const int>(buffer));
+                        length = 0;
+                    }
+                });
+                if (length != 0) {
+                    fn(std::span<const int>(buffer.data(), length));
+                }
+                return;
+            }
+            for (std::size_t first = 0; first < count; first += chunkSize) {
+                const std::size_t length = std::min(chunkSize, count - first);
+                gatherChunk(view, first, length, buffer.data());
+                fn(std::span<const int>(buffer.data(), length));
+            }
+        }
+
+        ContainerStats stats() const;
+
+        void resetStats();
+
 /**
  * @class AscendingIterator
  * @brief An iterator that allows iterating over the elements of a MagicalContainer in ascending order.
  * The AscendingIterator class provides functionality to iterate over the elements of a MagicalContainer
  * in ascending order. It keeps track of the current index within the container and provides comparison
  * operators to compare iterators and perform iteration operations.
+ * All four iterators model std::bidirectional_iterator. They dereference to a value rather than a reference,
+ * since the compressed backends hold no int to refer to, so their classic iterator_category is only input.
  * @author Tomer Gozlan
  * @date 06/06/2023
  */
         class AscendingIterator {
         private:
 
-            MagicalContainer &container;
-            int currentIndex;
+            MagicalContainer *container = nullptr;
+            int currentIndex = 0;
 
         public:
 
+            using iterator_concept = std::bidirectional_iterator_tag;
+            using iterator_category = std::input_iterator_tag;
+            using value_type = int;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = int;
+
+            AscendingIterator() = default;
+
             AscendingIterator(MagicalContainer &container);
 
             AscendingIterator(const AscendingIterator &other)
@@ -89,15 +504,10 @@ namespace ariel {
 
             AscendingIterator &operator=(const AscendingIterator &other);
 
-            AscendingIterator(AscendingIterator &&other)
+            AscendingIterator(AscendingIterator &&other) noexcept = default;
 
-            noexcept : container(other.container), currentIndex(other
-            .currentIndex) {}
-
-            AscendingIterator &operator=(AscendingIterator &&other)
-
-            noexcept {
-                return *this;
+            AscendingIterator &operator=(AscendingIterator &&other) {
+                return *this = other;
             }
 
             bool operator==(const AscendingIterator &other) const;
@@ -110,12 +520,22 @@ namespace ariel {
 
             AscendingIterator &operator++();
 
+            AscendingIterator &operator--();
+
+            AscendingIterator operator++(int);
+
+            AscendingIterator operator--(int);
+
             int operator*() const;
 
             AscendingIterator begin() const;
 
             AscendingIterator end() const;
 
+            std::reverse_iterator<AscendingIterator> rbegin() const;
+
+            std::reverse_iterator<AscendingIterator> rend() const;
+
             int getCurrentIndex() const;
 
             void setCurrentIndex(int index);
@@ -137,14 +557,27 @@ namespace ariel {
 
         private:
 
-            const MagicalContainer &container;
-            int currentIndex;
-            int startIndex;
-            int endIndex;
-            int middleIndex;
+            const MagicalContainer *container = nullptr;
+            int currentIndex = 0;
+            int startIndex = 0;
+            int endIndex = 0;
+            int middleIndex = 0;
+
+            int position() const;
+
+            void seek(int position);
 
         public:
 
+            using iterator_concept = std::bidirectional_iterator_tag;
+            using iterator_category = std::input_iterator_tag;
+            using value_type = int;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = int;
+
+            SideCrossIterator() = default;
+
             SideCrossIterator(const MagicalContainer &container);
 
             SideCrossIterator(const SideCrossIterator &other);
@@ -153,22 +586,11 @@ namespace ariel {
 
             SideCrossIterator &operator=(const SideCrossIterator &other);
 
-            SideCrossIterator &operator=(SideCrossIterator &&other)
-
-            noexcept {
-                return *this;
+            SideCrossIterator &operator=(SideCrossIterator &&other) {
+                return *this = other;
             }
 
-            SideCrossIterator(SideCrossIterator &&other)
-
-            noexcept : container(other.container), currentIndex(other
-            .currentIndex),
-            startIndex(other
-            .startIndex),
-            middleIndex(other
-            .middleIndex),
-            endIndex(other
-            .endIndex){}
+            SideCrossIterator(SideCrossIterator &&other) noexcept = default;
 
             bool operator==(const SideCrossIterator &other) const;
 
@@ -180,12 +602,22 @@ namespace ariel {
 
             SideCrossIterator &operator++();
 
+            SideCrossIterator &operator--();
+
+            SideCrossIterator operator++(int);
+
+            SideCrossIterator operator--(int);
+
             int operator*() const;
 
             SideCrossIterator begin() const;
 
             SideCrossIterator end() const;
 
+            std::reverse_iterator<SideCrossIterator> rbegin() const;
+
+            std::reverse_iterator<SideCrossIterator> rend() const;
+
             int getCurrentIndex() const;
 
             void setCurrentIndex(int index);
@@ -206,10 +638,20 @@ namespace ariel {
 
         class PrimeIterator {
         private:
-            const MagicalContainer &container;
-            int currentIndex;
+            const MagicalContainer *container = nullptr;
+            int currentIndex = 0;
 
         public:
+
+            using iterator_concept = std::bidirectional_iterator_tag;
+            using iterator_category = std::input_iterator_tag;
+            using value_type = int;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = int;
+
+            PrimeIterator() = default;
+
             PrimeIterator(const MagicalContainer &container);
 
             PrimeIterator(const PrimeIterator &other);
@@ -218,16 +660,11 @@ namespace ariel {
 
             PrimeIterator &operator=(const PrimeIterator &other);
 
-            PrimeIterator &operator=(PrimeIterator &&other)
-
-            noexcept {
-                return *this;
+            PrimeIterator &operator=(PrimeIterator &&other) {
+                return *this = other;
             }
 
-            PrimeIterator(PrimeIterator &&other)
-
-            noexcept: container(other.container), currentIndex(other
-            .currentIndex) {}
+            PrimeIterator(PrimeIterator &&other) noexcept = default;
 
             bool operator==(const PrimeIterator &other) const;
 
@@ -243,12 +680,87 @@ namespace ariel {
 
             PrimeIterator &operator++();
 
+            PrimeIterator &operator--();
+
+            PrimeIterator operator++(int);
+
+            PrimeIterator operator--(int);
+
             int operator*() const;
 
             PrimeIterator begin() const;
 
             PrimeIterator end() const;
 
+            std::reverse_iterator<PrimeIterator> rbegin() const;
+
+            std::reverse_iterator<PrimeIterator> rend() const;
+
+            int getCurrentIndex() const;
+
+            void setCurrentIndex(int index);
+
+            const MagicalContainer &getContainer() const;
+
+        };
+
+/**
+ * @class DescendingIterator
+ * @brief An iterator that allows iterating over the elements of a MagicalContainer in descending order.
+ * It reads the sorted storage from the back, so it needs no storage of its own: position i of the
+ * descending order is element size() - 1 - i of the ascending one.
+ */
+
+        class DescendingIterator {
+        private:
+            const MagicalContainer *container = nullptr;
+            int currentIndex = 0;
+
+        public:
+
+            using iterator_concept = std::bidirectional_iterator_tag;
+            using iterator_category = std::input_iterator_tag;
+            using value_type = int;
+            using difference_type = std::ptrdiff_t;
+            using pointer = void;
+            using reference = int;
+
+            DescendingIterator() = default;
+
+            DescendingIterator(const MagicalContainer &container);
+
+            DescendingIterator(const DescendingIterator &other);
+
+            ~DescendingIterator();
+
+            DescendingIterator &operator=(const DescendingIterator &other);
+
+            bool operator==(const DescendingIterator &other) const;
+
+            bool operator!=(const DescendingIterator &other) const;
+
+            bool operator>(const DescendingIterator &other) const;
+
+            bool operator<(const DescendingIterator &other) const;
+
+            DescendingIterator &operator++();
+
+            DescendingIterator &operator--();
+
+            DescendingIterator operator++(int);
+
+            DescendingIterator operator--(int);
+
+            int operator*() const;
+
+            DescendingIterator begin() const;
+
+            DescendingIterator end() const;
+
+            std::reverse_iterator<DescendingIterator> rbegin() const;
+
+            std::reverse_iterator<DescendingIterator> rend() const;
+
             int getCurrentIndex() const;
 
             void setCurrentIndex(int index);
@@ -259,6 +771,11 @@ namespace ariel {
 
     };
 
+    static_assert(std::bidirectional_iterator<MagicalContainer::AscendingIterator>);
+    static_assert(std::bidirectional_iterator<MagicalContainer::SideCrossIterator>);
+    static_assert(std::bidirectional_iterator<MagicalContainer::PrimeIterator>);
+    static_assert(std::bidirectional_iterator<MagicalContainer::DescendingIterator>);
+
 }
 
 #endif //MAGICAL_ITERATORS_MAGICALCONTAINER_HPP
\ No newline at end of file
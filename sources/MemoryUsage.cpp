@@ -0,0 +1,25 @@
+//
+// Memory usage breakdown.
+//
+
+#include "MemoryUsage.hpp"
+
+#include <initializer_list>
+
+namespace ariel {
+
+/**
+ * @brief Adds up every structure.
+ * @return The bytes used and reserved by the whole container.
+ */
+    ComponentMemory MemoryUsage::total() const {
+        ComponentMemory sum;
+        for (const ComponentMemory &part: {elements, primeView, ascendingView, crossView, lazyPrimes, searchIndex,
+                                           aggregateIndex, histogram, bitmap, frozen, mapped}) {
+            sum.used += part.used;
+            sum.reserved += part.reserved;
+        }
+        return sum;
+    }
+
+}
@@ -0,0 +1,41 @@
+/**
+ * @file MemoryUsage.hpp
+ * @struct MemoryUsage
+ * @brief The memory held by a MagicalContainer, split by internal structure.
+ * For every structure, `used` counts the bytes its contents occupy and `reserved` the bytes allocated for
+ * it, slack capacity included, so `reserved - used` is what shrinkToFit() can give back. Structures the
+ * container does not use count zero, and storage shared with a copy of the container is counted in full by
+ * both.
+ */
+
+#ifndef MAGICAL_ITERATORS_MEMORYUSAGE_HPP
+#define MAGICAL_ITERATORS_MEMORYUSAGE_HPP
+
+#include <cstddef>
+
+namespace ariel {
+
+    struct ComponentMemory {
+        std::size_t used = 0;
+        std::size_t reserved = 0;
+    };
+
+    struct MemoryUsage {
+        ComponentMemory elements;
+        ComponentMemory primeView;
+        ComponentMemory ascendingView;
+        ComponentMemory crossView;
+        ComponentMemory lazyPrimes;
+        ComponentMemory searchIndex;
+        ComponentMemory aggregateIndex;
+        ComponentMemory histogram;
+        ComponentMemory bitmap;
+        ComponentMemory frozen;
+        ComponentMemory mapped;
+
+        ComponentMemory total() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_MEMORYUSAGE_HPP
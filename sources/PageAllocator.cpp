@@ -0,0 +1,188 @@
+//
+// Huge page and NUMA aware allocation.
+//
+
+#include "PageAllocator.hpp"
+
+#include <exception>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <string>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace ariel {
+
+    namespace {
+
+        // From <numaif.h>, which ships with libnuma rather than with the kernel headers.
+        constexpr int PolicyBind = 2;
+        constexpr int PolicyInterleave = 3;
+        constexpr unsigned long NodeMaskBits = 64;
+
+        std::size_t roundToHugePages(std::size_t bytes) {
+            return (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+        }
+
+        /// Parses a node list such as "0", "0-1" or "0,2-3" into one bit per node.
+        std::uint64_t parseNodeList(const std::string &list) {
+            std::uint64_t mask = 0;
+            std::stringstream ranges(list);
+            std::string range;
+            while (std::getline(ranges, range, ',')) {
+                const std::size_t dash = range.find('-');
+                try {
+                    const unsigned long first = std::stoul(range.substr(0, dash));
+                    const unsigned long last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+                    for (unsigned long node = first; node <= last && node < NodeMaskBits; ++node) {
+                        mask |= std::uint64_t{1} << node;
+                    }
+                } catch (const std::exception &) {
+                    break;
+                }
+            }
+            return mask;
+        }
+
+        /// Maps length bytes aligned to a huge page boundary, by mapping one huge page more and unmapping the
+        /// unaligned head and the tail.
+        void *mapAligned(std::size_t length) {
+            void *address = ::mmap(nullptr, length + HugePageSize, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED) {
+                return nullptr;
+            }
+            const auto start = reinterpret_cast<std::uintptr_t>(address);
+            const std::uintptr_t aligned = (start + HugePageSize - 1) & ~(HugePageSize - 1);
+            if (aligned != start) {
+                ::munmap(address, aligned - start);
+            }
+            const std::size_t tail = HugePageSize - (aligned - start);
+            if (tail != 0) {
+                ::munmap(reinterpret_cast<void *>(aligned + length), tail);
+            }
+            return reinterpret_cast<void *>(aligned);
+        }
+
+        void *mapHugeTlb(std::size_t length) {
+#ifdef MAP_HUGETLB
+            int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#ifdef MAP_HUGE_SHIFT
+            flags |= 21 << MAP_HUGE_SHIFT;
+#endif
+            void *address = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+            return address == MAP_FAILED ? nullptr : address;
+#else
+            static_cast<void>(length);
+            return nullptr;
+#endif
+        }
+
+        void placeOnNodes(void *address, std::size_t length, const PagePolicy &policy) {
+#ifdef SYS_mbind
+            if (policy.placement == NumaPlacement::Local) {
+                return;
+            }
+            static const std::uint64_t online = pageSupport().onlineNodes;
+            const std::uint64_t mask = policy.nodeMask != 0 ? policy.nodeMask : online;
+            const int mode = policy.placement == NumaPlacement::Bind ? PolicyBind : PolicyInterleave;
+            // The kernel reads one bit less than maxnode says. A failure leaves the default placement.
+            static_cast<void>(::syscall(SYS_mbind, address, length, mode, &mask, NodeMaskBits + 1, 0U));
+#else
+            static_cast<void>(address);
+            static_cast<void>(length);
+            static_cast<void>(policy);
+#endif
+        }
+
+    }
+
+/**
+ * @brief Reads what the kernel offers from /sys and /proc. Anything that cannot be read counts as missing,
+ * except for the node list, which then counts as the single node 0.
+ * @return The huge page and NUMA support of the running system.
+ */
+    PageSupport pageSupport() {
+        PageSupport support;
+        std::ifstream transparent("/sys/kernel/mm/transparent_hugepage/enabled");
+        std::string mode;
+        std::getline(transparent, mode);
+        support.transparent = mode.find("[always]") != std::string::npos ||
+                              mode.find("[madvise]") != std::string::npos;
+
+        std::ifstream meminfo("/proc/meminfo");
+        std::string key;
+        std::size_t value = 0;
+        while (meminfo >> key >> value) {
+            if (key == "HugePages_Free:") {
+                support.freeHugePages = value;
+                break;
+            }
+            meminfo.ignore(256, '\n');
+        }
+
+        std::ifstream nodes("/sys/devices/system/node/online");
+        std::string list;
+        if (std::getline(nodes, list)) {
+            const std::uint64_t online = parseNodeList(list);
+            support.onlineNodes = online != 0 ? online : 1;
+        }
+        return support;
+    }
+
+/**
+ * @brief Check whether an allocation is mapped as pages rather than taken from operator new.
+ * @param bytes The size of the allocation.
+ * @param policy The policy it is made under.
+ * @return `true` for allocations of at least HugePageSize under any policy other than the default.
+ */
+    bool usesPages(std::size_t bytes, const PagePolicy &policy) {
+        return bytes >= HugePageSize && policy != PagePolicy();
+    }
+
+/**
+ * @brief Allocates memory under a page policy.
+ * @param bytes The size of the allocation.
+ * @param policy The huge page and NUMA policy.
+ * @return The memory, aligned to a huge page when it is mapped.
+ * @throws std::bad_alloc if no memory is left.
+ */
+    void *allocatePages(std::size_t bytes, const PagePolicy &policy) {
+        if (!usesPages(bytes, policy)) {
+            return ::operator new(bytes);
+        }
+        const std::size_t length = roundToHugePages(bytes);
+        void *address = policy.hugePages == HugePages::Explicit ? mapHugeTlb(length) : nullptr;
+        if (address == nullptr) {
+            address = mapAligned(length);
+            if (address == nullptr) {
+                throw std::bad_alloc();
+            }
+#ifdef MADV_HUGEPAGE
+            if (policy.hugePages != HugePages::Off) {
+                static_cast<void>(::madvise(address, length, MADV_HUGEPAGE));
+            }
+#endif
+        }
+        placeOnNodes(address, length, policy);
+        return address;
+    }
+
+/**
+ * @brief Frees memory from allocatePages().
+ * @param pointer The memory.
+ * @param bytes The size it was allocated with.
+ * @param policy The policy it was allocated under.
+ */
+    void freePages(void *pointer, std::size_t bytes, const PagePolicy &policy) {
+        if (!usesPages(bytes, policy)) {
+            ::operator delete(pointer);
+            return;
+        }
+        ::munmap(pointer, roundToHugePages(bytes));
+    }
+
+}
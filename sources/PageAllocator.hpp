@@ -0,0 +1,106 @@
+/**
+ * @file PageAllocator.hpp
+ * @class PageAllocator
+ * @brief A standard allocator that backs large arrays with 2 MiB huge pages and places them on NUMA nodes.
+ * Allocations smaller than HugePageSize, and all allocations under the default policy, go to operator new.
+ * Larger ones are mapped directly, rounded up to whole huge pages and aligned to them:
+ * - Transparent huge pages: the mapping is marked with madvise(MADV_HUGEPAGE).
+ * - Explicit huge pages: the mapping comes from the hugetlb pool (MAP_HUGETLB), or is made transparent when
+ *   the pool is empty or not configured.
+ * - Interleave or Bind: the mapping gets the NUMA policy through the mbind system call before it is touched,
+ *   without depending on libnuma.
+ * Every step that the kernel does not support is skipped, so an allocation only fails when memory runs out.
+ */
+
+#ifndef MAGICAL_ITERATORS_PAGEALLOCATOR_HPP
+#define MAGICAL_ITERATORS_PAGEALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace ariel {
+
+    enum class HugePages {
+        Off, Transparent, Explicit
+    };
+
+    enum class NumaPlacement {
+        Local, Interleave, Bind
+    };
+
+    constexpr std::size_t HugePageSize = std::size_t{1} << 21U;
+
+/**
+ * @struct PagePolicy
+ * @brief How a PageAllocator backs its large allocations. nodeMask has one bit per NUMA node to interleave
+ * over or bind to; 0 stands for every online node.
+ */
+    struct PagePolicy {
+        HugePages hugePages = HugePages::Off;
+        NumaPlacement placement = NumaPlacement::Local;
+        std::uint64_t nodeMask = 0;
+
+        bool operator==(const PagePolicy &other) const = default;
+    };
+
+/**
+ * @struct PageSupport
+ * @brief What the running kernel offers: transparent huge pages enabled for madvise() (or always), free
+ * pages in the hugetlb pool, and the online NUMA nodes.
+ */
+    struct PageSupport {
+        bool transparent = false;
+        std::size_t freeHugePages = 0;
+        std::uint64_t onlineNodes = 1;
+    };
+
+    PageSupport pageSupport();
+
+    bool usesPages(std::size_t bytes, const PagePolicy &policy);
+
+    void *allocatePages(std::size_t bytes, const PagePolicy &policy);
+
+    void freePages(void *pointer, std::size_t bytes, const PagePolicy &policy);
+
+    template<typename T>
+    class PageAllocator {
+    private:
+
+        PagePolicy policy;
+
+    public:
+
+        using value_type = T;
+        using propagate_on_container_copy_assignment = std::true_type;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        PageAllocator() = default;
+
+        explicit PageAllocator(const PagePolicy &policy) : policy(policy) {}
+
+        template<typename U>
+        PageAllocator(const PageAllocator<U> &other) : policy(other.getPolicy()) {}
+
+        T *allocate(std::size_t count) {
+            return static_cast<T *>(allocatePages(count * sizeof(T), policy));
+        }
+
+        void deallocate(T *pointer, std::size_t count) {
+            freePages(pointer, count * sizeof(T), policy);
+        }
+
+        const PagePolicy &getPolicy() const {
+            return policy;
+        }
+
+        template<typename U>
+        bool operator==(const PageAllocator<U> &other) const {
+            return policy == other.getPolicy();
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_PAGEALLOCATOR_HPP
@@ -0,0 +1,497 @@
+//
+// Persistent B+tree container.
+//
+
+#include "PersistentContainer.hpp"
+#include "PrimeKernel.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace ariel {
+
+/**
+ * @struct PersistentContainer::Node
+ * @brief A leaf holds up to LeafCapacity sorted elements and one prime bit per element; an inner node holds up
+ * to BranchCapacity children and the smallest element below each of them. Both count the elements and the
+ * primes below them. A node is never changed after it is shared.
+ */
+    struct PersistentContainer::Node {
+        std::vector<int> values;
+        std::uint64_t primeMask = 0;
+        std::vector<NodePtr> children;
+        std::vector<int> lows;
+        std::size_t count = 0;
+        std::size_t primes = 0;
+
+        bool isLeaf() const {
+            return children.empty();
+        }
+
+        /// The number of elements of a leaf or of children of an inner node.
+        std::size_t width() const {
+            return isLeaf() ? values.size() : children.size();
+        }
+
+        std::size_t capacity() const {
+            return isLeaf() ? LeafCapacity : BranchCapacity;
+        }
+
+        /// The index of the child whose range holds element, or would hold it if it were added.
+        std::size_t childFor(int element) const {
+            const auto after = static_cast<std::size_t>(std::upper_bound(lows.begin(), lows.end(), element) -
+                                                        lows.begin());
+            return after == 0 ? 0 : after - 1;
+        }
+    };
+
+    namespace {
+
+        std::uint64_t maskBelow(std::size_t position) {
+            return position >= 64 ? ~0ULL : (1ULL << position) - 1;
+        }
+
+        /// Inserts element into a leaf's values and its flag into the matching bit of mask. The leaf must hold
+        /// fewer than 64 elements.
+        void insertSorted(std::vector<int> &values, std::uint64_t &mask, int element, bool prime) {
+            const auto position = static_cast<std::size_t>(
+                    std::lower_bound(values.begin(), values.end(), element) - values.begin());
+            values.insert(values.begin() + static_cast<std::ptrdiff_t>(position), element);
+            mask = (mask & maskBelow(position)) | (static_cast<std::uint64_t>(prime) << position) |
+                   ((mask & ~maskBelow(position)) << 1U);
+        }
+
+        /// Removes element, which must be present, from a leaf's values and its bit from mask.
+        void eraseSorted(std::vector<int> &values, std::uint64_t &mask, int element) {
+            const auto position = static_cast<std::size_t>(
+                    std::lower_bound(values.begin(), values.end(), element) - values.begin());
+            values.erase(values.begin() + static_cast<std::ptrdiff_t>(position));
+            mask = (mask & maskBelow(position)) | ((mask >> 1U) & ~maskBelow(position));
+        }
+
+    }
+
+    PersistentContainer::PersistentContainer(NodePtr root) : root(std::move(root)) {}
+
+/**
+ * @brief Builds the first version from any elements; duplicates are ignored. Leaves and inner nodes are filled
+ * evenly, and as fully as their capacity allows.
+ * @param elements The elements, in any order.
+ */
+    PersistentContainer::PersistentContainer(std::span<const int> elements) {
+        std::vector<int> sorted(elements.begin(), elements.end());
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        std::vector<NodePtr> level = packLeaves(sorted, classifyPrimes(sorted));
+        while (level.size() > 1) {
+            level = packBranches(level);
+        }
+        if (!level.empty()) {
+            root = level.front();
+        }
+    }
+
+    PersistentContainer::NodePtr PersistentContainer::makeLeaf(std::vector<int> values, std::uint64_t primeMask) {
+        auto node = std::make_shared<Node>();
+        node->count = values.size();
+        node->primes = static_cast<std::size_t>(std::popcount(primeMask));
+        node->values = std::move(values);
+        node->primeMask = primeMask;
+        return node;
+    }
+
+    PersistentContainer::NodePtr PersistentContainer::makeBranch(std::vector<NodePtr> children) {
+        auto node = std::make_shared<Node>();
+        node->lows.reserve(children.size());
+        for (const NodePtr &child: children) {
+            node->lows.push_back(child->isLeaf() ? child->values.front() : child->lows.front());
+            node->count += child->count;
+            node->primes += child->primes;
+        }
+        node->children = std::move(children);
+        return node;
+    }
+
+/**
+ * @brief Splits sorted values into as few leaves as fit them, of sizes that differ by at most one.
+ * @param values The sorted values.
+ * @param primes One bit per value, 64 to a word as in classifyPrimes().
+ * @return The leaves in order.
+ */
+    std::vector<PersistentContainer::NodePtr>
+    PersistentContainer::packLeaves(std::span<const int> values, std::span<const std::uint64_t> primes) {
+        const std::size_t pieces = (values.size() + LeafCapacity - 1) / LeafCapacity;
+        std::vector<NodePtr> leaves;
+        leaves.reserve(pieces);
+        for (std::size_t piece = 0; piece < pieces; ++piece) {
+            const std::size_t begin = values.size() * piece / pieces;
+            const std::size_t end = values.size() * (piece + 1) / pieces;
+            std::uint64_t mask = 0;
+            for (std::size_t i = begin; i < end; ++i) {
+                mask |= ((primes[i / 64] >> (i % 64)) & 1U) << (i - begin);
+            }
+            leaves.push_back(makeLeaf(std::vector<int>(values.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                       values.begin() + static_cast<std::ptrdiff_t>(end)), mask));
+        }
+        return leaves;
+    }
+
+/**
+ * @brief Groups nodes of one level into as few inner nodes as fit them, of sizes that differ by at most one.
+ * @param children The nodes in order.
+ * @return The inner nodes in order.
+ */
+    std::vector<PersistentContainer::NodePtr> PersistentContainer::packBranches(std::span<const NodePtr> children) {
+        const std::size_t pieces = (children.size() + BranchCapacity - 1) / BranchCapacity;
+        std::vector<NodePtr> branches;
+        branches.reserve(pieces);
+        for (std::size_t piece = 0; piece < pieces; ++piece) {
+            const std::size_t begin = children.size() * piece / pieces;
+            const std::size_t end = children.size() * (piece + 1) / pieces;
+            branches.push_back(makeBranch(std::vector<NodePtr>(children.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                               children.begin() + static_cast<std::ptrdiff_t>(end))));
+        }
+        return branches;
+    }
+
+/**
+ * @brief Merges two neighbouring nodes of the same level, splitting the result evenly in two if it overflows.
+ * @param left The left node.
+ * @param right The node right after it.
+ * @return One or two nodes replacing both.
+ */
+    std::vector<PersistentContainer::NodePtr> PersistentContainer::merge(const NodePtr &left, const NodePtr &right) {
+        if (!left->isLeaf()) {
+            std::vector<NodePtr> children = left->children;
+            children.insert(children.end(), right->children.begin(), right->children.end());
+            return packBranches(children);
+        }
+        std::vector<int> values = left->values;
+        values.insert(values.end(), right->values.begin(), right->values.end());
+        std::vector<std::uint64_t> primes(primeBitmapWords(values.size()), 0);
+        primes[0] = left->primeMask;
+        for (std::uint64_t bits = right->primeMask; bits != 0; bits &= bits - 1) {
+            const std::size_t index = left->values.size() + static_cast<std::size_t>(std::countr_zero(bits));
+            primes[index / 64] |= 1ULL << (index % 64);
+        }
+        return packLeaves(values, primes);
+    }
+
+/**
+ * @brief Copies the path from node to the leaf that receives element, which must not be present yet. A full
+ * leaf is split in two before the insertion, and an inner node that overflows is split in two after it.
+ * @param node The root of the subtree.
+ * @param element The element to add.
+ * @param prime Whether the element is prime.
+ * @return The new subtree, and the new right sibling it split off or nullptr.
+ */
+    std::pair<PersistentContainer::NodePtr, PersistentContainer::NodePtr>
+    PersistentContainer::insert(const NodePtr &node, int element, bool prime) {
+        if (node->isLeaf()) {
+            std::vector<int> values = node->values;
+            std::uint64_t mask = node->primeMask;
+            if (values.size() < LeafCapacity) {
+                insertSorted(values, mask, element, prime);
+                return {makeLeaf(std::move(values), mask), nullptr};
+            }
+            const std::size_t half = LeafCapacity / 2;
+            std::vector<int> upper(values.begin() + static_cast<std::ptrdiff_t>(half), values.end());
+            std::uint64_t upperMask = mask >> half;
+            values.resize(half);
+            mask &= maskBelow(half);
+            if (element < upper.front()) {
+                insertSorted(values, mask, element, prime);
+            } else {
+                insertSorted(upper, upperMask, element, prime);
+            }
+            return {makeLeaf(std::move(values), mask), makeLeaf(std::move(upper), upperMask)};
+        }
+
+        const std::size_t index = node->childFor(element);
+        auto [child, sibling] = insert(node->children[index], element, prime);
+        std::vector<NodePtr> children = node->children;
+        children[index] = std::move(child);
+        if (sibling) {
+            children.insert(children.begin() + static_cast<std::ptrdiff_t>(index + 1), std::move(sibling));
+        }
+        if (children.size() <= BranchCapacity) {
+            return {makeBranch(std::move(children)), nullptr};
+        }
+        const std::size_t half = children.size() / 2;
+        std::vector<NodePtr> upper(children.begin() + static_cast<std::ptrdiff_t>(half), children.end());
+        children.resize(half);
+        return {makeBranch(std::move(children)), makeBranch(std::move(upper))};
+    }
+
+/**
+ * @brief Copies the path from node to the leaf that holds element, which must be present, without it. A child
+ * left less than a quarter full is merged with a neighbour, so the tree stays balanced and compact.
+ * @param node The root of the subtree.
+ * @param element The element to remove.
+ * @return The new subtree, or nullptr if it is now empty.
+ */
+    PersistentContainer::NodePtr PersistentContainer::erase(const NodePtr &node, int element) {
+        if (node->isLeaf()) {
+            if (node->values.size() == 1) {
+                return nullptr;
+            }
+            std::vector<int> values = node->values;
+            std::uint64_t mask = node->primeMask;
+            eraseSorted(values, mask, element);
+            return makeLeaf(std::move(values), mask);
+        }
+
+        const std::size_t index = node->childFor(element);
+        NodePtr child = erase(node->children[index], element);
+        std::vector<NodePtr> children = node->children;
+        if (!child) {
+            children.erase(children.begin() + static_cast<std::ptrdiff_t>(index));
+        } else if (child->width() < child->capacity() / 4 && children.size() > 1) {
+            const std::size_t left = index + 1 < children.size() ? index : index - 1;
+            children[index] = std::move(child);
+            std::vector<NodePtr> merged = merge(children[left], children[left + 1]);
+            children.erase(children.begin() + static_cast<std::ptrdiff_t>(left),
+                           children.begin() + static_cast<std::ptrdiff_t>(left + 2));
+            children.insert(children.begin() + static_cast<std::ptrdiff_t>(left), merged.begin(), merged.end());
+        } else {
+            children[index] = std::move(child);
+        }
+        if (children.empty()) {
+            return nullptr;
+        }
+        return makeBranch(std::move(children));
+    }
+
+/**
+ * @brief Get a new version with element added. This version is left as it is.
+ * @param element The element to add; if it is already present the new version is this one.
+ * @return The new version, sharing all but O(log n) nodes with this one.
+ */
+    PersistentContainer PersistentContainer::addElement(int element) const {
+        if (contains(element)) {
+            return *this;
+        }
+        const bool prime = isPrimeValue(element);
+        if (!root) {
+            return PersistentContainer(makeLeaf({element}, static_cast<std::uint64_t>(prime)));
+        }
+        auto [node, sibling] = insert(root, element, prime);
+        if (sibling) {
+            return PersistentContainer(makeBranch({std::move(node), std::move(sibling)}));
+        }
+        return PersistentContainer(std::move(node));
+    }
+
+/**
+ * @brief Get a new version with element removed. This version is left as it is.
+ * @param element The element to remove.
+ * @return The new version, sharing all but O(log n) nodes with this one.
+ * @throws std::runtime_error if the element is not found.
+ */
+    PersistentContainer PersistentContainer::removeElement(int element) const {
+        if (!contains(element)) {
+            throw std::runtime_error("Error: Element not found in PersistentContainer");
+        }
+        NodePtr node = erase(root, element);
+        while (node && !node->isLeaf() && node->children.size() == 1) {
+            node = node->children.front();
+        }
+        return PersistentContainer(std::move(node));
+    }
+
+/**
+ * @brief Get the number of elements in this version.
+ * @return The number of elements.
+ */
+    int PersistentContainer::size() const {
+        return root ? static_cast<int>(root->count) : 0;
+    }
+
+/**
+ * @brief Get the number of prime elements in this version.
+ * @return The number of primes.
+ */
+    int PersistentContainer::primeCount() const {
+        return root ? static_cast<int>(root->primes) : 0;
+    }
+
+/**
+ * @brief Check whether this version holds an element.
+ * @param element The element to look for.
+ * @return `true` if it is present.
+ */
+    bool PersistentContainer::contains(int element) const {
+        const Node *node = root.get();
+        while (node != nullptr && !node->isLeaf()) {
+            node = node->children[node->childFor(element)].get();
+        }
+        return node != nullptr && std::binary_search(node->values.begin(), node->values.end(), element);
+    }
+
+/**
+ * @brief Get the k-th smallest element, descending by the element counts of the nodes.
+ * @param k The zero-based position in ascending order.
+ * @return The element.
+ * @throws std::out_of_range if k is not in [0, size()).
+ */
+    int PersistentContainer::kth(int k) const {
+        if (k < 0 || k >= size()) {
+            throw std::out_of_range("Error: Invalid index.");
+        }
+        auto remaining = static_cast<std::size_t>(k);
+        const Node *node = root.get();
+        while (!node->isLeaf()) {
+            for (const NodePtr &child: node->children) {
+                if (remaining < child->count) {
+                    node = child.get();
+                    break;
+                }
+                remaining -= child->count;
+            }
+        }
+        return node->values[remaining];
+    }
+
+/**
+ * @brief Get a copy of the elements of this version.
+ * @return The elements in ascending order.
+ */
+    std::vector<int> PersistentContainer::getElements() const {
+        std::vector<int> elements;
+        elements.reserve(static_cast<std::size_t>(size()));
+        for (const Node *leaf: leaves(root)) {
+            elements.insert(elements.end(), leaf->values.begin(), leaf->values.end());
+        }
+        return elements;
+    }
+
+/**
+ * @brief Collects the leaves of a tree from left to right.
+ * @param root The root, or nullptr.
+ * @return The leaves; they stay valid as long as root does.
+ */
+    std::vector<const PersistentContainer::Node *> PersistentContainer::leaves(const NodePtr &root) {
+        std::vector<const Node *> result;
+        std::vector<const Node *> pending;
+        if (root) {
+            pending.push_back(root.get());
+        }
+        while (!pending.empty()) {
+            const Node *node = pending.back();
+            pending.pop_back();
+            if (node->isLeaf()) {
+                result.push_back(node);
+                continue;
+            }
+            for (auto child = node->children.rbegin(); child != node->children.rend(); ++child) {
+                pending.push_back(child->get());
+            }
+        }
+        return result;
+    }
+
+    Generator<int> PersistentContainer::walk(NodePtr root, bool primesOnly) {
+        for (const Node *leaf: leaves(root)) {
+            if (primesOnly) {
+                for (std::uint64_t bits = leaf->primeMask; bits != 0; bits &= bits - 1) {
+                    co_yield leaf->values[static_cast<std::size_t>(std::countr_zero(bits))];
+                }
+            } else {
+                for (int element: leaf->values) {
+                    co_yield element;
+                }
+            }
+        }
+    }
+
+    Generator<int> PersistentContainer::walkSideCross(NodePtr root) {
+        const std::vector<const Node *> all = leaves(root);
+        const std::size_t total = root ? root->count : 0;
+        std::size_t frontLeaf = 0;
+        std::size_t frontOffset = 0;
+        std::size_t backLeaf = all.empty() ? 0 : all.size() - 1;
+        std::size_t backOffset = all.empty() ? 0 : all.back()->values.size();
+        for (std::size_t emitted = 0; emitted < total; ++emitted) {
+            if (emitted % 2 == 0) {
+                if (frontOffset == all[frontLeaf]->values.size()) {
+                    ++frontLeaf;
+                    frontOffset = 0;
+                }
+                co_yield all[frontLeaf]->values[frontOffset++];
+            } else {
+                if (backOffset == 0) {
+                    --backLeaf;
+                    backOffset = all[backLeaf]->values.size();
+                }
+                co_yield all[backLeaf]->values[--backOffset];
+            }
+        }
+    }
+
+/**
+ * @brief Produces the elements of this version in ascending order. The generator keeps the version's nodes
+ * alive, so it may outlive this object.
+ * @return A generator of the elements.
+ */
+    Generator<int> PersistentContainer::ascending() const {
+        return walk(root, false);
+    }
+
+/**
+ * @brief Produces the elements of this version in side-cross order (smallest, largest, second smallest, ...)
+ * with one cursor walking the leaves forwards and one backwards.
+ * @return A generator of the elements.
+ */
+    Generator<int> PersistentContainer::sideCross() const {
+        return walkSideCross(root);
+    }
+
+/**
+ * @brief Produces the prime elements of this version in ascending order, walking only the set bits of each
+ * leaf's prime mask.
+ * @return A generator of the prime elements.
+ */
+    Generator<int> PersistentContainer::primes() const {
+        return walk(root, true);
+    }
+
+/**
+ * @brief Get the memory used by this version's nodes.
+ * @return The number of bytes of every node reachable from this version.
+ */
+    std::size_t PersistentContainer::memoryBytes() const {
+        return memoryBytes(std::span<const PersistentContainer>(this, 1));
+    }
+
+/**
+ * @brief Get the memory used by a set of versions, counting every node they share once.
+ * @param versions The versions.
+ * @return The number of bytes of every distinct node reachable from the versions.
+ */
+    std::size_t PersistentContainer::memoryBytes(std::span<const PersistentContainer> versions) {
+        std::unordered_set<const Node *> seen;
+        std::vector<const Node *> pending;
+        for (const PersistentContainer &version: versions) {
+            if (version.root) {
+                pending.push_back(version.root.get());
+            }
+        }
+        std::size_t total = 0;
+        while (!pending.empty()) {
+            const Node *node = pending.back();
+            pending.pop_back();
+            if (!seen.insert(node).second) {
+                continue;
+            }
+            total += sizeof(Node) + node->values.capacity() * sizeof(int) +
+                     node->children.capacity() * sizeof(NodePtr) + node->lows.capacity() * sizeof(int);
+            for (const NodePtr &child: node->children) {
+                pending.push_back(child.get());
+            }
+        }
+        return total;
+    }
+
+}
@@ -0,0 +1,95 @@
+/**
+ * @file PersistentContainer.hpp
+ * @class PersistentContainer
+ * @brief An immutable, versioned set of distinct integers with the three orders of a MagicalContainer.
+ * The elements live in a B+tree of sorted leaf blocks of at most LeafCapacity elements, with at most
+ * BranchCapacity children per inner node. Nodes are never changed once built: addElement() and removeElement()
+ * return a new version that copies only the O(log n) nodes on the path to the changed leaf and shares every
+ * other node with the version it came from. Keeping N versions that differ by C changes therefore costs
+ * O(n + C log n) memory instead of O(N n). Every node counts the elements and primes below it, and every leaf
+ * carries a 64-bit prime mask, so size(), primeCount() and kth() never visit the elements.
+ */
+
+#ifndef MAGICAL_ITERATORS_PERSISTENTCONTAINER_HPP
+#define MAGICAL_ITERATORS_PERSISTENTCONTAINER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+#include "Generator.hpp"
+
+namespace ariel {
+
+    class PersistentContainer {
+    public:
+
+        static constexpr std::size_t LeafCapacity = 64;
+        static constexpr std::size_t BranchCapacity = 32;
+
+    private:
+
+        struct Node;
+
+        using NodePtr = std::shared_ptr<const Node>;
+
+        NodePtr root;
+
+        explicit PersistentContainer(NodePtr root);
+
+        static NodePtr makeLeaf(std::vector<int> values, std::uint64_t primeMask);
+
+        static NodePtr makeBranch(std::vector<NodePtr> children);
+
+        static std::vector<NodePtr> packLeaves(std::span<const int> values, std::span<const std::uint64_t> primes);
+
+        static std::vector<NodePtr> packBranches(std::span<const NodePtr> children);
+
+        static std::vector<NodePtr> merge(const NodePtr &left, const NodePtr &right);
+
+        static std::pair<NodePtr, NodePtr> insert(const NodePtr &node, int element, bool prime);
+
+        static NodePtr erase(const NodePtr &node, int element);
+
+        static std::vector<const Node *> leaves(const NodePtr &root);
+
+        static Generator<int> walk(NodePtr root, bool primesOnly);
+
+        static Generator<int> walkSideCross(NodePtr root);
+
+    public:
+
+        PersistentContainer() = default;
+
+        explicit PersistentContainer(std::span<const int> elements);
+
+        PersistentContainer addElement(int element) const;
+
+        PersistentContainer removeElement(int element) const;
+
+        int size() const;
+
+        int primeCount() const;
+
+        bool contains(int element) const;
+
+        int kth(int k) const;
+
+        std::vector<int> getElements() const;
+
+        Generator<int> ascending() const;
+
+        Generator<int> sideCross() const;
+
+        Generator<int> primes() const;
+
+        std::size_t memoryBytes() const;
+
+        static std::size_t memoryBytes(std::span<const PersistentContainer> versions);
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_PERSISTENTCONTAINER_HPP
@@ -0,0 +1,58 @@
+//
+// Prefix-sum aggregate index.
+//
+
+#include "PrefixSumIndex.hpp"
+
+#include <bit>
+
+namespace ariel {
+
+/**
+ * @brief Builds the index from a sorted array and the primality of its elements.
+ * @param sorted The sorted values.
+ * @param primes One bit per value, set for the primes, 64 to a word as in classifyPrimes().
+ */
+    void PrefixSumIndex::build(std::span<const int> sorted, std::span<const std::uint64_t> primes) {
+        sums.assign(sorted.size() + 1, 0);
+        primeSums.assign(1, 0);
+        for (std::size_t i = 0; i < sorted.size(); ++i) {
+            sums[i + 1] = sums[i] + sorted[i];
+        }
+        for (std::size_t word = 0; word < primes.size(); ++word) {
+            for (std::uint64_t bits = primes[word]; bits != 0; bits &= bits - 1) {
+                const std::size_t index = word * 64 + static_cast<std::size_t>(std::countr_zero(bits));
+                primeSums.push_back(primeSums.back() + sorted[index]);
+            }
+        }
+    }
+
+/**
+ * @brief Get the sum of the values at positions [begin, end).
+ * @param begin The first position.
+ * @param end One past the last position, at most the number of values.
+ * @return The sum, 0 for an empty range.
+ */
+    long long PrefixSumIndex::sum(std::size_t begin, std::size_t end) const {
+        return sums[end] - sums[begin];
+    }
+
+/**
+ * @brief Get the sum of the primes ranked [begin, end) among the prime values.
+ * @param begin The rank of the first prime.
+ * @param end One past the rank of the last prime, at most the number of primes.
+ * @return The sum, 0 for an empty range.
+ */
+    long long PrefixSumIndex::primeSum(std::size_t begin, std::size_t end) const {
+        return primeSums[end] - primeSums[begin];
+    }
+
+/**
+ * @brief Get the memory held by the index.
+ * @return The capacity of both prefix arrays in bytes.
+ */
+    std::size_t PrefixSumIndex::memoryBytes() const {
+        return (sums.capacity() + primeSums.capacity()) * sizeof(long long);
+    }
+
+}
@@ -0,0 +1,40 @@
+/**
+ * @file PrefixSumIndex.hpp
+ * @class PrefixSumIndex
+ * @brief 64-bit prefix sums over a sorted array of integers and over its prime subsequence.
+ * The sum of any run of consecutive positions is the difference of two prefix sums, so together with a
+ * lower-bound search that turns a value range into a position range, range sums, counts and means cost
+ * O(log n). Like EytzingerIndex, the index is a derived structure: it is built once from the sorted storage,
+ * and its owner drops it whenever that storage changes.
+ */
+
+#ifndef MAGICAL_ITERATORS_PREFIXSUMINDEX_HPP
+#define MAGICAL_ITERATORS_PREFIXSUMINDEX_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ariel {
+
+    class PrefixSumIndex {
+    private:
+
+        std::vector<long long> sums;
+        std::vector<long long> primeSums;
+
+    public:
+
+        void build(std::span<const int> sorted, std::span<const std::uint64_t> primes);
+
+        long long sum(std::size_t begin, std::size_t end) const;
+
+        long long primeSum(std::size_t begin, std::size_t end) const;
+
+        std::size_t memoryBytes() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_PREFIXSUMINDEX_HPP
@@ -0,0 +1,235 @@
+//
+// Batch primality classification kernel.
+//
+
+#include "PrimeKernel.hpp"
+#include "PrimeTable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::size_t BlockLanes = 64;
+
+        /// A small odd prime together with the constants of the divisibility test n * inverse <= limit (mod 2^32).
+        struct TrialDivisor {
+            std::uint32_t prime;
+            std::uint32_t inverse;
+            std::uint32_t limit;
+        };
+
+        constexpr std::uint32_t inverseMod32(std::uint32_t odd) {
+            std::uint32_t inverse = odd;
+            for (int i = 0; i < 5; ++i) {
+                inverse *= 2U - odd * inverse;
+            }
+            return inverse;
+        }
+
+        constexpr std::array<std::uint32_t, 17> OddTrialPrimes = {3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43,
+                                                                  47, 53, 59, 61};
+
+        /// A survivor of trial division below this bound has no factor <= 61 and is smaller than 67 * 67, so it is prime.
+        constexpr std::uint32_t TrialSquareLimit = 67U * 67U;
+
+        constexpr std::array<TrialDivisor, OddTrialPrimes.size()> makeDivisors() {
+            std::array<TrialDivisor, OddTrialPrimes.size()> divisors{};
+            for (std::size_t i = 0; i < OddTrialPrimes.size(); ++i) {
+                std::uint32_t prime = OddTrialPrimes[i];
+                divisors[i] = TrialDivisor{prime, inverseMod32(prime), UINT32_MAX / prime};
+            }
+            return divisors;
+        }
+
+        constexpr std::array<TrialDivisor, OddTrialPrimes.size()> OddDivisors = makeDivisors();
+
+        std::uint64_t powMod(std::uint64_t base, std::uint32_t exponent, std::uint64_t modulus) {
+            std::uint64_t result = 1;
+            base %= modulus;
+            while (exponent != 0) {
+                if ((exponent & 1U) != 0) {
+                    result = result * base % modulus;
+                }
+                base = base * base % modulus;
+                exponent >>= 1U;
+            }
+            return result;
+        }
+
+/**
+ * @brief Classifies one block of at most 64 values into one bitmap word.
+ * @param values The values of the block.
+ * @param count The number of values in the block, at most BlockLanes.
+ * @return A word whose bit i is set iff values[i] is prime.
+ */
+        std::uint64_t classifyBlock(const int *values, std::size_t count) {
+            std::array<std::uint32_t, BlockLanes> lane{};
+            std::array<std::uint32_t, BlockLanes> alive{};
+
+            for (std::size_t i = 0; i < count; ++i) {
+                lane[i] = static_cast<std::uint32_t>(values[i]);
+                alive[i] = static_cast<std::uint32_t>(values[i] >= 2);
+            }
+
+            for (std::size_t i = 0; i < BlockLanes; ++i) {
+                alive[i] &= (lane[i] & 1U) | static_cast<std::uint32_t>(lane[i] == 2U);
+            }
+            for (const TrialDivisor &divisor: OddDivisors) {
+                for (std::size_t i = 0; i < BlockLanes; ++i) {
+                    alive[i] &= static_cast<std::uint32_t>(lane[i] * divisor.inverse > divisor.limit) |
+                                static_cast<std::uint32_t>(lane[i] == divisor.prime);
+                }
+            }
+
+            std::uint64_t word = 0;
+            for (std::size_t i = 0; i < count; ++i) {
+                if (alive[i] != 0 && lane[i] >= TrialSquareLimit) {
+                    bool prime = lane[i] < SmallPrimeLimit ? isSmallPrime(lane[i]) : isPrimeMillerRabin(lane[i]);
+                    alive[i] = static_cast<std::uint32_t>(prime);
+                }
+                word |= static_cast<std::uint64_t>(alive[i]) << i;
+            }
+            return word;
+        }
+
+    }
+
+/**
+ * @brief Deterministic Miller-Rabin primality test for 32-bit values.
+ * The bases 2, 7 and 61 are sufficient for every n < 4,759,123,141.
+ * @param num The number to check for primality.
+ * @return `true` if the number is prime, `false` otherwise.
+ */
+    bool isPrimeMillerRabin(std::uint32_t num) {
+        if (num < 2) {
+            return false;
+        }
+        for (std::uint32_t small: {2U, 3U, 5U, 7U}) {
+            if (num % small == 0) {
+                return num == small;
+            }
+        }
+
+        std::uint32_t odd = num - 1;
+        int shift = std::countr_zero(odd);
+        odd >>= shift;
+
+        for (std::uint32_t base: {2U, 7U, 61U}) {
+            if (base % num == 0) {
+                continue;
+            }
+            std::uint64_t x = powMod(base, odd, num);
+            if (x == 1 || x == num - 1) {
+                continue;
+            }
+            bool composite = true;
+            for (int round = 1; round < shift && composite; ++round) {
+                x = x * x % num;
+                composite = (x != num - 1);
+            }
+            if (composite) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+/**
+ * @brief Check if a signed number is prime.
+ * Values below 2^16 are answered from the compile-time table, larger ones by Miller-Rabin.
+ * @param num The number to check for primality.
+ * @return `true` if the number is prime, `false` otherwise (including every number below 2).
+ */
+    bool isPrimeValue(int num) {
+        if (num < 2) {
+            return false;
+        }
+        auto value = static_cast<std::uint32_t>(num);
+        if (value < SmallPrimeLimit) {
+            return isSmallPrime(value);
+        }
+        return isPrimeMillerRabin(value);
+    }
+
+/**
+ * @brief Get the number of bitmap words needed to classify a number of values.
+ * @param count The number of values.
+ * @return The number of 64-bit words in the output bitmap.
+ */
+    std::size_t primeBitmapWords(std::size_t count) {
+        return (count + BlockLanes - 1) / BlockLanes;
+    }
+
+/**
+ * @brief Classify a span of values, writing one bit per value into a caller-provided bitmap.
+ * Bit i % 64 of word i / 64 is set iff values[i] is prime; unused bits of the last word are cleared.
+ * @param values The values to classify.
+ * @param bitmap The output bitmap, at least primeBitmapWords(values.size()) words long.
+ * @throws std::runtime_error if the bitmap is too small.
+ */
+    void classifyPrimes(std::span<const int> values, std::span<std::uint64_t> bitmap) {
+        const std::size_t words = primeBitmapWords(values.size());
+        if (bitmap.size() < words) {
+            throw std::runtime_error("Error: Prime bitmap is too small");
+        }
+        for (std::size_t word = 0; word < words; ++word) {
+            const std::size_t first = word * BlockLanes;
+            bitmap[word] = classifyBlock(values.data() + first, std::min(BlockLanes, values.size() - first));
+        }
+    }
+
+/**
+ * @brief Classify a span of values into a newly allocated bitmap.
+ * @param values The values to classify.
+ * @return The bitmap, with bit i set iff values[i] is prime.
+ */
+    std::vector<std::uint64_t> classifyPrimes(std::span<const int> values) {
+        std::vector<std::uint64_t> bitmap(primeBitmapWords(values.size()));
+        classifyPrimes(values, bitmap);
+        return bitmap;
+    }
+
+/**
+ * @brief Inserts a flag into a bitmap from classifyPrimes(), moving the flags at and after it up by one.
+ * @param bitmap The bitmap of `count` values, grown to hold one more.
+ * @param count The number of values the bitmap classifies before the insertion.
+ * @param index The position of the inserted value, at most count.
+ * @param prime Whether the inserted value is prime.
+ */
+    void insertPrimeFlag(std::vector<std::uint64_t> &bitmap, std::size_t count, std::size_t index, bool prime) {
+        bitmap.resize(primeBitmapWords(count + 1), 0);
+        const std::size_t first = index / 64;
+        const std::uint64_t below = (1ULL << (index % 64)) - 1;
+        std::uint64_t carry = bitmap[first] >> 63U;
+        bitmap[first] = (bitmap[first] & below) | ((bitmap[first] & ~below) << 1U) |
+                        (static_cast<std::uint64_t>(prime) << (index % 64));
+        for (std::size_t word = first + 1; word < bitmap.size(); ++word) {
+            const std::uint64_t next = bitmap[word] >> 63U;
+            bitmap[word] = (bitmap[word] << 1U) | carry;
+            carry = next;
+        }
+    }
+
+/**
+ * @brief Erases a flag from a bitmap from classifyPrimes(), moving the flags after it down by one.
+ * @param bitmap The bitmap of `count` values, shrunk to hold one fewer.
+ * @param count The number of values the bitmap classifies before the erasure.
+ * @param index The position of the erased value, smaller than count.
+ */
+    void erasePrimeFlag(std::vector<std::uint64_t> &bitmap, std::size_t count, std::size_t index) {
+        const std::size_t first = index / 64;
+        const std::uint64_t below = (1ULL << (index % 64)) - 1;
+        bitmap[first] = (bitmap[first] & below) | ((bitmap[first] >> 1U) & ~below);
+        for (std::size_t word = first + 1; word < bitmap.size(); ++word) {
+            bitmap[word - 1] |= (bitmap[word] & 1U) << 63U;
+            bitmap[word] >>= 1U;
+        }
+        bitmap.resize(primeBitmapWords(count - 1));
+    }
+
+}
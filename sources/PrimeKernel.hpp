@@ -0,0 +1,37 @@
+/**
+ * @file PrimeKernel.hpp
+ * @brief Batch primality classification for spans of integers.
+ * The kernel works on blocks of 64 values, one output bitmap word per block. Every block is first
+ * filtered by trial division against a fixed set of small primes, written as straight-line lane loops
+ * (a multiply and a compare per lane and prime) so the compiler can vectorize them. The few survivors
+ * that are too large to be settled by the filter alone are looked up in the compile-time small prime table
+ * or, above 2^16, go through a deterministic Miller-Rabin test.
+ */
+
+#ifndef MAGICAL_ITERATORS_PRIMEKERNEL_HPP
+#define MAGICAL_ITERATORS_PRIMEKERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ariel {
+
+    bool isPrimeMillerRabin(std::uint32_t num);
+
+    bool isPrimeValue(int num);
+
+    std::size_t primeBitmapWords(std::size_t count);
+
+    void classifyPrimes(std::span<const int> values, std::span<std::uint64_t> bitmap);
+
+    std::vector<std::uint64_t> classifyPrimes(std::span<const int> values);
+
+    void insertPrimeFlag(std::vector<std::uint64_t> &bitmap, std::size_t count, std::size_t index, bool prime);
+
+    void erasePrimeFlag(std::vector<std::uint64_t> &bitmap, std::size_t count, std::size_t index);
+
+}
+
+#endif //MAGICAL_ITERATORS_PRIMEKERNEL_HPP
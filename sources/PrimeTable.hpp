@@ -0,0 +1,87 @@
+/**
+ * @file PrimeTable.hpp
+ * @brief A compile-time primality table for values below 2^16 and a constexpr primality test.
+ * The table holds one bit per value (8 KiB in total), generated by a constexpr sieve, so classifying a
+ * small value is a single load from read-only data with no startup cost. isPrimeConstexpr() uses the
+ * table below 2^16 and odd trial division above it, and can be evaluated in constant expressions.
+ */
+
+#ifndef MAGICAL_ITERATORS_PRIMETABLE_HPP
+#define MAGICAL_ITERATORS_PRIMETABLE_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace ariel {
+
+    constexpr std::uint32_t SmallPrimeLimit = 1U << 16U;
+
+    using SmallPrimeTable = std::array<std::uint64_t, SmallPrimeLimit / 64>;
+
+/**
+ * @brief Generates the small prime table with a sieve of Eratosthenes over the odd numbers.
+ * Every word starts with all odd positions set, so only odd multiples of odd primes have to be cleared,
+ * which keeps the evaluation well within the compilers' constexpr step limits.
+ * @return A table whose bit n % 64 of word n / 64 is set iff n is prime.
+ */
+    constexpr SmallPrimeTable makeSmallPrimeTable() {
+        SmallPrimeTable table{};
+        for (std::uint64_t &word: table) {
+            word = 0xAAAAAAAAAAAAAAAAULL;
+        }
+        table[0] &= ~(1ULL << 1U);
+        table[0] |= 1ULL << 2U;
+        for (std::uint32_t prime = 3; prime * prime < SmallPrimeLimit; prime += 2) {
+            if (((table[prime / 64] >> (prime % 64)) & 1U) == 0) {
+                continue;
+            }
+            for (std::uint32_t multiple = prime * prime; multiple < SmallPrimeLimit; multiple += 2 * prime) {
+                table[multiple / 64] &= ~(1ULL << (multiple % 64));
+            }
+        }
+        return table;
+    }
+
+    inline constexpr SmallPrimeTable SmallPrimes = makeSmallPrimeTable();
+
+/**
+ * @brief Check if a value below SmallPrimeLimit is prime with a single table load.
+ * @param num The number to check, which must be below SmallPrimeLimit.
+ * @return `true` if the number is prime, `false` otherwise.
+ */
+    constexpr bool isSmallPrime(std::uint32_t num) {
+        return ((SmallPrimes[num / 64] >> (num % 64)) & 1U) != 0;
+    }
+
+/**
+ * @brief Check if a number is prime, usable in constant expressions.
+ * @param num The number to check for primality.
+ * @return `true` if the number is prime, `false` otherwise.
+ */
+    constexpr bool isPrimeConstexpr(int num) {
+        if (num < 2) {
+            return false;
+        }
+        auto value = static_cast<std::uint32_t>(num);
+        if (value < SmallPrimeLimit) {
+            return isSmallPrime(value);
+        }
+        if ((value & 1U) == 0) {
+            return false;
+        }
+        for (std::uint32_t divisor = 3; divisor <= value / divisor; divisor += 2) {
+            if (value % divisor == 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    static_assert(!isPrimeConstexpr(-7) && !isPrimeConstexpr(0) && !isPrimeConstexpr(1));
+    static_assert(isPrimeConstexpr(2) && isPrimeConstexpr(3) && !isPrimeConstexpr(4) && isPrimeConstexpr(5));
+    static_assert(isPrimeConstexpr(65521) && !isPrimeConstexpr(65535) && isPrimeConstexpr(65537));
+    static_assert(isPrimeConstexpr(2147483647) && !isPrimeConstexpr(2147483645));
+
+}
+
+#endif //MAGICAL_ITERATORS_PRIMETABLE_HPP
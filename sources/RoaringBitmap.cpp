@@ -0,0 +1,615 @@
+//
+// Roaring-style compressed bitmap.
+//
+
+#include "RoaringBitmap.hpp"
+#include "PrimeKernel.hpp"
+#include "PrimeTable.hpp"
+
+#include <algorithm>
+#include <array>
+#include <stdexcept>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::uint16_t SmallValueChunk = 0x8000;
+
+        /// Position of the set bit with the given rank inside a word.
+        unsigned selectInWord(std::uint64_t word, std::uint32_t rank) {
+            for (std::uint32_t i = 0; i < rank; ++i) {
+                word &= word - 1;
+            }
+            return static_cast<unsigned>(std::countr_zero(word));
+        }
+
+        /// Words per block in the select counts of a bitmap chunk, and blocks per 1024-word chunk.
+        constexpr std::size_t SelectBlockWords = 8;
+        constexpr std::size_t SelectBlocks = 128;
+
+        /// Set bits before each block of one bitmap chunk, as counted by the calling thread.
+        struct SelectBlockCounts {
+            std::uint64_t stamp = 0;
+            std::size_t chunk = 0;
+            std::array<std::uint16_t, SelectBlocks> before{};
+        };
+
+        /// The last few chunks the calling thread selected in: both ends of a side-cross, for elements and primes.
+        struct SelectBlockCache {
+            std::array<SelectBlockCounts, 4> slots{};
+            std::size_t next = 0;
+        };
+
+        thread_local SelectBlockCache selectBlocks;
+
+
+    }
+
+/// Implementation of the chunk containers.
+
+
+/**
+ * @brief Check whether a chunk holds the given low half.
+ * @param low The low 16 bits of the key.
+ * @return `true` if the key is present.
+ */
+    bool RoaringBitmap::Chunk::contains(std::uint16_t low) const {
+        switch (kind) {
+            case ChunkKind::Array:
+                return std::binary_search(array.begin(), array.end(), low);
+            case ChunkKind::Bitmap:
+                return ((bits[low / 64U] >> (low % 64U)) & 1U) != 0;
+            case ChunkKind::Run: {
+                auto it = std::upper_bound(runs.begin(), runs.end(), low, [](std::uint16_t key, const Run &run) {
+                    return key < run.start;
+                });
+                if (it == runs.begin()) {
+                    return false;
+                }
+                --it;
+                return low <= it->start + it->length;
+            }
+        }
+        return false;
+    }
+
+/**
+ * @brief Adds a low half to a chunk. A run chunk is expanded first; an array chunk that reaches the
+ * array limit is converted to a bitmap.
+ * @param low The low 16 bits of the key.
+ * @return `true` if the key was not present before.
+ */
+    bool RoaringBitmap::Chunk::add(std::uint16_t low) {
+        if (kind == ChunkKind::Run) {
+            if (contains(low)) {
+                return false;
+            }
+            expandRuns();
+        }
+        if (kind == ChunkKind::Array) {
+            auto it = std::lower_bound(array.begin(), array.end(), low);
+            if (it != array.end() && *it == low) {
+                return false;
+            }
+            if (cardinality < ArrayLimit) {
+                array.insert(it, low);
+                ++cardinality;
+                return true;
+            }
+            toBitmap();
+        }
+        std::uint64_t &word = bits[low / 64U];
+        const std::uint64_t mask = 1ULL << (low % 64U);
+        if ((word & mask) != 0) {
+            return false;
+        }
+        word |= mask;
+        ++cardinality;
+        return true;
+    }
+
+/**
+ * @brief Removes a low half from a chunk. A bitmap chunk that shrinks to the array limit is converted to an array.
+ * @param low The low 16 bits of the key.
+ * @return `true` if the key was present.
+ */
+    bool RoaringBitmap::Chunk::remove(std::uint16_t low) {
+        if (!contains(low)) {
+            return false;
+        }
+        if (kind == ChunkKind::Run) {
+            expandRuns();
+        }
+        if (kind == ChunkKind::Array) {
+            array.erase(std::lower_bound(array.begin(), array.end(), low));
+            --cardinality;
+            return true;
+        }
+        bits[low / 64U] &= ~(1ULL << (low % 64U));
+        --cardinality;
+        if (cardinality <= ArrayLimit) {
+            toArray();
+        }
+        return true;
+    }
+
+/**
+ * @brief Counts the keys of a chunk that are smaller than the given low half.
+ * @param low The low 16 bits of the key.
+ * @return The number of keys below low.
+ */
+    std::uint32_t RoaringBitmap::Chunk::rank(std::uint16_t low) const {
+        switch (kind) {
+            case ChunkKind::Array:
+                return static_cast<std::uint32_t>(std::lower_bound(array.begin(), array.end(), low) - array.begin());
+            case ChunkKind::Bitmap: {
+                std::uint32_t count = 0;
+                for (std::size_t word = 0; word < low / 64U; ++word) {
+                    count += static_cast<std::uint32_t>(std::popcount(bits[word]));
+                }
+                const std::uint64_t below = (1ULL << (low % 64U)) - 1;
+                return count + static_cast<std::uint32_t>(std::popcount(bits[low / 64U] & below));
+            }
+            case ChunkKind::Run: {
+                std::uint32_t count = 0;
+                for (const Run &run: runs) {
+                    if (low <= run.start) {
+                        break;
+                    }
+                    count += std::min<std::uint32_t>(run.length + 1U, static_cast<std::uint32_t>(low - run.start));
+                }
+                return count;
+            }
+        }
+        return 0;
+    }
+
+/**
+ * @brief Finds the key of a chunk with the given rank.
+ * @param rank The rank, smaller than the chunk cardinality.
+ * @return The low 16 bits of the key.
+ */
+    std::uint16_t RoaringBitmap::Chunk::select(std::uint32_t rank) const {
+        switch (kind) {
+            case ChunkKind::Array:
+                return array[rank];
+            case ChunkKind::Bitmap:
+                for (std::size_t word = 0; word < bits.size(); ++word) {
+                    auto count = static_cast<std::uint32_t>(std::popcount(bits[word]));
+                    if (rank < count) {
+                        return static_cast<std::uint16_t>(word * 64 + selectInWord(bits[word], rank));
+                    }
+                    rank -= count;
+                }
+                break;
+            case ChunkKind::Run:
+                for (const Run &run: runs) {
+                    if (rank <= run.length) {
+                        return static_cast<std::uint16_t>(run.start + rank);
+                    }
+                    rank -= run.length + 1U;
+                }
+                break;
+        }
+        return 0;
+    }
+
+/**
+ * @brief Converts a chunk to the array representation.
+ */
+    void RoaringBitmap::Chunk::toArray() {
+        if (kind == ChunkKind::Array) {
+            return;
+        }
+        std::vector<std::uint16_t> lows;
+        lows.reserve(cardinality);
+        forEach([&](std::uint16_t low) {
+            lows.push_back(low);
+        });
+        array.swap(lows);
+        bits = std::vector<std::uint64_t>();
+        runs = std::vector<Run>();
+        kind = ChunkKind::Array;
+    }
+
+/**
+ * @brief Converts a chunk to the bitmap representation.
+ */
+    void RoaringBitmap::Chunk::toBitmap() {
+        if (kind == ChunkKind::Bitmap) {
+            return;
+        }
+        std::vector<std::uint64_t> words(BitmapWords, 0);
+        forEach([&](std::uint16_t low) {
+            words[low / 64U] |= 1ULL << (low % 64U);
+        });
+        bits.swap(words);
+        array = std::vector<std::uint16_t>();
+        runs = std::vector<Run>();
+        kind = ChunkKind::Bitmap;
+    }
+
+/**
+ * @brief Converts a run chunk to an array or a bitmap, whichever its cardinality calls for.
+ */
+    void RoaringBitmap::Chunk::expandRuns() {
+        if (cardinality <= ArrayLimit) {
+            toArray();
+        } else {
+            toBitmap();
+        }
+    }
+
+/**
+ * @brief Converts a chunk to the run representation if that is smaller than its current one.
+ */
+    void RoaringBitmap::Chunk::runOptimize() {
+        std::vector<Run> found;
+        forEach([&](std::uint16_t low) {
+            if (!found.empty() && found.back().start + found.back().length + 1U == low) {
+                ++found.back().length;
+            } else {
+                found.push_back(Run{low, 0});
+            }
+        });
+        if (found.size() * sizeof(Run) < bytes()) {
+            runs.swap(found);
+            array = std::vector<std::uint16_t>();
+            bits = std::vector<std::uint64_t>();
+            kind = ChunkKind::Run;
+        }
+    }
+
+/**
+ * @brief Get the payload size of a chunk.
+ * @return The number of bytes used by the chunk's container.
+ */
+    std::size_t RoaringBitmap::Chunk::bytes() const {
+        return array.capacity() * sizeof(std::uint16_t) + bits.capacity() * sizeof(std::uint64_t) +
+               runs.capacity() * sizeof(Run);
+    }
+
+
+/// Implementation of the RoaringBitmap class.
+
+
+/**
+ * @brief Finds the position of the chunk with the given high half, or where it would be inserted.
+ * @param high The high 16 bits of the key.
+ * @return The index of the first chunk whose high half is not less than high.
+ */
+    std::size_t RoaringBitmap::findChunk(std::uint16_t high) const {
+        auto it = std::lower_bound(chunks.begin(), chunks.end(), high,
+                                   [](const CowPtr<Chunk> &chunk, std::uint16_t key) {
+                                       return chunk->high < key;
+                                   });
+        return static_cast<std::size_t>(it - chunks.begin());
+    }
+
+/**
+ * @brief Get the per-chunk prefix counts used by rank() and select(), building them if a mutation dropped them.
+ * @return The prefix counts.
+ */
+    const RoaringBitmap::Prefix &RoaringBitmap::ensurePrefix() const {
+        return prefix.get([&] {
+            Prefix built;
+            built.counts.resize(chunks.size() + 1);
+            for (std::size_t i = 0; i < chunks.size(); ++i) {
+                built.counts[i + 1] = built.counts[i] + chunks[i]->cardinality;
+            }
+            built.stamp = nextCacheStamp();
+            return built;
+        });
+    }
+
+/**
+ * @brief Drops the prefix counts after a mutation; per-thread select counts keyed by their stamp go stale with them.
+ */
+    void RoaringBitmap::invalidate() {
+        prefix.clear();
+    }
+
+/**
+ * @brief Adds a value to the bitmap.
+ * @param value The value to add.
+ * @return `true` if the value was not present before.
+ */
+    bool RoaringBitmap::add(int value) {
+        const std::uint32_t key = toKey(value);
+        const auto high = static_cast<std::uint16_t>(key >> 16U);
+        std::size_t index = findChunk(high);
+        if (index == chunks.size() || chunks[index]->high != high) {
+            Chunk chunk;
+            chunk.high = high;
+            chunks.insert(chunks.begin() + static_cast<std::ptrdiff_t>(index), CowPtr<Chunk>(std::move(chunk)));
+        } else if (chunks[index]->contains(static_cast<std::uint16_t>(key))) {
+            return false;
+        }
+        chunks[index].write().add(static_cast<std::uint16_t>(key));
+        invalidate();
+        return true;
+    }
+
+/**
+ * @brief Removes a value from the bitmap. A chunk that becomes empty is dropped.
+ * @param value The value to remove.
+ * @return `true` if the value was present.
+ */
+    bool RoaringBitmap::remove(int value) {
+        const std::uint32_t key = toKey(value);
+        const auto high = static_cast<std::uint16_t>(key >> 16U);
+        std::size_t index = findChunk(high);
+        if (index == chunks.size() || chunks[index]->high != high ||
+            !chunks[index]->contains(static_cast<std::uint16_t>(key))) {
+            return false;
+        }
+        chunks[index].write().remove(static_cast<std::uint16_t>(key));
+        if (chunks[index]->cardinality == 0) {
+            chunks.erase(chunks.begin() + static_cast<std::ptrdiff_t>(index));
+        }
+        invalidate();
+        return true;
+    }
+
+/**
+ * @brief Check whether a value is in the bitmap.
+ * @param value The value to look for.
+ * @return `true` if the value is present.
+ */
+    bool RoaringBitmap::contains(int value) const {
+        const std::uint32_t key = toKey(value);
+        const auto high = static_cast<std::uint16_t>(key >> 16U);
+        std::size_t index = findChunk(high);
+        return index < chunks.size() && chunks[index]->high == high &&
+               chunks[index]->contains(static_cast<std::uint16_t>(key));
+    }
+
+/**
+ * @brief Get the number of values in the bitmap.
+ * @return The cardinality.
+ */
+    std::size_t RoaringBitmap::cardinality() const {
+        return ensurePrefix().counts.back();
+    }
+
+/**
+ * @brief Counts the values smaller than the given value.
+ * @param value The value to rank.
+ * @return The number of values < value, which is also the position value would have in ascending order.
+ */
+    std::size_t RoaringBitmap::rank(int value) const {
+        const std::vector<std::size_t> &counts = ensurePrefix().counts;
+        const std::uint32_t key = toKey(value);
+        const auto high = static_cast<std::uint16_t>(key >> 16U);
+        std::size_t index = findChunk(high);
+        if (index == chunks.size() || chunks[index]->high != high) {
+            return counts[index];
+        }
+        return counts[index] + chunks[index]->rank(static_cast<std::uint16_t>(key));
+    }
+
+/**
+ * @brief Finds the value with the given position in ascending order.
+ * Each thread keeps the set-bit counts per block of words for the last few bitmap chunks it selected in, so a
+ * select there is a binary search plus one block scan whatever order the ranks come in, side-cross included.
+ * @param rank The position, smaller than cardinality().
+ * @return The value at that position.
+ * @throws std::out_of_range if the rank is out of range.
+ */
+    int RoaringBitmap::select(std::size_t rank) const {
+        const Prefix &counted = ensurePrefix();
+        const std::vector<std::size_t> &counts = counted.counts;
+        if (rank >= counts.back()) {
+            throw std::out_of_range("Error: Invalid index.");
+        }
+        auto after = std::upper_bound(counts.begin(), counts.end(), rank);
+        const auto index = static_cast<std::size_t>(after - counts.begin()) - 1;
+        const Chunk &chunk = *chunks[index];
+        auto local = static_cast<std::uint32_t>(rank - counts[index]);
+        const std::uint32_t base = static_cast<std::uint32_t>(chunk.high) << 16U;
+
+        if (chunk.kind != ChunkKind::Bitmap) {
+            return fromKey(base | chunk.select(local));
+        }
+
+        static_assert(SelectBlocks * SelectBlockWords == BitmapWords);
+        SelectBlockCache &cache = selectBlocks;
+        auto slot = std::find_if(cache.slots.begin(), cache.slots.end(), [&](const SelectBlockCounts &counts) {
+            return counts.stamp == counted.stamp && counts.chunk == index;
+        });
+        if (slot == cache.slots.end()) {
+            slot = cache.slots.begin() + static_cast<std::ptrdiff_t>(cache.next);
+            cache.next = (cache.next + 1) % cache.slots.size();
+            std::uint32_t total = 0;
+            for (std::size_t block = 0; block < SelectBlocks; ++block) {
+                slot->before[block] = static_cast<std::uint16_t>(total);
+                for (std::size_t i = 0; i < SelectBlockWords; ++i) {
+                    total += static_cast<std::uint32_t>(std::popcount(chunk.bits[block * SelectBlockWords + i]));
+                }
+            }
+            slot->stamp = counted.stamp;
+            slot->chunk = index;
+        }
+
+        auto block = std::upper_bound(slot->before.begin(), slot->before.end(), local) - slot->before.begin() - 1;
+        std::size_t word = static_cast<std::size_t>(block) * SelectBlockWords;
+        std::uint32_t before = slot->before[static_cast<std::size_t>(block)];
+        for (;; ++word) {
+            auto count = static_cast<std::uint32_t>(std::popcount(chunk.bits[word]));
+            if (local < before + count) {
+                break;
+            }
+            before += count;
+        }
+        return fromKey(base | static_cast<std::uint32_t>(word * 64 + selectInWord(chunk.bits[word], local - before)));
+    }
+
+/**
+ * @brief Removes every value from the bitmap and releases its chunks.
+ */
+    void RoaringBitmap::clear() {
+        chunks = std::vector<CowPtr<Chunk>>();
+        invalidate();
+    }
+
+/**
+ * @brief Converts every chunk whose values form few enough runs to the run representation.
+ */
+    void RoaringBitmap::runOptimize() {
+        for (CowPtr<Chunk> &chunk: chunks) {
+            chunk.write().runOptimize();
+        }
+        invalidate();
+    }
+
+/**
+ * @brief Releases the slack capacity of the chunk list and of every chunk. A chunk without slack is left
+ * shared with the copies of the bitmap that share it.
+ */
+    void RoaringBitmap::shrinkToFit() {
+        chunks.shrink_to_fit();
+        for (CowPtr<Chunk> &chunk: chunks) {
+            if (chunk->array.capacity() == chunk->array.size() && chunk->bits.capacity() == chunk->bits.size() &&
+                chunk->runs.capacity() == chunk->runs.size()) {
+                continue;
+            }
+            Chunk &writable = chunk.write();
+            writable.array.shrink_to_fit();
+            writable.bits.shrink_to_fit();
+            writable.runs.shrink_to_fit();
+        }
+    }
+
+/**
+ * @brief Builds the bitmap of the prime values in this bitmap.
+ * The chunk of the values 0..65535 is intersected with the compile-time small prime table, word by word
+ * when it is a bitmap. Chunks of negative values are skipped, and the values of every other chunk are
+ * classified with the batch prime kernel.
+ * @return A bitmap holding exactly the prime values of this one.
+ */
+    RoaringBitmap RoaringBitmap::primes() const {
+        RoaringBitmap result;
+        for (const CowPtr<Chunk> &entry: chunks) {
+            const Chunk &chunk = *entry;
+            if (chunk.high < SmallValueChunk) {
+                continue;
+            }
+            Chunk out;
+            out.high = chunk.high;
+            if (chunk.high == SmallValueChunk && chunk.kind == ChunkKind::Bitmap) {
+                out.kind = ChunkKind::Bitmap;
+                out.bits.resize(BitmapWords);
+                for (std::size_t word = 0; word < BitmapWords; ++word) {
+                    out.bits[word] = chunk.bits[word] & SmallPrimes[word];
+                    out.cardinality += static_cast<std::uint32_t>(std::popcount(out.bits[word]));
+                }
+                if (out.cardinality <= ArrayLimit) {
+                    out.toArray();
+                }
+            } else if (chunk.high == SmallValueChunk) {
+                chunk.forEach([&](std::uint16_t low) {
+                    if (isSmallPrime(low)) {
+                        out.array.push_back(low);
+                    }
+                });
+            } else {
+                std::vector<int> values;
+                values.reserve(chunk.cardinality);
+                const std::uint32_t base = static_cast<std::uint32_t>(chunk.high) << 16U;
+                chunk.forEach([&](std::uint16_t low) {
+                    values.push_back(fromKey(base | low));
+                });
+                std::vector<std::uint64_t> bitmap = classifyPrimes(values);
+                for (std::size_t i = 0; i < values.size(); ++i) {
+                    if (((bitmap[i / 64] >> (i % 64)) & 1U) != 0) {
+                        out.array.push_back(static_cast<std::uint16_t>(toKey(values[i])));
+                    }
+                }
+            }
+            if (out.kind == ChunkKind::Array) {
+                out.cardinality = static_cast<std::uint32_t>(out.array.size());
+                if (out.cardinality > ArrayLimit) {
+                    out.toBitmap();
+                }
+            }
+            if (out.cardinality > 0) {
+                result.chunks.emplace_back(std::move(out));
+            }
+        }
+        result.invalidate();
+        return result;
+    }
+
+/**
+ * @brief Copies the values of the bitmap into a sorted vector.
+ * @return The values in ascending order.
+ */
+    std::vector<int> RoaringBitmap::toVector() const {
+        std::vector<int> values;
+        values.reserve(cardinality());
+        forEach([&](int value) {
+            values.push_back(value);
+        });
+        return values;
+    }
+
+/**
+ * @brief Counts the chunks stored with the given representation.
+ * @param kind The chunk representation.
+ * @return The number of chunks of that kind.
+ */
+    std::size_t RoaringBitmap::countChunks(ChunkKind kind) const {
+        return static_cast<std::size_t>(std::count_if(chunks.begin(), chunks.end(), [&](const CowPtr<Chunk> &chunk) {
+            return chunk->kind == kind;
+        }));
+    }
+
+/**
+ * @brief Get the memory used by the bitmap.
+ * @return The number of bytes used by the chunk directory, the chunk containers and the prefix counts.
+ */
+    std::size_t RoaringBitmap::memoryBytes() const {
+        std::size_t total = chunks.capacity() * (sizeof(CowPtr<Chunk>) + sizeof(Chunk));
+        if (const Prefix *counted = prefix.find()) {
+            total += counted->counts.capacity() * sizeof(std::size_t);
+        }
+        for (const CowPtr<Chunk> &chunk: chunks) {
+            total += chunk->bytes();
+        }
+        return total;
+    }
+
+/**
+ * @brief Builds a bitmap from sorted, duplicate-free values, choosing the smallest representation per chunk.
+ * @param sorted The values in ascending order.
+ * @return The bitmap holding those values.
+ */
+    RoaringBitmap RoaringBitmap::fromSorted(std::span<const int> sorted) {
+        RoaringBitmap result;
+        std::size_t first = 0;
+        while (first < sorted.size()) {
+            const auto high = static_cast<std::uint16_t>(toKey(sorted[first]) >> 16U);
+            std::size_t last = first;
+            while (last < sorted.size() && static_cast<std::uint16_t>(toKey(sorted[last]) >> 16U) == high) {
+                ++last;
+            }
+            Chunk chunk;
+            chunk.high = high;
+            chunk.cardinality = static_cast<std::uint32_t>(last - first);
+            chunk.array.reserve(last - first);
+            for (std::size_t i = first; i < last; ++i) {
+                chunk.array.push_back(static_cast<std::uint16_t>(toKey(sorted[i])));
+            }
+            if (chunk.cardinality > ArrayLimit) {
+                chunk.toBitmap();
+            }
+            chunk.runOptimize();
+            result.chunks.emplace_back(std::move(chunk));
+            first = last;
+        }
+        result.invalidate();
+        return result;
+    }
+
+}
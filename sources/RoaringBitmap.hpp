@@ -0,0 +1,166 @@
+/**
+ * @file RoaringBitmap.hpp
+ * @class RoaringBitmap
+ * @brief A compressed bitmap of signed integers in the Roaring style.
+ * The 32-bit key space (the value with its sign bit flipped, so unsigned key order matches signed value order)
+ * is split into chunks of 2^16 keys. Every non-empty chunk is stored as whichever container suits its contents:
+ * a sorted array of 16-bit lows (up to 4096 values), a 65536-bit bitmap, or a list of runs. Insert, remove
+ * and membership only touch one chunk, so they cost a binary search over the chunk directory plus a bounded
+ * amount of work inside the chunk. rank() and select() use per-chunk prefix counts built by the first query
+ * after a change; any number of threads may query a bitmap at once.
+ * Chunks are held through copy-on-write handles, so copying a bitmap shares every chunk and a later change
+ * copies only the chunk it touches.
+ */
+
+#ifndef MAGICAL_ITERATORS_ROARINGBITMAP_HPP
+#define MAGICAL_ITERATORS_ROARINGBITMAP_HPP
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "CowPtr.hpp"
+#include "LazyCache.hpp"
+
+namespace ariel {
+
+    class RoaringBitmap {
+    public:
+
+        enum class ChunkKind {
+            Array, Bitmap, Run
+        };
+
+    private:
+
+        static constexpr std::uint32_t ArrayLimit = 4096;
+        static constexpr std::size_t BitmapWords = 1024;
+
+        /// A run of consecutive lows: start, start + 1, ..., start + length.
+        struct Run {
+            std::uint16_t start;
+            std::uint16_t length;
+        };
+
+        struct Chunk {
+            std::uint16_t high = 0;
+            ChunkKind kind = ChunkKind::Array;
+            std::uint32_t cardinality = 0;
+            std::vector<std::uint16_t> array;
+            std::vector<std::uint64_t> bits;
+            std::vector<Run> runs;
+
+            bool contains(std::uint16_t low) const;
+
+            bool add(std::uint16_t low);
+
+            bool remove(std::uint16_t low);
+
+            std::uint32_t rank(std::uint16_t low) const;
+
+            std::uint16_t select(std::uint32_t rank) const;
+
+            void toArray();
+
+            void toBitmap();
+
+            void expandRuns();
+
+            void runOptimize();
+
+            std::size_t bytes() const;
+
+            template<typename Function>
+            void forEach(Function fn) const {
+                switch (kind) {
+                    case ChunkKind::Array:
+                        for (std::uint16_t low: array) {
+                            fn(low);
+                        }
+                        break;
+                    case ChunkKind::Bitmap:
+                        for (std::size_t word = 0; word < bits.size(); ++word) {
+                            for (std::uint64_t set = bits[word]; set != 0; set &= set - 1) {
+                                fn(static_cast<std::uint16_t>(word * 64 + static_cast<std::size_t>(std::countr_zero(set))));
+                            }
+                        }
+                        break;
+                    case ChunkKind::Run:
+                        for (const Run &run: runs) {
+                            for (std::uint32_t low = run.start; low <= run.start + run.length; ++low) {
+                                fn(static_cast<std::uint16_t>(low));
+                            }
+                        }
+                        break;
+                }
+            }
+        };
+
+        /// The number of values before each chunk, plus the total; the stamp tells per-thread select counts apart.
+        struct Prefix {
+            std::vector<std::size_t> counts;
+            std::uint64_t stamp = 0;
+        };
+
+        std::vector<CowPtr<Chunk>> chunks;
+        LazyCache<Prefix> prefix;
+
+        static constexpr std::uint32_t toKey(int value) {
+            return static_cast<std::uint32_t>(value) ^ 0x80000000U;
+        }
+
+        static constexpr int fromKey(std::uint32_t key) {
+            return static_cast<int>(key ^ 0x80000000U);
+        }
+
+        std::size_t findChunk(std::uint16_t high) const;
+
+        const Prefix &ensurePrefix() const;
+
+        void invalidate();
+
+    public:
+
+        bool add(int value);
+
+        bool remove(int value);
+
+        bool contains(int value) const;
+
+        std::size_t cardinality() const;
+
+        std::size_t rank(int value) const;
+
+        int select(std::size_t rank) const;
+
+        void clear();
+
+        void runOptimize();
+
+        void shrinkToFit();
+
+        RoaringBitmap primes() const;
+
+        std::vector<int> toVector() const;
+
+        std::size_t countChunks(ChunkKind kind) const;
+
+        std::size_t memoryBytes() const;
+
+        static RoaringBitmap fromSorted(std::span<const int> sorted);
+
+        template<typename Function>
+        void forEach(Function fn) const {
+            for (const CowPtr<Chunk> &chunk: chunks) {
+                const std::uint32_t base = static_cast<std::uint32_t>(chunk->high) << 16U;
+                chunk->forEach([&](std::uint16_t low) {
+                    fn(fromKey(base | low));
+                });
+            }
+        }
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_ROARINGBITMAP_HPP
@@ -0,0 +1,218 @@
+//
+// Set algebra kernels for sorted flagged spans.
+//
+
+#include "SetKernel.hpp"
+#include "PrimeKernel.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <iterator>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::size_t BlockLanes = 8;
+
+        /// Which values an operation keeps: those only in the left input, only in the right one, or in both.
+        struct Rule {
+            bool onlyLeft;
+            bool onlyRight;
+            bool both;
+        };
+
+        Rule ruleOf(SetOperation operation) {
+            switch (operation) {
+                case SetOperation::Union:
+                    return {true, true, true};
+                case SetOperation::Intersection:
+                    return {false, false, true};
+                case SetOperation::Difference:
+                    return {true, false, false};
+                case SetOperation::SymmetricDifference:
+                    break;
+            }
+            return {true, true, false};
+        }
+
+        bool flagAt(std::span<const std::uint64_t> flags, std::size_t index) {
+            return ((flags[index / 64] >> (index % 64)) & 1U) != 0;
+        }
+
+        /// Appends values and their flags to a result sized for at most capacity values.
+        class Output {
+        private:
+
+            FlaggedValues &result;
+
+        public:
+
+            Output(FlaggedValues &result, std::size_t capacity) : result(result) {
+                result.values.reserve(capacity);
+                result.flags.assign(primeBitmapWords(capacity), 0);
+            }
+
+            void push(int value, bool flag) {
+                const std::size_t index = result.values.size();
+                result.values.push_back(value);
+                result.flags[index / 64] |= static_cast<std::uint64_t>(flag) << (index % 64);
+            }
+
+            void copy(std::span<const int> values, std::span<const std::uint64_t> flags, std::size_t begin,
+                      std::size_t end) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    push(values[i], flagAt(flags, i));
+                }
+            }
+
+            void finish() {
+                result.flags.resize(primeBitmapWords(result.values.size()));
+            }
+        };
+
+        void mergeSorted(Rule rule, std::span<const int> left, std::span<const std::uint64_t> leftFlags,
+                         std::span<const int> right, std::span<const std::uint64_t> rightFlags, std::size_t i,
+                         std::size_t j, Output &out) {
+            while (i < left.size() && j < right.size()) {
+                if (left[i] < right[j]) {
+                    if (rule.onlyLeft) {
+                        out.push(left[i], flagAt(leftFlags, i));
+                    }
+                    ++i;
+                } else if (right[j] < left[i]) {
+                    if (rule.onlyRight) {
+                        out.push(right[j], flagAt(rightFlags, j));
+                    }
+                    ++j;
+                } else {
+                    if (rule.both) {
+                        out.push(left[i], flagAt(leftFlags, i));
+                    }
+                    ++i;
+                    ++j;
+                }
+            }
+            if (rule.onlyLeft) {
+                out.copy(left, leftFlags, i, left.size());
+            }
+            if (rule.onlyRight) {
+                out.copy(right, rightFlags, j, right.size());
+            }
+        }
+
+        /// Compares a block of 8 left values with a block of 8 right values at a time and advances the block
+        /// with the smaller last value, or both. The remainder is merged one value at a time.
+        void intersectBlocks(std::span<const int> left, std::span<const std::uint64_t> leftFlags,
+                             std::span<const int> right, std::span<const std::uint64_t> rightFlags, Output &out) {
+            std::size_t i = 0;
+            std::size_t j = 0;
+            while (i + BlockLanes <= left.size() && j + BlockLanes <= right.size()) {
+                const int *leftBlock = left.data() + i;
+                const int *rightBlock = right.data() + j;
+                std::uint32_t matches = 0;
+                for (std::size_t lane = 0; lane < BlockLanes; ++lane) {
+                    std::uint32_t hit = 0;
+                    for (std::size_t other = 0; other < BlockLanes; ++other) {
+                        hit |= static_cast<std::uint32_t>(leftBlock[lane] == rightBlock[other]);
+                    }
+                    matches |= hit << lane;
+                }
+                for (; matches != 0; matches &= matches - 1) {
+                    const auto lane = static_cast<std::size_t>(std::countr_zero(matches));
+                    out.push(leftBlock[lane], flagAt(leftFlags, i + lane));
+                }
+                const int leftLast = leftBlock[BlockLanes - 1];
+                const int rightLast = rightBlock[BlockLanes - 1];
+                i += leftLast <= rightLast ? BlockLanes : 0;
+                j += rightLast <= leftLast ? BlockLanes : 0;
+            }
+            mergeSorted(ruleOf(SetOperation::Intersection), left, leftFlags, right, rightFlags, i, j, out);
+        }
+
+        /// Walks the small input and gallops through the large one, copying the runs of the large input
+        /// between two small values as a whole when the operation keeps them.
+        void gallopSmall(Rule rule, bool smallIsLeft, std::span<const int> small,
+                         std::span<const std::uint64_t> smallFlags, std::span<const int> large,
+                         std::span<const std::uint64_t> largeFlags, Output &out) {
+            const bool keepLargeOnly = smallIsLeft ? rule.onlyRight : rule.onlyLeft;
+            const bool keepSmallOnly = smallIsLeft ? rule.onlyLeft : rule.onlyRight;
+            std::size_t position = 0;
+            for (std::size_t k = 0; k < small.size(); ++k) {
+                const std::size_t found = gallop(large, position, small[k]);
+                if (keepLargeOnly) {
+                    out.copy(large, largeFlags, position, found);
+                }
+                const bool both = found < large.size() && large[found] == small[k];
+                if (both ? rule.both : keepSmallOnly) {
+                    out.push(small[k], both && !smallIsLeft ? flagAt(largeFlags, found) : flagAt(smallFlags, k));
+                }
+                position = both ? found + 1 : found;
+            }
+            if (keepLargeOnly) {
+                out.copy(large, largeFlags, position, large.size());
+            }
+        }
+
+    }
+
+/**
+ * @brief Finds the first position at or after from whose value is not less than target, probing from, from + 1,
+ * from + 3, from + 7, ... before a binary search, so the cost grows with the distance travelled.
+ * @param values Sorted values.
+ * @param from The position to start from.
+ * @param target The value to look for.
+ * @return The position found, or values.size() if every value from there on is less than target.
+ */
+    std::size_t gallop(std::span<const int> values, std::size_t from, int target) {
+        std::size_t low = from;
+        std::size_t high = from;
+        std::size_t step = 1;
+        while (high < values.size() && values[high] < target) {
+            low = high + 1;
+            high += step;
+            step *= 2;
+        }
+        high = std::min(high, values.size());
+        auto first = values.begin() + static_cast<std::ptrdiff_t>(low);
+        auto last = values.begin() + static_cast<std::ptrdiff_t>(high);
+        return static_cast<std::size_t>(std::distance(values.begin(), std::lower_bound(first, last, target)));
+    }
+
+/**
+ * @brief Computes a set operation between two sorted, duplicate-free flagged inputs.
+ * A value in both inputs keeps the flag it has on the left.
+ * @param operation The operation; Difference keeps the left values that are not on the right.
+ * @param left The left values.
+ * @param leftFlags One bit per left value.
+ * @param right The right values.
+ * @param rightFlags One bit per right value.
+ * @return The sorted result and its flags.
+ */
+    FlaggedValues combineSorted(SetOperation operation, std::span<const int> left,
+                                std::span<const std::uint64_t> leftFlags, std::span<const int> right,
+                                std::span<const std::uint64_t> rightFlags) {
+        const Rule rule = ruleOf(operation);
+        std::size_t capacity = left.size() + right.size();
+        if (operation == SetOperation::Intersection) {
+            capacity = std::min(left.size(), right.size());
+        } else if (operation == SetOperation::Difference) {
+            capacity = left.size();
+        }
+
+        FlaggedValues result;
+        Output out(result, capacity);
+        if (left.size() > right.size() * GallopRatio) {
+            gallopSmall(rule, false, right, rightFlags, left, leftFlags, out);
+        } else if (right.size() > left.size() * GallopRatio) {
+            gallopSmall(rule, true, left, leftFlags, right, rightFlags, out);
+        } else if (operation == SetOperation::Intersection) {
+            intersectBlocks(left, leftFlags, right, rightFlags, out);
+        } else {
+            mergeSorted(rule, left, leftFlags, right, rightFlags, 0, 0, out);
+        }
+        out.finish();
+        return result;
+    }
+
+}
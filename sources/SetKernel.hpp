@@ -0,0 +1,45 @@
+/**
+ * @file SetKernel.hpp
+ * @brief Set algebra on sorted, duplicate-free spans of integers that carry one flag bit per element.
+ * Every operation walks both inputs once and writes the result together with its flags, so a flag such as
+ * primality is carried from the inputs to the output instead of being recomputed. Intersections of inputs of
+ * similar size compare blocks of 8 values against each other in straight-line lane loops that the compiler
+ * can vectorize; the other operations merge one value at a time. When one input is more than GallopRatio
+ * times larger than the other, every operation walks the small input instead and finds each of its values in
+ * the large one by galloping, copying the runs of the large input in between as a whole.
+ */
+
+#ifndef MAGICAL_ITERATORS_SETKERNEL_HPP
+#define MAGICAL_ITERATORS_SETKERNEL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace ariel {
+
+    enum class SetOperation {
+        Union, Intersection, Difference, SymmetricDifference
+    };
+
+    constexpr std::size_t GallopRatio = 32;
+
+/**
+ * @struct FlaggedValues
+ * @brief Sorted, duplicate-free values with one flag bit per value, 64 to a word as in classifyPrimes().
+ */
+    struct FlaggedValues {
+        std::vector<int> values;
+        std::vector<std::uint64_t> flags;
+    };
+
+    std::size_t gallop(std::span<const int> values, std::size_t from, int target);
+
+    FlaggedValues combineSorted(SetOperation operation, std::span<const int> left,
+                                std::span<const std::uint64_t> leftFlags, std::span<const int> right,
+                                std::span<const std::uint64_t> rightFlags);
+
+}
+
+#endif //MAGICAL_ITERATORS_SETKERNEL_HPP
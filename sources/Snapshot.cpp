@@ -0,0 +1,237 @@
+//
+// Binary snapshot format and memory-mapped reader.
+//
+
+#include "Snapshot.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr char Magic[8] = {'M', 'A', 'G', 'I', 'C', 'A', 'L', 'C'};
+        constexpr std::uint64_t SectionAlignment = 64;
+        constexpr std::uint64_t ChecksumSeed = 0xcbf29ce484222325ULL;
+        constexpr std::uint64_t ChecksumPrime = 0x100000001b3ULL;
+
+        std::uint64_t alignUp(std::uint64_t offset) {
+            return (offset + SectionAlignment - 1) & ~(SectionAlignment - 1);
+        }
+
+        /// FNV-1a over 64-bit words, finishing byte by byte.
+        std::uint64_t checksum(std::uint64_t hash, const void *data, std::size_t size) {
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            std::size_t i = 0;
+            for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+                std::uint64_t word = 0;
+                std::memcpy(&word, bytes + i, sizeof(word));
+                hash = (hash ^ word) * ChecksumPrime;
+            }
+            for (; i < size; ++i) {
+                hash = (hash ^ bytes[i]) * ChecksumPrime;
+            }
+            return hash;
+        }
+
+        /// Closes a file descriptor when it goes out of scope.
+        struct FileDescriptor {
+            int fd;
+
+            explicit FileDescriptor(int fd) : fd(fd) {}
+
+            FileDescriptor(const FileDescriptor &) = delete;
+
+            FileDescriptor &operator=(const FileDescriptor &) = delete;
+
+            ~FileDescriptor() {
+                if (fd >= 0) {
+                    ::close(fd);
+                }
+            }
+        };
+
+        void writeAll(int fd, const void *data, std::size_t size) {
+            const auto *bytes = static_cast<const char *>(data);
+            while (size > 0) {
+                ssize_t written = ::write(fd, bytes, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    throw std::runtime_error("Error: Failed to write snapshot");
+                }
+                bytes += written;
+                size -= static_cast<std::size_t>(written);
+            }
+        }
+
+        void writeZeros(int fd, std::size_t size) {
+            const std::vector<char> zeros(size, 0);
+            writeAll(fd, zeros.data(), zeros.size());
+        }
+
+    }
+
+/**
+ * @brief Writes a snapshot file.
+ * The snapshot is written and synced to path + ".tmp" first and then renamed over path, so a reader never
+ * sees a partial file and a container mapped from path keeps its old mapping while it saves over it.
+ * @param path The path of the file to create or replace.
+ * @param elements The sorted elements.
+ * @param primeIndex The ascending positions of the prime elements in elements.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+    void MappedSnapshot::write(const std::string &path, std::span<const int> elements,
+                               std::span<const std::uint32_t> primeIndex) {
+        SnapshotHeader header{};
+        std::memcpy(header.magic, Magic, sizeof(Magic));
+        header.version = Version;
+        header.headerSize = sizeof(SnapshotHeader);
+        header.count = elements.size();
+        header.primeCount = primeIndex.size();
+        header.elementsOffset = alignUp(sizeof(SnapshotHeader));
+        header.primesOffset = alignUp(header.elementsOffset + elements.size_bytes());
+        header.checksum = checksum(checksum(ChecksumSeed, elements.data(), elements.size_bytes()),
+                                   primeIndex.data(), primeIndex.size_bytes());
+
+        const std::string temporary = path + ".tmp";
+        try {
+            FileDescriptor file(::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644));
+            if (file.fd < 0) {
+                throw std::runtime_error("Error: Failed to open snapshot file " + temporary);
+            }
+            writeAll(file.fd, &header, sizeof(header));
+            writeZeros(file.fd, header.elementsOffset - sizeof(header));
+            writeAll(file.fd, elements.data(), elements.size_bytes());
+            writeZeros(file.fd, header.primesOffset - header.elementsOffset - elements.size_bytes());
+            writeAll(file.fd, primeIndex.data(), primeIndex.size_bytes());
+            if (::fsync(file.fd) != 0) {
+                throw std::runtime_error("Error: Failed to write snapshot");
+            }
+        } catch (...) {
+            ::unlink(temporary.c_str());
+            throw;
+        }
+        if (::rename(temporary.c_str(), path.c_str()) != 0) {
+            ::unlink(temporary.c_str());
+            throw std::runtime_error("Error: Failed to replace snapshot file " + path);
+        }
+    }
+
+/**
+ * @brief Maps a snapshot file into memory.
+ * The header is validated and the prime index is range-checked; the element array is served straight from
+ * the mapping without being read. Verification also reads the whole file once to compare the checksum and to
+ * check that the elements are strictly ascending, which a checksum written over unsorted input would not catch.
+ * @param path The path of the snapshot file.
+ * @param verify `true` to also validate the checksum and the element order.
+ * @return The mapped snapshot.
+ * @throws std::runtime_error if the file cannot be mapped or is not a valid snapshot.
+ */
+    MappedSnapshot MappedSnapshot::open(const std::string &path, bool verify) {
+        if constexpr (std::endian::native != std::endian::little) {
+            throw std::runtime_error("Error: Snapshots are only supported on little-endian targets");
+        }
+
+        FileDescriptor file(::open(path.c_str(), O_RDONLY));
+        if (file.fd < 0) {
+            throw std::runtime_error("Error: Failed to open snapshot file " + path);
+        }
+        struct stat status{};
+        if (::fstat(file.fd, &status) != 0 || status.st_size < static_cast<off_t>(sizeof(SnapshotHeader))) {
+            throw std::runtime_error("Error: Invalid snapshot file " + path);
+        }
+        const auto fileBytes = static_cast<std::size_t>(status.st_size);
+        void *address = ::mmap(nullptr, fileBytes, PROT_READ, MAP_PRIVATE, file.fd, 0);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("Error: Failed to map snapshot file " + path);
+        }
+
+        MappedSnapshot snapshot;
+        snapshot.mapping = std::shared_ptr<const void>(address, [fileBytes](const void *mapped) {
+            ::munmap(const_cast<void *>(mapped), fileBytes);
+        });
+        snapshot.mappingBytes = fileBytes;
+
+        SnapshotHeader header{};
+        std::memcpy(&header, address, sizeof(header));
+        // Each section must lie inside the file; the divisions keep the checks free of overflow.
+        auto fits = [fileBytes](std::uint64_t offset, std::uint64_t items, std::uint64_t width) {
+            return offset <= fileBytes && items <= (fileBytes - offset) / width;
+        };
+        if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version ||
+            header.headerSize != sizeof(SnapshotHeader) || header.elementsOffset < sizeof(SnapshotHeader) ||
+            header.elementsOffset % SectionAlignment != 0 || header.primesOffset % SectionAlignment != 0 ||
+            header.count > static_cast<std::uint64_t>(std::numeric_limits<int>::max()) ||
+            header.primeCount > header.count || !fits(header.elementsOffset, header.count, sizeof(int)) ||
+            header.primesOffset < header.elementsOffset + header.count * sizeof(int) ||
+            !fits(header.primesOffset, header.primeCount, sizeof(std::uint32_t))) {
+            throw std::runtime_error("Error: Invalid snapshot file " + path);
+        }
+
+        const auto *base = static_cast<const char *>(address);
+        snapshot.count = static_cast<std::size_t>(header.count);
+        snapshot.primes = static_cast<std::size_t>(header.primeCount);
+        snapshot.values = reinterpret_cast<const int *>(base + header.elementsOffset);
+        snapshot.primeRanks = reinterpret_cast<const std::uint32_t *>(base + header.primesOffset);
+
+        // Every prime position is dereferenced without further checks, so the prime index is always checked
+        // to be strictly ascending and in range; this reads only the (small) prime section.
+        std::span<const std::uint32_t> primeIndex = snapshot.primeIndex();
+        for (std::size_t k = 0; k < primeIndex.size(); ++k) {
+            if (primeIndex[k] >= snapshot.count || (k > 0 && primeIndex[k] <= primeIndex[k - 1])) {
+                throw std::runtime_error("Error: Invalid snapshot file " + path);
+            }
+        }
+        if (verify) {
+            std::span<const int> elements = snapshot.elements();
+            std::uint64_t actual = checksum(checksum(ChecksumSeed, elements.data(), elements.size_bytes()),
+                                            primeIndex.data(), primeIndex.size_bytes());
+            if (actual != header.checksum) {
+                throw std::runtime_error("Error: Snapshot checksum mismatch in " + path);
+            }
+            if (std::adjacent_find(elements.begin(), elements.end(), std::greater_equal<>()) != elements.end()) {
+                throw std::runtime_error("Error: Invalid snapshot file " + path);
+            }
+        }
+        return snapshot;
+    }
+
+/**
+ * @brief Get the mapped element array.
+ * @return The sorted elements.
+ */
+    std::span<const int> MappedSnapshot::elements() const {
+        return {values, count};
+    }
+
+/**
+ * @brief Get the mapped prime index.
+ * @return The ascending positions of the prime elements in elements().
+ */
+    std::span<const std::uint32_t> MappedSnapshot::primeIndex() const {
+        return {primeRanks, primes};
+    }
+
+/**
+ * @brief Get the size of the mapping.
+ * @return The number of mapped bytes, which live in the page cache rather than on the heap.
+ */
+    std::size_t MappedSnapshot::mappedBytes() const {
+        return mappingBytes;
+    }
+
+}
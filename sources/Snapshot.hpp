@@ -0,0 +1,65 @@
+/**
+ * @file Snapshot.hpp
+ * @class MappedSnapshot
+ * @brief The versioned binary snapshot format of a MagicalContainer and its memory-mapped reader.
+ * A snapshot file is a 64-byte header followed by the sorted element array (int32) and the prime index
+ * (uint32 positions of the prime elements in the element array), each starting on a 64-byte boundary.
+ * The header holds a magic string, the format version, the section offsets and sizes, and a checksum of
+ * both sections. Data is stored in native little-endian order, so a mapped file can serve the arrays
+ * directly from the page cache without any parsing or copying.
+ */
+
+#ifndef MAGICAL_ITERATORS_SNAPSHOT_HPP
+#define MAGICAL_ITERATORS_SNAPSHOT_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+
+namespace ariel {
+
+    struct SnapshotHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t headerSize;
+        std::uint64_t count;
+        std::uint64_t primeCount;
+        std::uint64_t elementsOffset;
+        std::uint64_t primesOffset;
+        std::uint64_t checksum;
+        std::uint64_t reserved;
+    };
+
+    static_assert(sizeof(SnapshotHeader) == 64, "The snapshot header must stay 64 bytes");
+
+    class MappedSnapshot {
+    private:
+
+        std::shared_ptr<const void> mapping;
+        std::size_t mappingBytes = 0;
+        const int *values = nullptr;
+        const std::uint32_t *primeRanks = nullptr;
+        std::size_t count = 0;
+        std::size_t primes = 0;
+
+    public:
+
+        static constexpr std::uint32_t Version = 1;
+
+        static void write(const std::string &path, std::span<const int> elements,
+                          std::span<const std::uint32_t> primeIndex);
+
+        static MappedSnapshot open(const std::string &path, bool verify);
+
+        std::span<const int> elements() const;
+
+        std::span<const std::uint32_t> primeIndex() const;
+
+        std::size_t mappedBytes() const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_SNAPSHOT_HPP
@@ -0,0 +1,186 @@
+//
+// Opt-in instrumentation of a MagicalContainer.
+//
+
+#include "Stats.hpp"
+#include "MagicalContainer.hpp"
+
+#include <bit>
+#include <cmath>
+#include <sstream>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::array<const char *, StatsOperationCount> OperationNames = {
+                "addElement", "addElements", "removeElement", "isPrime", "rebuildViews"
+        };
+
+    }
+
+/**
+ * @brief Records one latency sample. Several threads may record into the same histogram at once.
+ * @param nanoseconds The latency in nanoseconds. Samples beyond the last bucket are counted in it.
+ */
+    void LatencyHistogram::record(std::uint64_t nanoseconds) {
+        auto index = static_cast<std::size_t>(std::bit_width(nanoseconds));
+        countStatistic(buckets[index < BucketCount ? index : BucketCount - 1], 1U);
+        countStatistic(samples, 1U);
+        countStatistic(totalNanoseconds, nanoseconds);
+    }
+
+/**
+ * @brief Copies the histogram while other threads may still be recording into it.
+ * @return A copy of every bucket and total.
+ */
+    LatencyHistogram LatencyHistogram::snapshot() const {
+        LatencyHistogram copy;
+        for (std::size_t index = 0; index < BucketCount; ++index) {
+            copy.buckets[index] = loadStatistic(buckets[index]);
+        }
+        copy.samples = loadStatistic(samples);
+        copy.totalNanoseconds = loadStatistic(totalNanoseconds);
+        return copy;
+    }
+
+/**
+ * @brief Get the number of recorded samples.
+ * @return The number of samples.
+ */
+    std::uint64_t LatencyHistogram::count() const {
+        return samples;
+    }
+
+/**
+ * @brief Get the number of samples in one bucket.
+ * @param index The bucket, holding the samples in [2^(index-1), 2^index) ns.
+ * @return The number of samples in the bucket.
+ * @throws std::out_of_range if the index is out of range.
+ */
+    std::uint64_t LatencyHistogram::bucket(std::size_t index) const {
+        return buckets.at(index);
+    }
+
+/**
+ * @brief Get the mean latency.
+ * @return The mean of the samples in nanoseconds, or 0 if there are none.
+ */
+    double LatencyHistogram::meanNanoseconds() const {
+        return samples == 0 ? 0 : static_cast<double>(totalNanoseconds) / static_cast<double>(samples);
+    }
+
+/**
+ * @brief Get an upper bound of a latency quantile.
+ * @param quantile The quantile, in [0, 1].
+ * @return The upper end of the bucket holding the quantile in nanoseconds, or 0 if there are no samples.
+ */
+    std::uint64_t LatencyHistogram::quantileNanoseconds(double quantile) const {
+        if (samples == 0) {
+            return 0;
+        }
+        auto rank = static_cast<std::uint64_t>(std::ceil(quantile * static_cast<double>(samples)));
+        rank = rank == 0 ? 1 : rank;
+        std::uint64_t seen = 0;
+        for (std::size_t index = 0; index < BucketCount; ++index) {
+            seen += buckets[index];
+            if (seen >= rank) {
+                return index == 0 ? 0 : (std::uint64_t{1} << index) - 1;
+            }
+        }
+        return (std::uint64_t{1} << (BucketCount - 1)) - 1;
+    }
+
+/**
+ * @brief Notes the current size of the container's storage, counting any growth as allocated bytes.
+ * @param bytes The bytes now reserved by the storage and its views.
+ */
+    void ContainerStats::recordFootprint(std::size_t bytes) {
+        if (bytes > footprintBytes) {
+            bytesAllocated += bytes - footprintBytes;
+        }
+        footprintBytes = bytes;
+    }
+
+/**
+ * @brief Copies the statistics while threads reading the container may still be counting into them.
+ * @return A copy of every counter and histogram.
+ */
+    ContainerStats ContainerStats::snapshot() const {
+        ContainerStats copy;
+        copy.addElementCalls = loadStatistic(addElementCalls);
+        copy.removeElementCalls = loadStatistic(removeElementCalls);
+        copy.primalityTests = loadStatistic(primalityTests);
+        copy.viewRebuilds = loadStatistic(viewRebuilds);
+        copy.bytesAllocated = bytesAllocated;
+        copy.iteratorConstructions = loadStatistic(iteratorConstructions);
+        copy.footprintBytes = footprintBytes;
+        for (std::size_t operation = 0; operation < StatsOperationCount; ++operation) {
+            copy.latency[operation] = latency[operation].snapshot();
+        }
+        return copy;
+    }
+
+/**
+ * @brief Get the latency histogram of one operation.
+ * @param operation The operation.
+ * @return Its histogram.
+ */
+    const LatencyHistogram &ContainerStats::latencyOf(StatsOperation operation) const {
+        return latency[static_cast<std::size_t>(operation)];
+    }
+
+/**
+ * @brief Formats the counters and, for every operation that was timed, its sample count, mean, p50 and
+ * p99 and the non-empty histogram buckets.
+ * @return A multi-line text report.
+ */
+    std::string ContainerStats::dump() const {
+        std::ostringstream out;
+        out << "MagicalContainer stats" << (Enabled ? "" : " (disabled, build with MAGICAL_STATS)") << '\n'
+            << "  addElement calls:       " << addElementCalls << '\n'
+            << "  removeElement calls:    " << removeElementCalls << '\n'
+            << "  primality tests:        " << primalityTests << '\n'
+            << "  view rebuilds:          " << viewRebuilds << '\n'
+            << "  bytes allocated:        " << bytesAllocated << '\n'
+            << "  iterator constructions: " << iteratorConstructions << '\n';
+        for (std::size_t operation = 0; operation < StatsOperationCount; ++operation) {
+            const LatencyHistogram &histogram = latency[operation];
+            if (histogram.count() == 0) {
+                continue;
+            }
+            out << "  " << OperationNames[operation] << ": " << histogram.count() << " samples, mean "
+                << histogram.meanNanoseconds() << " ns, p50 <= " << histogram.quantileNanoseconds(0.5)
+                << " ns, p99 <= " << histogram.quantileNanoseconds(0.99) << " ns\n";
+            for (std::size_t index = 0; index < LatencyHistogram::BucketCount; ++index) {
+                if (histogram.bucket(index) != 0) {
+                    out << "    < " << (std::uint64_t{1} << index) << " ns: " << histogram.bucket(index) << '\n';
+                }
+            }
+        }
+        return out.str();
+    }
+
+/**
+ * @brief Get the instrumentation data of the MagicalContainer.
+ * @return A copy of its counters and histograms, all zero unless built with MAGICAL_STATS.
+ */
+    ContainerStats MagicalContainer::stats() const {
+#ifdef MAGICAL_STATS
+        return this->statistics.snapshot();
+#else
+        return {};
+#endif
+    }
+
+/**
+ * @brief Clears the counters and histograms of the MagicalContainer.
+ */
+    void MagicalContainer::resetStats() {
+#ifdef MAGICAL_STATS
+        this->statistics = ContainerStats{};
+        this->statistics.footprintBytes = storageBytes();
+#endif
+    }
+
+}
@@ -0,0 +1,150 @@
+/**
+ * @file Stats.hpp
+ * @brief Opt-in instrumentation of a MagicalContainer.
+ * When compiled with MAGICAL_STATS defined (`make STATS=1`), every container counts its element insertions
+ * and removals, primality tests, view rebuilds, iterator constructions and the bytes its vector storage grew
+ * by, and records the latency of its mutating operations in log2-bucketed histograms. Without it, the
+ * MAGICAL_STATS_* macros expand to nothing, the container holds no statistics and stats() returns zeros.
+ * Const queries count through relaxed atomic increments, so threads reading one container at once do not
+ * race on its statistics.
+ * Every translation unit must be built with the same setting, since it changes the container's layout.
+ */
+
+#ifndef MAGICAL_ITERATORS_STATS_HPP
+#define MAGICAL_ITERATORS_STATS_HPP
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ariel {
+
+    enum class StatsOperation : std::size_t {
+        AddElement, AddElements, RemoveElement, IsPrime, RebuildViews
+    };
+
+    constexpr std::size_t StatsOperationCount = 5;
+
+/**
+ * @brief Adds to a counter that threads reading the same container may bump at the same time.
+ * @param counter The counter.
+ * @param amount The amount to add.
+ */
+    inline void countStatistic(std::uint64_t &counter, std::uint64_t amount) {
+        std::atomic_ref<std::uint64_t>(counter).fetch_add(amount, std::memory_order_relaxed);
+    }
+
+/**
+ * @brief Reads a counter that other threads may be bumping through countStatistic().
+ * @param counter The counter, which must not belong to a const object.
+ * @return Its value.
+ */
+    inline std::uint64_t loadStatistic(const std::uint64_t &counter) {
+        return std::atomic_ref<std::uint64_t>(const_cast<std::uint64_t &>(counter)).load(std::memory_order_relaxed);
+    }
+
+/**
+ * @class LatencyHistogram
+ * @brief Counts latencies in power-of-two buckets: bucket b holds the samples in [2^(b-1), 2^b) ns.
+ */
+    class LatencyHistogram {
+    public:
+
+        static constexpr std::size_t BucketCount = 48;
+
+    private:
+
+        std::array<std::uint64_t, BucketCount> buckets{};
+        std::uint64_t samples = 0;
+        std::uint64_t totalNanoseconds = 0;
+
+    public:
+
+        void record(std::uint64_t nanoseconds);
+
+        LatencyHistogram snapshot() const;
+
+        std::uint64_t count() const;
+
+        std::uint64_t bucket(std::size_t index) const;
+
+        double meanNanoseconds() const;
+
+        std::uint64_t quantileNanoseconds(double quantile) const;
+    };
+
+/**
+ * @struct ContainerStats
+ * @brief The counters and latency histograms of one MagicalContainer.
+ */
+    struct ContainerStats {
+#ifdef MAGICAL_STATS
+        static constexpr bool Enabled = true;
+#else
+        static constexpr bool Enabled = false;
+#endif
+
+        std::uint64_t addElementCalls = 0;
+        std::uint64_t removeElementCalls = 0;
+        std::uint64_t primalityTests = 0;
+        std::uint64_t viewRebuilds = 0;
+        std::uint64_t bytesAllocated = 0;
+        std::uint64_t iteratorConstructions = 0;
+        std::size_t footprintBytes = 0;
+        std::array<LatencyHistogram, StatsOperationCount> latency{};
+
+        void recordFootprint(std::size_t bytes);
+
+        ContainerStats snapshot() const;
+
+        const LatencyHistogram &latencyOf(StatsOperation operation) const;
+
+        std::string dump() const;
+    };
+
+/**
+ * @class ScopedLatency
+ * @brief Records the time between its construction and destruction into a histogram.
+ */
+    class ScopedLatency {
+    private:
+
+        LatencyHistogram &histogram;
+        std::chrono::steady_clock::time_point start;
+
+    public:
+
+        explicit ScopedLatency(LatencyHistogram &histogram)
+                : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+
+        ScopedLatency(const ScopedLatency &) = delete;
+
+        ScopedLatency &operator=(const ScopedLatency &) = delete;
+
+        ~ScopedLatency() {
+            auto elapsed = std::chrono::steady_clock::now() - start;
+            histogram.record(static_cast<std::uint64_t>(
+                                     std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        }
+    };
+
+}
+
+#ifdef MAGICAL_STATS
+#define MAGICAL_STATS_CONCAT_IMPL(a, b) a##b
+#define MAGICAL_STATS_CONCAT(a, b) MAGICAL_STATS_CONCAT_IMPL(a, b)
+#define MAGICAL_STATS_COUNT(stats, counter, amount) (::ariel::countStatistic((stats).counter, (amount)))
+#define MAGICAL_STATS_FOOTPRINT(stats, bytes) ((stats).recordFootprint(bytes))
+#define MAGICAL_STATS_TIME(stats, operation) \
+    ::ariel::ScopedLatency MAGICAL_STATS_CONCAT(magicalStatsTimer, __LINE__)( \
+        (stats).latency[static_cast<std::size_t>(::ariel::StatsOperation::operation)])
+#else
+#define MAGICAL_STATS_COUNT(stats, counter, amount) static_cast<void>(0)
+#define MAGICAL_STATS_FOOTPRINT(stats, bytes) static_cast<void>(0)
+#define MAGICAL_STATS_TIME(stats, operation) static_cast<void>(0)
+#endif
+
+#endif //MAGICAL_ITERATORS_STATS_HPP
@@ -0,0 +1,141 @@
+//
+// Work-stealing thread pool.
+//
+
+#include "ThreadPool.hpp"
+
+namespace ariel {
+
+    namespace {
+
+        /// The pool the current thread works for, and the index of its queue there.
+        thread_local const ThreadPool *currentPool = nullptr;
+        thread_local std::size_t currentQueue = 0;
+
+    }
+
+/**
+ * @brief Starts the worker threads.
+ * @param workers The number of worker threads. Callers waiting in parallelChunks() work as well.
+ */
+    ThreadPool::ThreadPool(std::size_t workers) {
+        for (std::size_t i = 0; i <= workers; ++i) {
+            queues.push_back(std::make_unique<Queue>());
+        }
+        threads.reserve(workers);
+        for (std::size_t i = 0; i < workers; ++i) {
+            threads.emplace_back([this, i] {
+                work(i);
+            });
+        }
+    }
+
+/**
+ * @brief Stops and joins the workers. Tasks still queued are discarded.
+ */
+    ThreadPool::~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping.store(true);
+        }
+        sleepCondition.notify_all();
+        for (std::thread &thread: threads) {
+            thread.join();
+        }
+    }
+
+/**
+ * @brief Get the process-wide pool, with one worker per hardware thread besides the caller.
+ * @return The shared pool.
+ */
+    ThreadPool &ThreadPool::shared() {
+        static ThreadPool pool(std::thread::hardware_concurrency() > 1 ? std::thread::hardware_concurrency() - 1 : 0);
+        return pool;
+    }
+
+/**
+ * @brief Get the number of worker threads.
+ * @return The number of workers, not counting callers.
+ */
+    std::size_t ThreadPool::workerCount() const {
+        return threads.size();
+    }
+
+/**
+ * @brief Get the queue the current thread pushes to and pops from.
+ * @return Its own queue for a worker of this pool, the shared queue for any other thread.
+ */
+    std::size_t ThreadPool::ownQueue() const {
+        return currentPool == this ? currentQueue : queues.size() - 1;
+    }
+
+/**
+ * @brief Queues a task and wakes a sleeping worker.
+ * @param task The task to run.
+ */
+    void ThreadPool::submit(std::function<void()> task) {
+        Queue &queue = *queues[ownQueue()];
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.tasks.push_back(std::move(task));
+        }
+        pending.fetch_add(1);
+        // Taking the lock orders the increment before a worker's check of `pending`, so no wakeup is lost.
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+        }
+        sleepCondition.notify_one();
+    }
+
+/**
+ * @brief Runs one task: the newest of the thread's own queue, or else the oldest one stolen from another queue.
+ * @return `false` if every queue was empty.
+ */
+    bool ThreadPool::runOne() {
+        const std::size_t own = ownQueue();
+        std::function<void()> task;
+        for (std::size_t offset = 0; offset < queues.size() && !task; ++offset) {
+            const std::size_t index = (own + offset) % queues.size();
+            Queue &queue = *queues[index];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            if (queue.tasks.empty()) {
+                continue;
+            }
+            if (index == own) {
+                task = std::move(queue.tasks.back());
+                queue.tasks.pop_back();
+            } else {
+                task = std::move(queue.tasks.front());
+                queue.tasks.pop_front();
+            }
+        }
+        if (!task) {
+            return false;
+        }
+        pending.fetch_sub(1);
+        task();
+        return true;
+    }
+
+/**
+ * @brief The loop of a worker thread: runs tasks while there are any and sleeps otherwise.
+ * @param index The index of the worker's queue.
+ */
+    void ThreadPool::work(std::size_t index) {
+        currentPool = this;
+        currentQueue = index;
+        while (true) {
+            if (runOne()) {
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepCondition.wait(lock, [this] {
+                return stopping.load() || pending.load() > 0;
+            });
+            if (stopping.load()) {
+                return;
+            }
+        }
+    }
+
+}
@@ -0,0 +1,123 @@
+/**
+ * @file ThreadPool.hpp
+ * @class ThreadPool
+ * @brief A small work-stealing thread pool for the parallel traversals of a MagicalContainer.
+ * Every worker owns a deque of tasks: it pushes and pops its own tasks at the back, while idle workers steal
+ * from the front of the others' deques. Threads that are not workers submit to a shared queue, and a thread
+ * that waits in parallelChunks() runs tasks itself until its loop finishes, so a pool of N workers uses
+ * N + 1 threads and a pool of 0 workers runs everything on the caller.
+ */
+
+#ifndef MAGICAL_ITERATORS_THREADPOOL_HPP
+#define MAGICAL_ITERATORS_THREADPOOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ariel {
+
+    class ThreadPool {
+    private:
+
+        struct Queue {
+            std::mutex mutex;
+            std::deque<std::function<void()>> tasks;
+        };
+
+        /// One queue per worker, followed by the queue of the threads outside the pool.
+        std::vector<std::unique_ptr<Queue>> queues;
+        std::vector<std::thread> threads;
+        std::atomic<std::size_t> pending{0};
+        std::atomic<bool> stopping{false};
+        std::mutex sleepMutex;
+        std::condition_variable sleepCondition;
+
+        std::size_t ownQueue() const;
+
+        void work(std::size_t index);
+
+    public:
+
+        explicit ThreadPool(std::size_t workers);
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        ~ThreadPool();
+
+        static ThreadPool &shared();
+
+        std::size_t workerCount() const;
+
+        void submit(std::function<void()> task);
+
+        bool runOne();
+
+/**
+ * @brief Calls body(chunk) for every chunk in [0, chunks) on the pool and waits for all of them.
+ * The range is split in halves recursively: the thread running a range submits its upper half and keeps
+ * the lower one, so idle workers steal large ranges first and every thread ends up on contiguous chunks.
+ * @param chunks The number of chunks.
+ * @param body The function to run for each chunk index.
+ * @throws The first exception thrown by body, once every chunk has finished.
+ */
+        template<typename Body>
+        void parallelChunks(std::size_t chunks, Body &&body) {
+            if (chunks == 0) {
+                return;
+            }
+            // Tasks hold the loop state by shared_ptr, so it outlives a worker that is still returning from
+            // the last chunk when the caller sees the count reach zero.
+            struct Loop {
+                std::atomic<std::size_t> remaining;
+                std::mutex errorMutex;
+                std::exception_ptr error;
+                std::function<void(const std::shared_ptr<Loop> &, std::size_t, std::size_t)> run;
+            };
+            auto loop = std::make_shared<Loop>();
+            loop->remaining.store(chunks);
+            loop->run = [this, &body](const std::shared_ptr<Loop> &self, std::size_t low, std::size_t high) {
+                while (high - low > 1) {
+                    const std::size_t middle = low + (high - low) / 2;
+                    submit([self, middle, high] {
+                        self->run(self, middle, high);
+                    });
+                    high = middle;
+                }
+                try {
+                    body(low);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(self->errorMutex);
+                    if (!self->error) {
+                        self->error = std::current_exception();
+                    }
+                }
+                self->remaining.fetch_sub(1, std::memory_order_acq_rel);
+            };
+
+            loop->run(loop, 0, chunks);
+            while (loop->remaining.load(std::memory_order_acquire) != 0) {
+                if (!runOne()) {
+                    std::this_thread::yield();
+                }
+            }
+            if (loop->error) {
+                std::rethrow_exception(loop->error);
+            }
+        }
+    };
+
+    constexpr std::size_t DefaultParallelGrain = 1U << 14U;
+
+}
+
+#endif //MAGICAL_ITERATORS_THREADPOOL_HPP
@@ -0,0 +1,213 @@
+//
+// Incrementally maintained value histogram.
+//
+
+#include "ValueHistogram.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+#include <stdexcept>
+
+namespace ariel {
+
+    namespace {
+
+        constexpr std::size_t ZeroBucket = 32;
+
+    }
+
+/**
+ * @brief Creates an empty histogram of equal-width buckets over [low, high].
+ * If the range does not divide evenly, the width is rounded up and the last bucket may end past high.
+ * @param low The smallest value of the first bucket.
+ * @param high The largest value that is not counted as overflow.
+ * @param bucketCount The number of buckets; fewer are made if the range holds fewer values.
+ * @return The histogram.
+ * @throws std::runtime_error if low is greater than high or bucketCount is 0.
+ */
+    ValueHistogram ValueHistogram::linear(int low, int high, std::size_t bucketCount) {
+        if (low > high || bucketCount == 0) {
+            throw std::runtime_error("Error: Invalid histogram layout");
+        }
+        const long long range = static_cast<long long>(high) - low + 1;
+        const auto buckets = static_cast<long long>(bucketCount);
+        ValueHistogram histogram;
+        histogram.scale = BucketScale::Linear;
+        histogram.low = low;
+        histogram.width = (range + buckets - 1) / buckets;
+        histogram.buckets.assign(static_cast<std::size_t>((range + histogram.width - 1) / histogram.width), 0);
+        return histogram;
+    }
+
+/**
+ * @brief Creates an empty log-scaled histogram. Bucket 32 holds 0; bucket 32 + b holds [2^(b-1), 2^b) and
+ * bucket 32 - b holds (-2^b, -2^(b-1)], so bucket 0 holds only INT_MIN.
+ * @return The histogram.
+ */
+    ValueHistogram ValueHistogram::log2() {
+        return {};
+    }
+
+/**
+ * @brief Get the counter a value is counted in.
+ * @param value The value.
+ * @return Its bucket, or the underflow or overflow counter of a linear histogram.
+ */
+    std::uint64_t *ValueHistogram::counterOf(int value) {
+        if (scale == BucketScale::Log2) {
+            const std::uint64_t magnitude = value < 0 ? static_cast<std::uint64_t>(-static_cast<long long>(value))
+                                                      : static_cast<std::uint64_t>(value);
+            const auto bits = static_cast<std::size_t>(std::bit_width(magnitude));
+            return &buckets[value < 0 ? ZeroBucket - bits : ZeroBucket + bits];
+        }
+        if (value < low) {
+            return &underflowCount;
+        }
+        const auto index = static_cast<std::size_t>((value - low) / width);
+        return index < buckets.size() ? &buckets[index] : &overflowCount;
+    }
+
+/**
+ * @brief Counts one more occurrence of a value.
+ * @param value The value.
+ */
+    void ValueHistogram::add(int value) {
+        ++*counterOf(value);
+        ++total;
+    }
+
+/**
+ * @brief Counts one occurrence of a value less. The value must have been added before.
+ * @param value The value.
+ */
+    void ValueHistogram::remove(int value) {
+        --*counterOf(value);
+        --total;
+    }
+
+/**
+ * @brief Resets every count to 0 and keeps the bucket layout.
+ */
+    void ValueHistogram::clear() {
+        std::fill(buckets.begin(), buckets.end(), 0);
+        underflowCount = 0;
+        overflowCount = 0;
+        total = 0;
+    }
+
+/**
+ * @brief Get the bucket layout.
+ * @return Linear or Log2.
+ */
+    BucketScale ValueHistogram::getScale() const {
+        return scale;
+    }
+
+/**
+ * @brief Get the number of buckets, not counting underflow and overflow.
+ * @return The number of buckets.
+ */
+    std::size_t ValueHistogram::bucketCount() const {
+        return buckets.size();
+    }
+
+/**
+ * @brief Get the number of values in one bucket.
+ * @param index The bucket.
+ * @return The number of values in [bucketLow(index), bucketHigh(index)].
+ * @throws std::out_of_range if the index is out of range.
+ */
+    std::uint64_t ValueHistogram::bucket(std::size_t index) const {
+        return buckets.at(index);
+    }
+
+/**
+ * @brief Get the smallest value of a bucket.
+ * @param index The bucket, assumed to be in range.
+ * @return The smallest value the bucket holds.
+ */
+    long long ValueHistogram::bucketLow(std::size_t index) const {
+        if (scale == BucketScale::Linear) {
+            return low + static_cast<long long>(index) * width;
+        }
+        if (index < ZeroBucket) {
+            const long long smallest = -(1LL << (ZeroBucket - index)) + 1;
+            return std::max(smallest, static_cast<long long>(std::numeric_limits<int>::min()));
+        }
+        return index == ZeroBucket ? 0 : 1LL << (index - ZeroBucket - 1);
+    }
+
+/**
+ * @brief Get the largest value of a bucket.
+ * @param index The bucket, assumed to be in range.
+ * @return The largest value the bucket holds.
+ */
+    long long ValueHistogram::bucketHigh(std::size_t index) const {
+        if (scale == BucketScale::Linear) {
+            return bucketLow(index) + width - 1;
+        }
+        if (index < ZeroBucket) {
+            return -(1LL << (ZeroBucket - index - 1));
+        }
+        return index == ZeroBucket ? 0 : (1LL << (index - ZeroBucket)) - 1;
+    }
+
+/**
+ * @brief Get the number of values below the first bucket of a linear histogram.
+ * @return The underflow count, always 0 for a log-scaled histogram.
+ */
+    std::uint64_t ValueHistogram::underflow() const {
+        return underflowCount;
+    }
+
+/**
+ * @brief Get the number of values above the last bucket of a linear histogram.
+ * @return The overflow count, always 0 for a log-scaled histogram.
+ */
+    std::uint64_t ValueHistogram::overflow() const {
+        return overflowCount;
+    }
+
+/**
+ * @brief Get the number of values counted.
+ * @return The number of values, including underflow and overflow.
+ */
+    std::uint64_t ValueHistogram::count() const {
+        return total;
+    }
+
+/**
+ * @brief Estimates a quantile from the bucket counts, assuming the values of a bucket are spread evenly over
+ * it. The estimate is off by at most the width of the bucket it falls in; underflow and overflow values are
+ * taken to lie at the first and last bucket boundary.
+ * @param q The quantile, in [0, 1]; 0 is the smallest value and 1 the largest.
+ * @return The estimated value.
+ * @throws std::runtime_error if the histogram is empty or q is outside [0, 1].
+ */
+    double ValueHistogram::quantile(double q) const {
+        if (total == 0) {
+            throw std::runtime_error("Error: Histogram is empty");
+        }
+        if (!(q >= 0 && q <= 1)) {
+            throw std::runtime_error("Error: Quantile must be in [0, 1]");
+        }
+        double rank = q * static_cast<double>(total - 1);
+        if (rank < static_cast<double>(underflowCount)) {
+            return static_cast<double>(bucketLow(0));
+        }
+        rank -= static_cast<double>(underflowCount);
+        for (std::size_t index = 0; index < buckets.size(); ++index) {
+            const auto inBucket = static_cast<double>(buckets[index]);
+            if (rank < inBucket) {
+                const auto span = static_cast<double>(bucketHigh(index) - bucketLow(index) + 1);
+                const double estimate = static_cast<double>(bucketLow(index)) + (rank + 0.5) / inBucket * span - 0.5;
+                return std::clamp(estimate, static_cast<double>(bucketLow(index)),
+                                  static_cast<double>(bucketHigh(index)));
+            }
+            rank -= inBucket;
+        }
+        return static_cast<double>(bucketHigh(buckets.size() - 1));
+    }
+
+}
@@ -0,0 +1,78 @@
+/**
+ * @file ValueHistogram.hpp
+ * @class ValueHistogram
+ * @brief A histogram of integer values that is updated one value at a time.
+ * Buckets are either linear, a fixed number of equal-width buckets over [low, high] with values outside
+ * that range counted as underflow or overflow, or log-scaled: one bucket for 0 and one for every power-of-two
+ * magnitude on each side of it, which covers every int in 64 buckets. Adding or removing a value costs one
+ * bucket computation and one counter update. Quantiles are interpolated within a bucket as if its values
+ * were spread evenly over it, so their error is bounded by the bucket width.
+ */
+
+#ifndef MAGICAL_ITERATORS_VALUEHISTOGRAM_HPP
+#define MAGICAL_ITERATORS_VALUEHISTOGRAM_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ariel {
+
+    enum class BucketScale {
+        Linear, Log2
+    };
+
+    class ValueHistogram {
+    public:
+
+        /// One bucket for 0, 32 for the power-of-two magnitudes of negative ints and 31 for positive ones.
+        static constexpr std::size_t Log2BucketCount = 64;
+
+    private:
+
+        BucketScale scale = BucketScale::Log2;
+        long long low = 0;
+        long long width = 1;
+        std::vector<std::uint64_t> buckets = std::vector<std::uint64_t>(Log2BucketCount, 0);
+        std::uint64_t underflowCount = 0;
+        std::uint64_t overflowCount = 0;
+        std::uint64_t total = 0;
+
+        std::uint64_t *counterOf(int value);
+
+    public:
+
+        ValueHistogram() = default;
+
+        static ValueHistogram linear(int low, int high, std::size_t bucketCount);
+
+        static ValueHistogram log2();
+
+        void add(int value);
+
+        void remove(int value);
+
+        void clear();
+
+        BucketScale getScale() const;
+
+        std::size_t bucketCount() const;
+
+        std::uint64_t bucket(std::size_t index) const;
+
+        long long bucketLow(std::size_t index) const;
+
+        long long bucketHigh(std::size_t index) const;
+
+        std::uint64_t underflow() const;
+
+        std::uint64_t overflow() const;
+
+        std::uint64_t count() const;
+
+        double quantile(double q) const;
+    };
+
+}
+
+#endif //MAGICAL_ITERATORS_VALUEHISTOGRAM_HPP